@@ -0,0 +1,67 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include "signalserver.h"
+
+using namespace std;
+
+
+void usage(const char* prg);
+
+static std::atomic<bool> g_running(true);
+
+void on_signal(int) {
+  g_running = false;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int port = argc > 1 ? atoi(argv[1]) : 0;
+  string address = argc > 2 ? argv[2] : "127.0.0.1";
+
+  if (port < 0 || port > 65535) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  peerapi::SignalServer server;
+  if (!server.Start(address, static_cast<uint16_t>(port))) {
+    std::cerr << "Failed to start signal server." << std::endl;
+    return 1;
+  }
+
+  std::cout << "Signal server is listening on " << server.url() << std::endl;
+  std::cout << "Use {\"url\": \"" << server.url() << "\"} as options of peer." << std::endl;
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  while (g_running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  server.Stop();
+  return 0;
+}
+
+void usage(const char* prg) {
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << prg << " [port] [address]" << std::endl << std::endl;
+  std::cerr << "Example: " << std::endl << std::endl;
+  std::cerr << "   > " << prg << " 8443" << std::endl;
+}
@@ -0,0 +1,813 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+//
+// Benchmark of peers in one process with a local signal server.
+//
+// Each scenario opens its own peers, measures and closes them, so results
+// don't depend on the order of scenarios. Results are written in JSON to
+// track regressions over time.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <ctime>
+
+#include "webrtc/base/thread.h"
+
+#include "peerapi.h"
+#include "signalserver.h"
+#include "resourceusage.h"
+
+using namespace std;
+
+
+//
+// Configuration
+//
+
+struct Config {
+  std::vector<string> scenarios;
+  string output;
+  string options;                         // Additional options of peers
+  size_t bytes = 64 * 1024 * 1024;        // Bytes of throughput scenarios
+  size_t message_size = 16 * 1024;        // Message size of throughput and fanout
+  size_t sweep_bytes = 8 * 1024 * 1024;   // Bytes of each size of message_rate
+  size_t window = 1024 * 1024;            // Bytes in flight of asynchronous send
+  size_t rtt_size = 64;
+  int iterations = 1000;                  // Round trips of rtt
+  int peers = 16;                         // Peers of fanout, setup and idle_memory
+  int fanout_messages = 100;              // Messages to each peer of fanout
+  int idle_ms = 2000;                     // Idle time of idle_memory
+  int timeout = 120;                      // Seconds of each run
+  bool local_transport = false;
+};
+
+Config config;
+string signal_options;
+
+const char* kScenarios[] = {
+  "throughput_async", "throughput_sync", "message_rate", "rtt", "fanout", "setup",
+  "idle_memory"
+};
+
+const size_t kSweepSizes[] = {
+  64, 256, 1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024
+};
+
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Nearest-rank percentile of sorted values
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+  if (rank < 1) rank = 1;
+  if (rank > sorted.size()) rank = sorted.size();
+  return sorted[rank - 1];
+}
+
+
+//
+// class Result
+//
+// A JSON object of one run
+//
+
+class Result {
+public:
+  explicit Result(const string& scenario) : ok_(false) {
+    Add("scenario", scenario);
+  }
+
+  Result& Add(const string& key, const string& value) {
+    fields_.push_back(std::make_pair(key, "\"" + value + "\""));
+    return *this;
+  }
+
+  Result& Add(const string& key, double value) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << value;
+    fields_.push_back(std::make_pair(key, out.str()));
+    return *this;
+  }
+
+  Result& Add(const string& key, int64_t value) {
+    fields_.push_back(std::make_pair(key, std::to_string(value)));
+    return *this;
+  }
+
+  Result& Add(const string& key, size_t value) {
+    return Add(key, static_cast<int64_t>(value));
+  }
+
+  Result& Add(const string& key, int value) {
+    return Add(key, static_cast<int64_t>(value));
+  }
+
+  // Rates of a transfer of |messages| and |bytes| in |us| microseconds
+  Result& AddRates(size_t messages, size_t bytes, int64_t us) {
+    double seconds = us / 1000000.0;
+    Add("messages", messages);
+    Add("bytes", bytes);
+    Add("seconds", seconds);
+    Add("messages_per_sec", seconds > 0 ? messages / seconds : 0);
+    Add("mbytes_per_sec", seconds > 0 ? bytes / seconds / (1024 * 1024) : 0);
+    return *this;
+  }
+
+  void set_ok(bool ok) { ok_ = ok; }
+  bool ok() const { return ok_; }
+
+  string ToJson(const string& indent) const {
+    std::ostringstream out;
+    out << indent << "{";
+    for (size_t i = 0; i < fields_.size(); i++) {
+      out << (i == 0 ? "" : ",") << "\n" << indent << "  \""
+          << fields_[i].first << "\": " << fields_[i].second;
+    }
+    out << ",\n" << indent << "  \"ok\": " << (ok_ ? "true" : "false");
+    out << "\n" << indent << "}";
+    return out.str();
+  }
+
+private:
+  std::vector<std::pair<string, string>> fields_;
+  bool ok_;
+};
+
+std::vector<Result> results;
+
+
+//
+// class Session
+//
+// A server peer and clients connected to it. Run() opens peers, calls
+// on_ready_ when all clients are connected and returns after Finish() or
+// a timeout.
+//
+
+class Session : public rtc::MessageHandler {
+public:
+  explicit Session(int clients)
+      : thread_(rtc::Thread::Current()),
+        server_id_(Peer::CreateRandomUuid()),
+        server_(server_id_),
+        opened_(0), connected_(0), closed_(0),
+        finishing_(false), timed_out_(false) {
+
+    for (int i = 0; i < clients; i++) {
+      client_ids_.push_back(Peer::CreateRandomUuid());
+      clients_.emplace_back(new Peer(client_ids_[i]));
+      index_[client_ids_[i]] = i;
+      connect_us_.push_back(0);
+      connected_us_.push_back(0);
+    }
+  }
+
+  ~Session() {
+    thread_->Clear(this);
+  }
+
+  // Client index by peer id
+  int index(const string& peer_id) {
+    auto it = index_.find(peer_id);
+    return it == index_.end() ? -1 : it->second;
+  }
+
+  const string& server_id() const { return server_id_; }
+  const string& client_id(int i) const { return client_ids_[i]; }
+  Peer& server() { return server_; }
+  Peer& client(int i) { return *clients_[i]; }
+  int clients() const { return static_cast<int>(clients_.size()); }
+  int64_t connect_us(int i) const { return connect_us_[i]; }
+  int64_t connected_us(int i) const { return connected_us_[i]; }
+
+  bool Run() {
+    server_.SetOptions(signal_options);
+    server_.SetOptions(config.options);
+    server_.On("open", function_peer( string peer_id ) {
+      opened_++;
+      for (auto& client : clients_) client->Open();
+    });
+
+    server_.On("connect", function_peer( string peer_id ) {
+      OnConnected();
+    });
+
+    server_.On("close", function_peer( string peer_id, CloseCode code, string desc ) {
+      if (peer_id == server_id_) OnClosed();
+    });
+
+    server_.On("message", function_peer( string peer_id, char* data, size_t size ) {
+      if (on_server_message_) on_server_message_(index(peer_id), data, size);
+    });
+
+    for (int i = 0; i < clients(); i++) {
+      Peer& peer = client(i);
+      peer.SetOptions(signal_options);
+      peer.SetOptions(config.options);
+
+      peer.On("open", [this, i]( string peer_id ) {
+        opened_++;
+        if (finishing_) return;
+        connect_us_[i] = NowUs();
+        client(i).Connect(server_id_);
+      });
+
+      peer.On("connect", [this, i]( string peer_id ) {
+        connected_us_[i] = NowUs();
+        OnConnected();
+      });
+
+      peer.On("close", [this, i]( string peer_id, CloseCode code, string desc ) {
+        if (peer_id == client_ids_[i]) OnClosed();
+      });
+
+      peer.On("message", [this, i]( string peer_id, char* data, size_t size ) {
+        if (on_client_message_) on_client_message_(i, data, size);
+      });
+
+      peer.On("writable", [this, i]( string peer_id ) {
+        if (on_client_writable_ && !finishing_) on_client_writable_(i);
+      });
+    }
+
+    thread_->PostDelayed(RTC_FROM_HERE, config.timeout * 1000, this, MSG_TIMEOUT);
+    server_.Open();
+    Peer::Run();
+    thread_->Clear(this);
+
+    return !timed_out_;
+  }
+
+  // Close all peers. Run() returns when they have been closed, or after
+  // kCloseTimeoutMs if some of them don't emit "close".
+  void Finish() {
+    if (finishing_) return;
+    finishing_ = true;
+
+    // Clients are opened by "open" of the server
+    if (opened_ == 0) {
+      Peer::Stop();
+      return;
+    }
+
+    for (auto& client : clients_) client->Close();
+    server_.Close();
+
+    thread_->PostDelayed(RTC_FROM_HERE, kCloseTimeoutMs, this, MSG_CLOSE_TIMEOUT);
+  }
+
+  // Finish() from other threads
+  void PostFinish() {
+    thread_->Post(RTC_FROM_HERE, this, MSG_FINISH);
+  }
+
+  // Call |callback| after |ms| milliseconds
+  void PostDelayed(int ms, std::function<void()> callback) {
+    thread_->PostDelayed(RTC_FROM_HERE, ms, this, MSG_CALLBACK,
+                         new CallbackData(callback));
+  }
+
+  bool timed_out() const { return timed_out_; }
+
+  std::function<void()> on_ready_;
+  std::function<void(int, const char*, size_t)> on_server_message_;
+  std::function<void(int, const char*, size_t)> on_client_message_;
+  std::function<void(int)> on_client_writable_;
+
+protected:
+  void OnMessage(rtc::Message* msg) override {
+    switch (msg->message_id) {
+    case MSG_TIMEOUT:
+      std::cerr << "Timeout in " << config.timeout << " seconds" << std::endl;
+      timed_out_ = true;
+      Finish();
+      break;
+    case MSG_FINISH:
+      Finish();
+      break;
+    case MSG_CALLBACK: {
+      std::unique_ptr<CallbackData> data(static_cast<CallbackData*>(msg->pdata));
+      if (!finishing_) data->callback_();
+      break;
+    }
+    case MSG_CLOSE_TIMEOUT:
+      std::cerr << "Peers have not been closed" << std::endl;
+      Peer::Stop();
+      break;
+    }
+  }
+
+private:
+  enum {
+    MSG_TIMEOUT,          // A run has not finished in config.timeout
+    MSG_FINISH,           // Finish() has been called by other threads
+    MSG_CALLBACK,         // A callback of PostDelayed()
+    MSG_CLOSE_TIMEOUT     // Peers have not been closed after the timeout
+  };
+
+  struct CallbackData : public rtc::MessageData {
+    explicit CallbackData(std::function<void()> callback) : callback_(callback) {}
+    std::function<void()> callback_;
+  };
+
+  static const int kCloseTimeoutMs = 5000;
+
+  void OnConnected() {
+    // Both of a server and a client emit "connect"
+    if (++connected_ == clients() * 2 && on_ready_ && !finishing_) {
+      on_ready_();
+    }
+  }
+
+  void OnClosed() {
+    if (++closed_ == clients() + 1) Peer::Stop();
+  }
+
+  rtc::Thread* thread_;
+  string server_id_;
+  Peer server_;
+  std::vector<string> client_ids_;
+  std::vector<std::unique_ptr<Peer>> clients_;
+  std::map<string, int> index_;
+  std::vector<int64_t> connect_us_;
+  std::vector<int64_t> connected_us_;
+  int opened_;         // Peers emitted "open"
+  int connected_;
+  int closed_;
+  bool finishing_;
+  bool timed_out_;
+};
+
+
+//
+// Scenarios
+//
+
+// A client sends |count| messages of |size| bytes to the server.
+//
+// Asynchronous send fails if the buffer of a data channel is full, so the
+// server acknowledges received bytes and the client keeps at most
+// config.window bytes in flight. Synchronous send waits for each message
+// in another thread, since it blocks until the buffer is drained.
+Result RunTransfer(const string& scenario, size_t size, size_t count, bool sync) {
+  Result result(scenario);
+  result.Add("mode", string(sync ? "sync" : "async"));
+  result.Add("message_size", size);
+
+  Session session(1);
+  const string payload(size, 'x');
+  const size_t total = size * count;
+  const size_t window = std::max(config.window, size * 4);
+  const size_t ack_bytes = window / 4;
+
+  size_t sent = 0;
+  size_t acked = 0;
+  size_t received = 0;
+  size_t last_ack = 0;
+  int64_t start_us = 0;
+  int64_t end_us = 0;
+  std::thread sender;
+  std::atomic<bool> failed(false);
+
+  // Send() fails if a send buffer or the send budget is full, then the
+  // client pumps again on "writable"
+  auto pump = [&]() {
+    while (sent < total && sent - acked < window) {
+      if (!session.client(0).Send(session.server_id(), payload.data(), size)) break;
+      sent += size;
+    }
+  };
+
+  session.on_client_writable_ = [&](int client) {
+    if (!sync && start_us > 0) pump();
+  };
+
+  session.on_ready_ = [&]() {
+    start_us = NowUs();
+    if (!sync) {
+      pump();
+      return;
+    }
+
+    sender = std::thread([&]() {
+      for (size_t i = 0; i < count; i++) {
+        if (!session.client(0).Send(session.server_id(), payload.data(), size, SYNC_ON)) {
+          std::cerr << "Failed to send synchronously" << std::endl;
+          failed = true;
+          session.PostFinish();
+          return;
+        }
+      }
+    });
+  };
+
+  session.on_server_message_ = [&](int client, const char* data, size_t length) {
+    received += length;
+    if (!sync && (received - last_ack >= ack_bytes || received == total)) {
+      last_ack = received;
+      session.server().Send(session.client_id(client), std::to_string(received));
+    }
+
+    if (received == total) {
+      end_us = NowUs();
+      session.Finish();
+    }
+  };
+
+  session.on_client_message_ = [&](int client, const char* data, size_t length) {
+    acked = std::strtoull(string(data, length).c_str(), nullptr, 10);
+    pump();
+  };
+
+  bool ok = session.Run();
+  if (sender.joinable()) sender.join();
+
+  result.set_ok(ok && !failed && received == total);
+  result.AddRates(count, total, result.ok() ? end_us - start_us : 0);
+  return result;
+}
+
+// Round trips of a message of config.rtt_size bytes between a client and
+// the server echoing it. The first round trips are not measured.
+Result RunRtt() {
+  Result result("rtt");
+  result.Add("message_size", config.rtt_size);
+
+  Session session(1);
+  const string payload(config.rtt_size, 'x');
+  const int warmup = std::min(10, config.iterations / 10);
+  std::vector<double> rtts;
+  int sent = 0;
+  int64_t sent_us = 0;
+
+  auto ping = [&]() {
+    sent++;
+    sent_us = NowUs();
+    session.client(0).Send(session.server_id(), payload.data(), payload.size());
+  };
+
+  session.on_ready_ = ping;
+
+  session.on_server_message_ = [&](int client, const char* data, size_t size) {
+    session.server().Send(session.client_id(client), data, size);
+  };
+
+  session.on_client_message_ = [&](int client, const char* data, size_t size) {
+    if (sent > warmup) rtts.push_back((NowUs() - sent_us) / 1000.0);
+
+    if (sent < config.iterations + warmup) {
+      ping();
+    }
+    else {
+      session.Finish();
+    }
+  };
+
+  bool ok = session.Run();
+
+  std::sort(rtts.begin(), rtts.end());
+  double sum = 0;
+  for (double rtt : rtts) sum += rtt;
+
+  result.Add("iterations", rtts.size());
+  result.Add("min_ms", rtts.empty() ? 0 : rtts.front());
+  result.Add("mean_ms", rtts.empty() ? 0 : sum / rtts.size());
+  result.Add("p50_ms", Percentile(rtts, 50));
+  result.Add("p90_ms", Percentile(rtts, 90));
+  result.Add("p99_ms", Percentile(rtts, 99));
+  result.Add("max_ms", rtts.empty() ? 0 : rtts.back());
+  result.set_ok(ok && rtts.size() == static_cast<size_t>(config.iterations));
+  return result;
+}
+
+// The server sends config.fanout_messages messages to each of config.peers
+// clients in turn.
+Result RunFanout() {
+  Result result("fanout");
+  result.Add("peers", config.peers);
+  result.Add("message_size", config.message_size);
+
+  Session session(config.peers);
+  const string payload(config.message_size, 'x');
+  std::vector<int> received(config.peers, 0);
+  std::vector<double> done_ms;
+  int64_t start_us = 0;
+  int64_t end_us = 0;
+
+  session.on_ready_ = [&]() {
+    start_us = NowUs();
+    for (int m = 0; m < config.fanout_messages; m++) {
+      for (int i = 0; i < session.clients(); i++) {
+        session.server().Send(session.client_id(i), payload.data(), payload.size());
+      }
+    }
+  };
+
+  session.on_client_message_ = [&](int client, const char* data, size_t size) {
+    if (++received[client] != config.fanout_messages) return;
+
+    end_us = NowUs();
+    done_ms.push_back((end_us - start_us) / 1000.0);
+    if (done_ms.size() == received.size()) session.Finish();
+  };
+
+  bool ok = session.Run();
+  ok = ok && done_ms.size() == received.size();
+
+  const size_t messages = static_cast<size_t>(config.peers) * config.fanout_messages;
+  std::sort(done_ms.begin(), done_ms.end());
+
+  result.AddRates(messages, messages * config.message_size, ok ? end_us - start_us : 0);
+  result.Add("peer_p50_ms", Percentile(done_ms, 50));
+  result.Add("peer_p99_ms", Percentile(done_ms, 99));
+  result.set_ok(ok);
+  return result;
+}
+
+// config.peers clients connect to the server at the same time. A setup time
+// of a peer is from Connect() to "connect", after the signal server is
+// connected.
+Result RunSetup() {
+  Result result("setup");
+  result.Add("peers", config.peers);
+
+  Session session(config.peers);
+  session.on_ready_ = [&]() {
+    session.Finish();
+  };
+
+  bool ok = session.Run();
+
+  std::vector<double> setup_ms;
+  int64_t first_us = 0;
+  int64_t last_us = 0;
+
+  for (int i = 0; i < session.clients(); i++) {
+    if (session.connected_us(i) == 0) continue;
+    setup_ms.push_back((session.connected_us(i) - session.connect_us(i)) / 1000.0);
+    if (first_us == 0 || session.connect_us(i) < first_us) first_us = session.connect_us(i);
+    if (session.connected_us(i) > last_us) last_us = session.connected_us(i);
+  }
+
+  ok = ok && setup_ms.size() == static_cast<size_t>(config.peers);
+  std::sort(setup_ms.begin(), setup_ms.end());
+
+  double seconds = ok ? (last_us - first_us) / 1000000.0 : 0;
+  result.Add("seconds", seconds);
+  result.Add("connections_per_sec", seconds > 0 ? config.peers / seconds : 0);
+  result.Add("p50_ms", Percentile(setup_ms, 50));
+  result.Add("p90_ms", Percentile(setup_ms, 90));
+  result.Add("p99_ms", Percentile(setup_ms, 99));
+  result.Add("max_ms", setup_ms.empty() ? 0 : setup_ms.back());
+  result.set_ok(ok);
+  return result;
+}
+
+// config.peers clients connect to the server and stay idle for
+// config.idle_ms. Heap usage by subsystem, if built with
+// PEERAPI_MEMORY_ACCOUNTING, and RSS are compared with those before the
+// peers are created. Both ends of each connection and a signal connection
+// of each client are in this process, so a cost of a peer at one end is
+// about a half of the heap of "peer" and "channel".
+Result RunIdleMemory() {
+  Result result("idle_memory");
+  result.Add("peers", config.peers);
+  result.Add("idle_ms", config.idle_ms);
+
+  const Usage usage_before = SampleUsage();
+  const std::vector<Peer::MemoryUsage> heap_before = Peer::GetMemoryUsage();
+  Usage usage_idle;
+  std::vector<Peer::MemoryUsage> heap_idle;
+  bool sampled = false;
+  bool ok;
+
+  {
+    Session session(config.peers);
+    session.on_ready_ = [&]() {
+      session.PostDelayed(config.idle_ms, [&]() {
+        usage_idle = SampleUsage();
+        heap_idle = Peer::GetMemoryUsage();
+        sampled = true;
+        session.Finish();
+      });
+    };
+
+    ok = session.Run();
+  }
+
+  if (sampled && usage_before.rss_kb >= 0) {
+    result.Add("rss_bytes_per_peer",
+               (usage_idle.rss_kb - usage_before.rss_kb) * 1024.0 / config.peers);
+  }
+
+  if (sampled && !heap_idle.empty()) {
+    int64_t total = 0;
+    for (size_t i = 0; i < heap_idle.size(); i++) {
+      int64_t bytes = static_cast<int64_t>(heap_idle[i].bytes_) -
+                      static_cast<int64_t>(heap_before[i].bytes_);
+      result.Add("heap_" + heap_idle[i].subsystem_ + "_bytes_per_peer",
+                 static_cast<double>(bytes) / config.peers);
+      total += bytes;
+    }
+    result.Add("heap_bytes_per_peer", static_cast<double>(total) / config.peers);
+  }
+
+  result.set_ok(ok && sampled);
+  return result;
+}
+
+void RunScenario(const string& scenario) {
+  std::cerr << "Run " << scenario << std::endl;
+
+  if (scenario == "throughput_async") {
+    results.push_back(RunTransfer(scenario, config.message_size,
+                                  config.bytes / config.message_size, false));
+  }
+  else if (scenario == "throughput_sync") {
+    results.push_back(RunTransfer(scenario, config.message_size,
+                                  config.bytes / config.message_size, true));
+  }
+  else if (scenario == "message_rate") {
+    for (size_t size : kSweepSizes) {
+      size_t count = std::max<size_t>(config.sweep_bytes / size, 16);
+      results.push_back(RunTransfer(scenario, size, count, false));
+    }
+  }
+  else if (scenario == "rtt") {
+    results.push_back(RunRtt());
+  }
+  else if (scenario == "fanout") {
+    results.push_back(RunFanout());
+  }
+  else if (scenario == "setup") {
+    results.push_back(RunSetup());
+  }
+  else if (scenario == "idle_memory") {
+    results.push_back(RunIdleMemory());
+  }
+}
+
+
+//
+// main
+//
+
+void usage(const char* prg);
+bool ParseArguments(int argc, char* argv[]);
+string ToJson();
+
+int main(int argc, char *argv[]) {
+  if (!ParseArguments(argc, argv)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  peerapi::SignalServer signal_server;
+  if (!signal_server.Start()) {
+    std::cerr << "Failed to start signal server" << std::endl;
+    return 1;
+  }
+
+  signal_options = "{\"url\": \"" + signal_server.url() + "\", \"ice_mode\": \"local\", "
+                   "\"local_transport\": " + (config.local_transport ? "true" : "false") + "}";
+
+  for (auto& scenario : config.scenarios) {
+    RunScenario(scenario);
+  }
+
+  signal_server.Stop();
+
+  if (config.output.empty()) {
+    std::cout << ToJson();
+  }
+  else {
+    std::ofstream out(config.output);
+    out << ToJson();
+    if (!out) {
+      std::cerr << "Failed to write " << config.output << std::endl;
+      return 1;
+    }
+  }
+
+  for (auto& result : results) {
+    if (!result.ok()) return 1;
+  }
+  return 0;
+}
+
+bool ParseArguments(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--local-transport") {
+      config.local_transport = true;
+      continue;
+    }
+
+    if (i + 1 >= argc) return false;
+    string value = argv[++i];
+
+    if (arg == "--scenario") {
+      std::istringstream names(value);
+      string name;
+      while (std::getline(names, name, ',')) {
+        if (std::find(std::begin(kScenarios), std::end(kScenarios), name) == std::end(kScenarios)) {
+          std::cerr << "Unknown scenario: " << name << std::endl;
+          return false;
+        }
+        config.scenarios.push_back(name);
+      }
+    }
+    else if (arg == "--output") config.output = value;
+    else if (arg == "--options") config.options = value;
+    else if (arg == "--bytes") config.bytes = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--message-size") config.message_size = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--sweep-bytes") config.sweep_bytes = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--window") config.window = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--rtt-size") config.rtt_size = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--iterations") config.iterations = std::atoi(value.c_str());
+    else if (arg == "--peers") config.peers = std::atoi(value.c_str());
+    else if (arg == "--fanout-messages") config.fanout_messages = std::atoi(value.c_str());
+    else if (arg == "--idle-ms") config.idle_ms = std::atoi(value.c_str());
+    else if (arg == "--timeout") config.timeout = std::atoi(value.c_str());
+    else return false;
+  }
+
+  if (config.scenarios.empty()) {
+    config.scenarios.assign(std::begin(kScenarios), std::end(kScenarios));
+  }
+
+  return config.message_size > 0 && config.bytes >= config.message_size &&
+         config.rtt_size > 0 && config.iterations > 0 && config.peers > 0 &&
+         config.fanout_messages > 0 && config.idle_ms >= 0 && config.timeout > 0;
+}
+
+string ToJson() {
+  std::ostringstream out;
+  out << "{\n"
+      << "  \"benchmark\": \"peerapi\",\n"
+      << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+      << "  \"config\": {\n"
+      << "    \"local_transport\": " << (config.local_transport ? "true" : "false") << ",\n"
+      << "    \"bytes\": " << config.bytes << ",\n"
+      << "    \"message_size\": " << config.message_size << ",\n"
+      << "    \"sweep_bytes\": " << config.sweep_bytes << ",\n"
+      << "    \"window\": " << config.window << ",\n"
+      << "    \"rtt_size\": " << config.rtt_size << ",\n"
+      << "    \"iterations\": " << config.iterations << ",\n"
+      << "    \"peers\": " << config.peers << ",\n"
+      << "    \"fanout_messages\": " << config.fanout_messages << ",\n"
+      << "    \"idle_ms\": " << config.idle_ms << ",\n"
+      << "    \"memory_accounting\": " << (Peer::GetMemoryUsage().empty() ? "false" : "true") << "\n"
+      << "  },\n"
+      << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    out << (i == 0 ? "\n" : ",\n") << results[i].ToJson("    ");
+  }
+
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+void usage(const char* prg) {
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << prg << " [options]" << std::endl << std::endl;
+  std::cerr << "  --scenario a,b,...     throughput_async, throughput_sync, message_rate," << std::endl;
+  std::cerr << "                         rtt, fanout, setup, idle_memory (default: all)" << std::endl;
+  std::cerr << "  --output file          Write JSON results to file (default: stdout)" << std::endl;
+  std::cerr << "  --options json         Additional options of peers" << std::endl;
+  std::cerr << "  --local-transport      Use the in-process transport instead of data channels" << std::endl;
+  std::cerr << "  --bytes n              Bytes of throughput (default: 67108864)" << std::endl;
+  std::cerr << "  --message-size n       Message size of throughput and fanout (default: 16384)" << std::endl;
+  std::cerr << "  --sweep-bytes n        Bytes of each size of message_rate (default: 8388608)" << std::endl;
+  std::cerr << "  --window n             Bytes in flight of asynchronous send (default: 1048576)" << std::endl;
+  std::cerr << "  --rtt-size n           Message size of rtt (default: 64)" << std::endl;
+  std::cerr << "  --iterations n         Round trips of rtt (default: 1000)" << std::endl;
+  std::cerr << "  --peers n              Peers of fanout, setup and idle_memory (default: 16)" << std::endl;
+  std::cerr << "  --fanout-messages n    Messages to each peer of fanout (default: 100)" << std::endl;
+  std::cerr << "  --idle-ms n            Idle time of idle_memory (default: 2000)" << std::endl;
+  std::cerr << "  --timeout n            Seconds of each run (default: 120)" << std::endl;
+  std::cerr << std::endl;
+}
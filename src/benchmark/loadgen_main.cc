@@ -0,0 +1,651 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+//
+// Load generator of connection setup.
+//
+// Connectors open, connect to one of listeners, exchange a message and
+// close at a given rate. Setup latency, close codes of failures and
+// resource usage of the process are reported in JSON. Listeners and
+// connectors can run in separate processes sharing a signal server by
+// --url and --role.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+
+#include "webrtc/base/thread.h"
+
+#include "peerapi.h"
+#include "signalserver.h"
+#include "resourceusage.h"
+
+using namespace std;
+
+
+//
+// Configuration
+//
+
+struct Config {
+  string url;                   // A local signal server is started if empty
+  string role = "both";         // listen, connect or both
+  string prefix;                // Listener ids are prefix-0, prefix-1, ...
+  string options;               // Additional options of peers
+  string output;
+  int listeners = 1;
+  int peers = 1000;             // Connectors
+  double rate = 100;            // Connectors started per second
+  int concurrency = 0;          // Connectors in progress. 0 is unlimited
+  size_t message_size = 64;
+  int timeout = 30;             // Seconds of a connector
+  int duration = 0;             // Seconds of listen role. 0 runs until interrupted
+  bool local_transport = false;
+};
+
+Config config;
+string peer_options;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void on_signal(int) {
+  interrupted = 1;
+}
+
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+string CloseCodeName(CloseCode code) {
+  switch (code) {
+  case CLOSE_NORMAL: return "CLOSE_NORMAL";
+  case CLOSE_GOING_AWAY: return "CLOSE_GOING_AWAY";
+  case CLOSE_ABNORMAL: return "CLOSE_ABNORMAL";
+  case CLOSE_PROTOCOL_ERROR: return "CLOSE_PROTOCOL_ERROR";
+  case CLOSE_SIGNAL_ERROR: return "CLOSE_SIGNAL_ERROR";
+  case CLOSE_REJECTED: return "CLOSE_REJECTED";
+  }
+  return "CLOSE_" + std::to_string(static_cast<unsigned int>(code));
+}
+
+
+//
+// class Latency
+//
+// Latencies in milliseconds with a histogram of fixed buckets
+//
+
+class Latency {
+public:
+  void Add(int64_t us) { values_.push_back(us / 1000.0); }
+
+  string ToJson(const string& indent) {
+    static const double kBuckets[] = {
+      1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000
+    };
+
+    std::sort(values_.begin(), values_.end());
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n"
+        << indent << "  \"count\": " << values_.size() << ",\n"
+        << indent << "  \"p50_ms\": " << Percentile(50) << ",\n"
+        << indent << "  \"p90_ms\": " << Percentile(90) << ",\n"
+        << indent << "  \"p99_ms\": " << Percentile(99) << ",\n"
+        << indent << "  \"max_ms\": " << (values_.empty() ? 0 : values_.back()) << ",\n"
+        << indent << "  \"histogram\": [";
+
+    // Count of values less than or equal to each bucket and above the previous
+    size_t begin = 0;
+    for (size_t i = 0; i <= sizeof(kBuckets) / sizeof(kBuckets[0]); i++) {
+      bool last = i == sizeof(kBuckets) / sizeof(kBuckets[0]);
+      size_t end = last ? values_.size() :
+                   std::upper_bound(values_.begin(), values_.end(), kBuckets[i]) - values_.begin();
+      out << (i == 0 ? "\n" : ",\n") << indent << "    { \"le_ms\": ";
+      if (last) out << "\"inf\""; else out << std::setprecision(0) << kBuckets[i];
+      out << ", \"count\": " << end - begin << " }";
+      out << std::setprecision(3);
+      begin = end;
+    }
+
+    out << "\n" << indent << "  ]\n" << indent << "}";
+    return out.str();
+  }
+
+private:
+  double Percentile(double p) const {
+    if (values_.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * values_.size() + 0.999999);
+    rank = std::max<size_t>(1, std::min(rank, values_.size()));
+    return values_[rank - 1];
+  }
+
+  std::vector<double> values_;
+};
+
+
+//
+// class LoadGenerator
+//
+
+class LoadGenerator : public rtc::MessageHandler {
+public:
+  LoadGenerator()
+      : thread_(rtc::Thread::Current()),
+        payload_(config.message_size, 'x'),
+        start_us_(0), tick_us_(0), end_us_(0), budget_(0),
+        started_(0), opened_(0), connected_(0), succeeded_(0), failed_(0),
+        listeners_opened_(0), listeners_closed_(0), finishing_(false) {}
+
+  ~LoadGenerator() {
+    thread_->Clear(this);
+  }
+
+  void Run() {
+    start_us_ = tick_us_ = NowUs();
+
+    if (config.role != "connect") {
+      for (int i = 0; i < config.listeners; i++) StartListener(ListenerId(i));
+    }
+
+    if (config.role == "connect") {
+      thread_->Post(RTC_FROM_HERE, this, MSG_TICK);
+    }
+
+    thread_->PostDelayed(RTC_FROM_HERE, kSampleMs, this, MSG_SAMPLE);
+    Peer::Run();
+
+    if (end_us_ == 0) end_us_ = NowUs();
+  }
+
+  string ToJson();
+
+protected:
+  void OnMessage(rtc::Message* msg) override {
+    switch (msg->message_id) {
+    case MSG_TICK:
+      Tick();
+      break;
+    case MSG_SAMPLE:
+      Sample();
+      break;
+    case MSG_RELEASE: {
+      std::unique_ptr<ReleaseData> data(static_cast<ReleaseData*>(msg->pdata));
+      connectors_.erase(data->id_);
+      CheckDone();
+      break;
+    }
+    case MSG_STOP:
+      Peer::Stop();
+      break;
+    }
+  }
+
+private:
+  enum {
+    MSG_TICK,             // Start connectors by the rate
+    MSG_SAMPLE,           // Sample resource usage and sweep timed out connectors
+    MSG_RELEASE,          // Delete a connector outside of its event handlers
+    MSG_STOP              // Peers have not been closed in kCloseTimeoutMs
+  };
+
+  struct ReleaseData : public rtc::MessageData {
+    explicit ReleaseData(const string& id) : id_(id) {}
+    string id_;
+  };
+
+  struct Connector {
+    std::unique_ptr<Peer> peer_;
+    string id_;
+    string listener_;
+    int64_t start_us_ = 0;
+    int64_t open_us_ = 0;
+    int64_t connect_us_ = 0;
+    int64_t closing_us_ = 0;
+    bool done_ = false;           // Counted as succeeded or failed
+  };
+
+  struct UsageSample {
+    double seconds;
+    size_t active;
+    Usage usage;
+  };
+
+  static const int kTickMs = 10;
+  static const int kSampleMs = 1000;
+  static const int kCloseTimeoutMs = 5000;
+
+  static string ListenerId(int i) {
+    return config.prefix + "-" + std::to_string(i);
+  }
+
+  void StartListener(const string& id) {
+    std::unique_ptr<Peer> peer(new Peer(id));
+    Peer* listener = peer.get();
+
+    listener->SetOptions(peer_options);
+    listener->SetOptions(config.options);
+
+    listener->On("open", [this]( string peer_id ) {
+      // Connectors start when all listeners are ready
+      if (++listeners_opened_ == config.listeners && config.role == "both") {
+        tick_us_ = NowUs();
+        thread_->Post(RTC_FROM_HERE, this, MSG_TICK);
+      }
+    });
+
+    listener->On("message", [listener]( string peer_id, char* data, size_t size ) {
+      listener->Send(peer_id, data, size);
+    });
+
+    listener->On("close", [this, id]( string peer_id, CloseCode code, string desc ) {
+      if (peer_id != id) return;
+
+      if (!finishing_) {
+        std::cerr << "Listener " << id << " has been closed: " << CloseCodeName(code) << std::endl;
+      }
+      listeners_closed_++;
+      CheckDone();
+    });
+
+    listeners_.push_back(std::move(peer));
+    listener->Open();
+  }
+
+  void Tick() {
+    if (finishing_) return;
+
+    int64_t now = NowUs();
+    budget_ += (now - tick_us_) / 1000000.0 * config.rate;
+    budget_ = std::min(budget_, std::max(1.0, config.rate * kTickMs / 1000.0));
+    tick_us_ = now;
+
+    while (budget_ >= 1 && started_ < config.peers &&
+           (config.concurrency == 0 || Active() < static_cast<size_t>(config.concurrency))) {
+      StartConnector();
+      budget_ -= 1;
+    }
+
+    if (started_ < config.peers) {
+      thread_->PostDelayed(RTC_FROM_HERE, kTickMs, this, MSG_TICK);
+    }
+  }
+
+  size_t Active() const {
+    return started_ - succeeded_ - failed_;
+  }
+
+  void StartConnector() {
+    Connector* c = new Connector();
+    c->id_ = Peer::CreateRandomUuid();
+    c->listener_ = ListenerId(started_ % config.listeners);
+    c->start_us_ = NowUs();
+    c->peer_.reset(new Peer(c->id_));
+    connectors_[c->id_].reset(c);
+    started_++;
+
+    Peer& peer = *c->peer_;
+    peer.SetOptions(peer_options);
+    peer.SetOptions(config.options);
+
+    peer.On("open", [this, c]( string peer_id ) {
+      c->open_us_ = NowUs();
+      open_.Add(c->open_us_ - c->start_us_);
+      opened_++;
+      if (!c->done_) c->peer_->Connect(c->listener_);
+    });
+
+    peer.On("connect", [this, c]( string peer_id ) {
+      c->connect_us_ = NowUs();
+      connect_.Add(c->connect_us_ - c->open_us_);
+      setup_.Add(c->connect_us_ - c->start_us_);
+      connected_++;
+      if (!c->done_) c->peer_->Send(c->listener_, payload_);
+    });
+
+    peer.On("message", [this, c]( string peer_id, char* data, size_t size ) {
+      if (c->done_) return;
+      exchange_.Add(NowUs() - c->connect_us_);
+      Complete(c, "");
+    });
+
+    peer.On("close", [this, c]( string peer_id, CloseCode code, string desc ) {
+      if (peer_id == c->id_) {
+        Complete(c, CloseCodeName(code), false);
+        Release(c);
+      }
+      else {
+        // A listener closed or rejected before the message is exchanged
+        Complete(c, CloseCodeName(code));
+      }
+    });
+
+    peer.Open();
+  }
+
+  // Count a result of a connector and close it. |failure| is empty if succeeded.
+  void Complete(Connector* c, const string& failure, bool close = true) {
+    if (c->done_) return;
+    c->done_ = true;
+    c->closing_us_ = NowUs();
+
+    if (failure.empty()) {
+      succeeded_++;
+    }
+    else {
+      failed_++;
+      failures_[failure]++;
+    }
+
+    if (succeeded_ + failed_ == config.peers) end_us_ = NowUs();
+
+    if (close) c->peer_->Close();
+    Tick();
+  }
+
+  void Release(Connector* c) {
+    thread_->Post(RTC_FROM_HERE, this, MSG_RELEASE, new ReleaseData(c->id_));
+  }
+
+  void Sample() {
+    int64_t now = NowUs();
+
+    // Connectors timed out, and ones not closed in the timeout after that
+    std::vector<Connector*> timed_out;
+    std::vector<Connector*> stuck;
+    for (auto& it : connectors_) {
+      Connector* c = it.second.get();
+      if (!c->done_ && now - c->start_us_ > config.timeout * 1000000LL) {
+        timed_out.push_back(c);
+      }
+      else if (c->done_ && now - c->closing_us_ > config.timeout * 1000000LL) {
+        stuck.push_back(c);
+      }
+    }
+    for (auto c : timed_out) Complete(c, "timeout");
+    for (auto c : stuck) Release(c);
+
+    UsageSample sample;
+    sample.seconds = (now - start_us_) / 1000000.0;
+    sample.active = Active();
+    sample.usage = SampleUsage();
+    samples_.push_back(sample);
+
+    std::cerr << std::fixed << std::setprecision(0)
+              << "t=" << sample.seconds << "s started=" << started_
+              << " active=" << sample.active << " succeeded=" << succeeded_
+              << " failed=" << failed_ << " threads=" << sample.usage.threads
+              << " fds=" << sample.usage.fds << " rss_kb=" << sample.usage.rss_kb
+              << std::endl;
+
+    if (interrupted ||
+        (config.role == "listen" && config.duration > 0 &&
+         sample.seconds >= config.duration)) {
+      Finish();
+    }
+
+    thread_->PostDelayed(RTC_FROM_HERE, kSampleMs, this, MSG_SAMPLE);
+  }
+
+  void CheckDone() {
+    if (!finishing_ && config.role != "listen" &&
+        succeeded_ + failed_ == config.peers && connectors_.empty()) {
+      Finish();
+    }
+
+    if (finishing_ && connectors_.empty() &&
+        listeners_closed_ == static_cast<int>(listeners_.size())) {
+      Peer::Stop();
+    }
+  }
+
+  void Finish() {
+    if (finishing_) return;
+    finishing_ = true;
+
+    if (end_us_ == 0) end_us_ = NowUs();
+
+    for (auto& it : connectors_) {
+      if (!it.second->done_) Complete(it.second.get(), "interrupted");
+    }
+
+    for (auto& listener : listeners_) listener->Close();
+
+    thread_->PostDelayed(RTC_FROM_HERE, kCloseTimeoutMs, this, MSG_STOP);
+    CheckDone();
+  }
+
+  rtc::Thread* thread_;
+  const string payload_;
+  std::vector<std::unique_ptr<Peer>> listeners_;
+  std::map<string, std::unique_ptr<Connector>> connectors_;
+
+  int64_t start_us_;
+  int64_t tick_us_;
+  int64_t end_us_;
+  double budget_;               // Connectors to start by the rate
+
+  int started_;
+  int opened_;
+  int connected_;
+  int succeeded_;
+  int failed_;
+  int listeners_opened_;
+  int listeners_closed_;
+  bool finishing_;
+
+  std::map<string, int> failures_;
+  Latency open_;                // Open() to "open", signal server
+  Latency connect_;             // Connect() to "connect", peer connection
+  Latency setup_;               // Open() to "connect"
+  Latency exchange_;            // "connect" to the echo of a message
+  std::vector<UsageSample> samples_;
+};
+
+
+string LoadGenerator::ToJson() {
+  double seconds = (end_us_ - start_us_) / 1000000.0;
+
+  Usage max_usage;
+  for (auto& sample : samples_) {
+    max_usage.threads = std::max(max_usage.threads, sample.usage.threads);
+    max_usage.fds = std::max(max_usage.fds, sample.usage.fds);
+    max_usage.rss_kb = std::max(max_usage.rss_kb, sample.usage.rss_kb);
+  }
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\n"
+      << "  \"benchmark\": \"peerapi_loadgen\",\n"
+      << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+      << "  \"config\": {\n"
+      << "    \"role\": \"" << config.role << "\",\n"
+      << "    \"listeners\": " << config.listeners << ",\n"
+      << "    \"peers\": " << config.peers << ",\n"
+      << "    \"rate\": " << config.rate << ",\n"
+      << "    \"concurrency\": " << config.concurrency << ",\n"
+      << "    \"message_size\": " << config.message_size << ",\n"
+      << "    \"timeout\": " << config.timeout << ",\n"
+      << "    \"local_transport\": " << (config.local_transport ? "true" : "false") << "\n"
+      << "  },\n"
+      << "  \"connectors\": {\n"
+      << "    \"started\": " << started_ << ",\n"
+      << "    \"opened\": " << opened_ << ",\n"
+      << "    \"connected\": " << connected_ << ",\n"
+      << "    \"succeeded\": " << succeeded_ << ",\n"
+      << "    \"failed\": " << failed_ << ",\n"
+      << "    \"seconds\": " << seconds << ",\n"
+      << "    \"succeeded_per_sec\": " << (seconds > 0 ? succeeded_ / seconds : 0) << "\n"
+      << "  },\n"
+      << "  \"failures\": {";
+
+  bool first = true;
+  for (auto& failure : failures_) {
+    out << (first ? "\n" : ",\n") << "    \"" << failure.first << "\": " << failure.second;
+    first = false;
+  }
+
+  out << (failures_.empty() ? "},\n" : "\n  },\n")
+      << "  \"latency\": {\n"
+      << "    \"open\": " << open_.ToJson("    ") << ",\n"
+      << "    \"connect\": " << connect_.ToJson("    ") << ",\n"
+      << "    \"setup\": " << setup_.ToJson("    ") << ",\n"
+      << "    \"exchange\": " << exchange_.ToJson("    ") << "\n"
+      << "  },\n"
+      << "  \"resources\": {\n"
+      << "    \"threads_max\": " << max_usage.threads << ",\n"
+      << "    \"fds_max\": " << max_usage.fds << ",\n"
+      << "    \"rss_kb_max\": " << max_usage.rss_kb << ",\n"
+      << "    \"samples\": [";
+
+  for (size_t i = 0; i < samples_.size(); i++) {
+    const UsageSample& sample = samples_[i];
+    out << (i == 0 ? "\n" : ",\n")
+        << "      { \"seconds\": " << sample.seconds
+        << ", \"active\": " << sample.active
+        << ", \"threads\": " << sample.usage.threads
+        << ", \"fds\": " << sample.usage.fds
+        << ", \"rss_kb\": " << sample.usage.rss_kb << " }";
+  }
+
+  out << (samples_.empty() ? "]\n" : "\n    ]\n")
+      << "  }\n"
+      << "}\n";
+  return out.str();
+}
+
+
+//
+// main
+//
+
+void usage(const char* prg);
+bool ParseArguments(int argc, char* argv[]);
+
+int main(int argc, char *argv[]) {
+  if (!ParseArguments(argc, argv)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  peerapi::SignalServer signal_server;
+  string url = config.url;
+
+  if (url.empty()) {
+    if (!signal_server.Start()) {
+      std::cerr << "Failed to start signal server" << std::endl;
+      return 1;
+    }
+    url = signal_server.url();
+  }
+
+  peer_options = "{\"url\": \"" + url + "\", \"ice_mode\": \"local\", "
+                 "\"local_transport\": " + (config.local_transport ? "true" : "false") + "}";
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  string result;
+  {
+    LoadGenerator generator;
+    generator.Run();
+    result = generator.ToJson();
+  }
+
+  signal_server.Stop();
+
+  if (config.output.empty()) {
+    std::cout << result;
+  }
+  else {
+    std::ofstream out(config.output);
+    out << result;
+    if (!out) {
+      std::cerr << "Failed to write " << config.output << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+bool ParseArguments(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--local-transport") {
+      config.local_transport = true;
+      continue;
+    }
+
+    if (i + 1 >= argc) return false;
+    string value = argv[++i];
+
+    if (arg == "--url") config.url = value;
+    else if (arg == "--role") config.role = value;
+    else if (arg == "--prefix") config.prefix = value;
+    else if (arg == "--options") config.options = value;
+    else if (arg == "--output") config.output = value;
+    else if (arg == "--listeners") config.listeners = std::atoi(value.c_str());
+    else if (arg == "--peers") config.peers = std::atoi(value.c_str());
+    else if (arg == "--rate") config.rate = std::atof(value.c_str());
+    else if (arg == "--concurrency") config.concurrency = std::atoi(value.c_str());
+    else if (arg == "--message-size") config.message_size = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--timeout") config.timeout = std::atoi(value.c_str());
+    else if (arg == "--duration") config.duration = std::atoi(value.c_str());
+    else return false;
+  }
+
+  // Listener ids have to be shared if listeners are in another process
+  if (config.prefix.empty()) {
+    if (config.role != "both") {
+      std::cerr << "--prefix is required with --role " << config.role << std::endl;
+      return false;
+    }
+    config.prefix = Peer::CreateRandomUuid();
+  }
+
+  return (config.role == "both" || config.role == "listen" || config.role == "connect") &&
+         config.listeners > 0 && config.peers > 0 && config.rate > 0 &&
+         config.concurrency >= 0 && config.message_size > 0 && config.timeout > 0;
+}
+
+void usage(const char* prg) {
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << prg << " [options]" << std::endl << std::endl;
+  std::cerr << "  --url url              Signal server (default: a local signal server)" << std::endl;
+  std::cerr << "  --role role            both, listen or connect (default: both)" << std::endl;
+  std::cerr << "  --prefix name          Listener ids are name-0, name-1, ..." << std::endl;
+  std::cerr << "  --listeners n          Listeners (default: 1)" << std::endl;
+  std::cerr << "  --peers n              Connectors (default: 1000)" << std::endl;
+  std::cerr << "  --rate n               Connectors started per second (default: 100)" << std::endl;
+  std::cerr << "  --concurrency n        Connectors in progress, 0 is unlimited (default: 0)" << std::endl;
+  std::cerr << "  --message-size n       Size of the exchanged message (default: 64)" << std::endl;
+  std::cerr << "  --timeout n            Seconds of a connector to finish (default: 30)" << std::endl;
+  std::cerr << "  --duration n           Seconds of listen role, 0 runs until Ctrl-C (default: 0)" << std::endl;
+  std::cerr << "  --options json         Additional options of peers" << std::endl;
+  std::cerr << "  --local-transport      Use the in-process transport instead of data channels" << std::endl;
+  std::cerr << "  --output file          Write JSON results to file (default: stdout)" << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Example: " << std::endl;
+  std::cerr << "  > " << prg << " --url ws://host:port --role listen --prefix lg --listeners 4" << std::endl;
+  std::cerr << "  > " << prg << " --url ws://host:port --role connect --prefix lg --listeners 4 --rate 500" << std::endl;
+  std::cerr << std::endl;
+}
@@ -0,0 +1,355 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+//
+// Microbenchmarks of hot loops of the signaling connection.
+//
+// Each suite compares the kernels of a loop with its previous implementation
+// over a range of buffer sizes, and writes throughput in JSON.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+
+#include "websocketpp/frame.hpp"
+#include "websocketpp/utf8_validator.hpp"
+
+using namespace std;
+
+
+//
+// Configuration and results
+//
+
+const char* kSuites[] = { "mask", "utf8" };
+
+const websocketpp::cpu::kernel kKernels[] = {
+  websocketpp::cpu::scalar, websocketpp::cpu::sse2, websocketpp::cpu::avx2, websocketpp::cpu::neon
+};
+
+struct Config {
+  vector<string> suites;
+  string output;
+  vector<size_t> sizes = { 16, 64, 256, 1024, 4096, 16384, 65536, 1048576 };
+  uint64_t bytes = 256 * 1024 * 1024;
+};
+
+struct Result {
+  string suite;
+  string kernel;
+  size_t size;
+  uint64_t bytes;
+  double seconds;
+
+  string ToJson(const string& indent) const {
+    std::ostringstream out;
+    out << indent << "{ \"suite\": \"" << suite << "\", \"kernel\": \"" << kernel
+        << "\", \"size\": " << size << ", \"bytes\": " << bytes
+        << ", \"seconds\": " << seconds
+        << ", \"mb_per_sec\": " << (seconds > 0 ? bytes / seconds / (1024 * 1024) : 0)
+        << " }";
+    return out.str();
+  }
+};
+
+Config config;
+vector<Result> results;
+
+// Folded into the output so that measured loops are not optimized out
+volatile uint64_t sink = 0;
+
+
+//
+// Run |function| over a buffer of |size| until config.bytes are processed
+//
+
+void Measure(const string& suite, const string& kernel, size_t size,
+             std::function<void(uint8_t*, size_t)> function) {
+  vector<uint8_t> buffer(size);
+  for (size_t i = 0; i < size; i++) {
+    buffer[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+
+  const uint64_t iterations = std::max<uint64_t>(1, config.bytes / size);
+
+  // Warm up caches and the dispatch of the kernel
+  function(buffer.data(), size);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; i++) {
+    function(buffer.data(), size);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  sink += buffer[size / 2];
+
+  Result result;
+  result.suite = suite;
+  result.kernel = kernel;
+  result.size = size;
+  result.bytes = iterations * size;
+  result.seconds = elapsed.count();
+  results.push_back(result);
+
+  std::cerr << suite << " " << kernel << " " << size << ": "
+            << result.bytes / result.seconds / (1024 * 1024) << " MB/s" << std::endl;
+}
+
+
+//
+// mask: WebSocket payload masking of websocketpp::frame
+//
+
+// byte_mask_circ before the SIMD kernels
+size_t PreviousByteMaskCirc(uint8_t* data, size_t length, size_t prepared_key) {
+  websocketpp::frame::uint32_converter key;
+  key.i = static_cast<uint32_t>(prepared_key);
+
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = data[i] ^ key.c[i % 4];
+  }
+
+  return websocketpp::frame::circshift_prepared_key(prepared_key, length % 4);
+}
+
+// word_mask_exact before the SIMD kernels
+void PreviousWordMaskExact(uint8_t* data, size_t length,
+                           const websocketpp::frame::masking_key_type& key) {
+  size_t prepared_key = websocketpp::frame::prepare_masking_key(key);
+  size_t n = length / sizeof(size_t);
+  size_t* word = reinterpret_cast<size_t*>(data);
+
+  for (size_t i = 0; i < n; i++) {
+    word[i] = word[i] ^ prepared_key;
+  }
+
+  for (size_t i = n * sizeof(size_t); i < length; i++) {
+    data[i] = data[i] ^ key.c[i % 4];
+  }
+}
+
+void RunMask() {
+  namespace cpu = websocketpp::cpu;
+  namespace frame = websocketpp::frame;
+
+  frame::masking_key_type key;
+  key.i = 0x12345678;
+  const size_t prepared_key = frame::prepare_masking_key(key);
+
+  std::cerr << "mask: dispatched kernel is "
+            << cpu::get_kernel_name(cpu::detect_kernel()) << std::endl;
+
+  for (size_t size : config.sizes) {
+    Measure("mask", "previous_byte_mask_circ", size, [&](uint8_t* data, size_t length) {
+      PreviousByteMaskCirc(data, length, prepared_key);
+    });
+
+    Measure("mask", "previous_word_mask_exact", size, [&](uint8_t* data, size_t length) {
+      PreviousWordMaskExact(data, length, key);
+    });
+
+    for (cpu::kernel kernel : kKernels) {
+      frame::simd::mask_function function = frame::simd::get_mask_function(kernel);
+      if (function == nullptr) continue;
+
+      Measure("mask", cpu::get_kernel_name(kernel), size, [&](uint8_t* data, size_t length) {
+        function(data, data, length, key.c);
+      });
+    }
+
+    Measure("mask", "byte_mask_circ", size, [&](uint8_t* data, size_t length) {
+      frame::byte_mask_circ(data, length, prepared_key);
+    });
+  }
+}
+
+
+//
+// utf8: UTF-8 validation of text messages by websocketpp::utf8_validator
+//
+
+// Text of signaling commands in ASCII, and with non-ASCII every 64 bytes
+void FillText(uint8_t* data, size_t length, bool ascii) {
+  static const char json[] = "{\"command\":\"sdp\",\"data\":{\"type\":\"offer\",\"sdp\":\"v=0 o=- 4611731400430051336 2 IN IP4 127.0.0.1 s=- t=0 0\"}}";
+  const size_t json_length = sizeof(json) - 1;
+
+  for (size_t i = 0; i < length; i++) {
+    data[i] = static_cast<uint8_t>(json[i % json_length]);
+  }
+
+  if (ascii) return;
+
+  // U+00E9 in two bytes
+  for (size_t i = 63; i + 1 < length; i += 64) {
+    data[i] = 0xC3;
+    data[i + 1] = 0xA9;
+  }
+}
+
+void RunUtf8() {
+  namespace cpu = websocketpp::cpu;
+  namespace utf8 = websocketpp::utf8_validator;
+
+  std::cerr << "utf8: dispatched kernel is "
+            << cpu::get_kernel_name(cpu::detect_kernel()) << std::endl;
+
+  const bool texts[] = { true, false };
+  for (bool ascii : texts) {
+    const string suite = ascii ? "utf8_ascii" : "utf8_mixed";
+
+    for (size_t size : config.sizes) {
+      // The text is filled once, and the validators don't modify it
+      bool filled = false;
+      auto fill = [&](uint8_t* data, size_t length) {
+        if (!filled) FillText(data, length, ascii);
+        filled = true;
+      };
+
+      filled = false;
+      Measure(suite, "previous_decode", size, [&](uint8_t* data, size_t length) {
+        fill(data, length);
+        utf8::validator validator;
+        bool valid = true;
+        for (size_t i = 0; i < length && valid; i++) {
+          valid = validator.consume(data[i]);
+        }
+        sink += valid && validator.complete();
+      });
+
+      // Kernels alone scan only up to the first non-ASCII byte
+      for (cpu::kernel kernel : kKernels) {
+        utf8::simd::ascii_function function = utf8::simd::get_ascii_function(kernel);
+        if (function == nullptr || !ascii) continue;
+
+        filled = false;
+        Measure(suite, string("skip_ascii_") + cpu::get_kernel_name(kernel), size,
+                [&](uint8_t* data, size_t length) {
+          fill(data, length);
+          sink += function(data, data + length) - data;
+        });
+      }
+
+      filled = false;
+      Measure(suite, "decode", size, [&](uint8_t* data, size_t length) {
+        fill(data, length);
+        utf8::validator validator;
+        sink += validator.decode(data, data + length) && validator.complete();
+      });
+    }
+  }
+}
+
+
+//
+// main
+//
+
+void usage(const char* prg);
+bool ParseArguments(int argc, char* argv[]);
+string ToJson();
+
+int main(int argc, char *argv[]) {
+  if (!ParseArguments(argc, argv)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (auto& suite : config.suites) {
+    if (suite == "mask") RunMask();
+    if (suite == "utf8") RunUtf8();
+  }
+
+  if (config.output.empty()) {
+    std::cout << ToJson();
+  }
+  else {
+    std::ofstream out(config.output);
+    out << ToJson();
+    if (!out) {
+      std::cerr << "Failed to write " << config.output << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+bool ParseArguments(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (i + 1 >= argc) return false;
+    string value = argv[++i];
+
+    if (arg == "--suite") {
+      std::istringstream names(value);
+      string name;
+      while (std::getline(names, name, ',')) {
+        if (std::find(std::begin(kSuites), std::end(kSuites), name) == std::end(kSuites)) {
+          std::cerr << "Unknown suite: " << name << std::endl;
+          return false;
+        }
+        config.suites.push_back(name);
+      }
+    }
+    else if (arg == "--sizes") {
+      config.sizes.clear();
+      std::istringstream sizes(value);
+      string size;
+      while (std::getline(sizes, size, ',')) {
+        config.sizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+      }
+    }
+    else if (arg == "--output") config.output = value;
+    else if (arg == "--bytes") config.bytes = std::strtoull(value.c_str(), nullptr, 10);
+    else return false;
+  }
+
+  if (config.suites.empty()) {
+    config.suites.assign(std::begin(kSuites), std::end(kSuites));
+  }
+
+  return !config.sizes.empty() && config.bytes > 0 &&
+         std::find(config.sizes.begin(), config.sizes.end(), 0) == config.sizes.end();
+}
+
+string ToJson() {
+  std::ostringstream out;
+  out << "{\n"
+      << "  \"benchmark\": \"micro\",\n"
+      << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+      << "  \"config\": {\n"
+      << "    \"bytes\": " << config.bytes << ",\n"
+      << "    \"sink\": " << sink << "\n"
+      << "  },\n"
+      << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    out << (i == 0 ? "\n" : ",\n") << results[i].ToJson("    ");
+  }
+
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+void usage(const char* prg) {
+  std::cerr << std::endl;
+  std::cerr << "Usage: " << prg << " [options]" << std::endl << std::endl;
+  std::cerr << "  --suite a,b,...        mask, utf8 (default: all)" << std::endl;
+  std::cerr << "  --output file          Write JSON results to file (default: stdout)" << std::endl;
+  std::cerr << "  --sizes a,b,...        Buffer sizes in bytes (default: 16 to 1048576)" << std::endl;
+  std::cerr << "  --bytes n              Bytes processed by each kernel and size (default: 268435456)" << std::endl;
+  std::cerr << std::endl;
+}
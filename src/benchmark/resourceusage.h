@@ -0,0 +1,57 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+#ifndef __PEERAPI_BENCHMARK_RESOURCEUSAGE_H__
+#define __PEERAPI_BENCHMARK_RESOURCEUSAGE_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
+//
+// Resource usage of this process. Values are -1 if not supported.
+//
+
+struct Usage {
+  int threads = -1;
+  int fds = -1;
+  int64_t rss_kb = -1;
+};
+
+inline Usage SampleUsage() {
+  Usage usage;
+
+#if defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 8, "Threads:") == 0) {
+      usage.threads = std::atoi(line.c_str() + 8);
+    }
+    else if (line.compare(0, 6, "VmRSS:") == 0) {
+      usage.rss_kb = std::atoll(line.c_str() + 6);
+    }
+  }
+
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir != nullptr) {
+    int count = 0;
+    while (readdir(dir) != nullptr) count++;
+    closedir(dir);
+    // ".", ".." and the descriptor of dir itself
+    usage.fds = count - 3;
+  }
+#endif
+
+  return usage;
+}
+
+#endif // __PEERAPI_BENCHMARK_RESOURCEUSAGE_H__
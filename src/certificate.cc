@@ -0,0 +1,172 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+#include "webrtc/base/timeutils.h"
+
+#include "certificate.h"
+#include "logging.h"
+
+namespace peerapi {
+
+namespace {
+
+// Generate a new certificate before it expires
+const uint64_t kExpirationMarginMs = 24 * 60 * 60 * 1000;
+
+// Don't read the PEM files again within this time after a failure
+const uint64_t kLoadRetryMs = 60 * 1000;
+
+typedef std::tuple<int, std::string, std::string, int> CertificateKey;
+
+struct CertificateEntry {
+  rtc::scoped_refptr<rtc::RTCCertificate> certificate_;
+  uint64_t created_ms_ = 0;
+  uint64_t failed_ms_ = 0;
+};
+
+// Certificates by setting, so peers with different settings don't replace
+// each other's certificate
+struct CertificateCache {
+  std::mutex lock_;
+  std::map<CertificateKey, CertificateEntry> entries_;
+};
+
+CertificateCache& Cache() {
+  static CertificateCache cache;
+  return cache;
+}
+
+CertificateKey KeyOf(const SharedCertificate::Setting& setting) {
+  return CertificateKey(static_cast<int>(setting.key_type_), setting.certificate_file_,
+                        setting.private_key_file_, setting.rotation_);
+}
+
+bool ReadFile(const std::string& path, std::string* content) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file) return false;
+
+  std::ostringstream stream;
+  stream << file.rdbuf();
+  *content = stream.str();
+  return true;
+}
+
+} // namespace
+
+
+rtc::scoped_refptr<rtc::RTCCertificate>
+SharedCertificate::Get(const Setting& setting) {
+  CertificateCache& cache = Cache();
+  std::lock_guard<std::mutex> guard(cache.lock_);
+  CertificateEntry& entry = cache.entries_[KeyOf(setting)];
+
+  uint64_t now = rtc::TimeUTCMillis();
+
+  // A loaded certificate is the same until the files are replaced, so it is
+  // used until it actually expires. A generated one is replaced in advance.
+  bool loaded = !setting.certificate_file_.empty() || !setting.private_key_file_.empty();
+
+  if (entry.certificate_) {
+    bool expired = false;
+
+    if (setting.rotation_ > 0 &&
+        now >= entry.created_ms_ + static_cast<uint64_t>(setting.rotation_) * 1000) {
+      expired = true;
+    }
+    else if (entry.certificate_->HasExpired(loaded ? now : now + kExpirationMarginMs)) {
+      expired = true;
+    }
+
+    if (!expired) return entry.certificate_;
+  }
+
+  // Don't read the files for each peer connection while they are invalid
+  if (loaded && entry.failed_ms_ > 0 && now < entry.failed_ms_ + kLoadRetryMs) {
+    if (entry.certificate_ && !entry.certificate_->HasExpired(now)) {
+      return entry.certificate_;
+    }
+    return nullptr;
+  }
+
+  if (entry.certificate_) {
+    LOG_F( INFO ) << "Rotate certificate";
+  }
+
+  rtc::scoped_refptr<rtc::RTCCertificate> certificate =
+      loaded ? Load(setting) : Generate(setting);
+
+  if (!certificate) {
+    // Keep the previous one if it is still valid
+    entry.failed_ms_ = now;
+    if (entry.certificate_ && !entry.certificate_->HasExpired(now)) {
+      return entry.certificate_;
+    }
+    return nullptr;
+  }
+
+  entry.certificate_ = certificate;
+  entry.created_ms_ = now;
+  entry.failed_ms_ = 0;
+
+  LOG_F( INFO ) << "Done";
+  return certificate;
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate>
+SharedCertificate::Generate(const Setting& setting) {
+  rtc::KeyParams params = setting.key_type_ == rtc::KT_RSA ?
+                          rtc::KeyParams::RSA() : rtc::KeyParams::ECDSA();
+
+  std::unique_ptr<rtc::SSLIdentity> identity(
+      rtc::SSLIdentity::Generate("peerapi", params));
+  if (!identity) {
+    LOG_F( LERROR ) << "Failed to generate certificate";
+    return nullptr;
+  }
+
+  return rtc::RTCCertificate::Create(std::move(identity));
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate>
+SharedCertificate::Load(const Setting& setting) {
+  std::string certificate;
+  std::string private_key;
+
+  if (!ReadFile(setting.certificate_file_, &certificate)) {
+    LOG_F( LERROR ) << "Failed to read " << setting.certificate_file_;
+    return nullptr;
+  }
+
+  if (!ReadFile(setting.private_key_file_, &private_key)) {
+    LOG_F( LERROR ) << "Failed to read " << setting.private_key_file_;
+    return nullptr;
+  }
+
+  std::unique_ptr<rtc::SSLIdentity> identity(
+      rtc::SSLIdentity::FromPEMStrings(private_key, certificate));
+  if (!identity) {
+    LOG_F( LERROR ) << "Invalid certificate or private key";
+    return nullptr;
+  }
+
+  rtc::scoped_refptr<rtc::RTCCertificate> loaded =
+      rtc::RTCCertificate::Create(std::move(identity));
+
+  if (loaded->HasExpired(rtc::TimeUTCMillis())) {
+    LOG_F( LERROR ) << "Certificate has expired, " << setting.certificate_file_;
+    return nullptr;
+  }
+
+  return loaded;
+}
+
+} // namespace peerapi
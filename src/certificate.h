@@ -0,0 +1,49 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_CERTIFICATE_H__
+#define __PEERAPI_CERTIFICATE_H__
+
+#include <string>
+
+#include "webrtc/base/rtccertificate.h"
+#include "webrtc/base/scoped_ref_ptr.h"
+#include "webrtc/base/sslidentity.h"
+
+namespace peerapi {
+
+//
+// class SharedCertificate
+//
+// A DTLS certificate shared by all peer connections in a process. Without
+// it, WebRTC generates a key pair for each peer connection. The certificate
+// is generated once, or loaded from PEM files, and a new one is generated
+// when it is older than the rotation period or about to expire. Loaded PEM
+// files are read again only after the rotation period or when the loaded
+// certificate has expired. Existing peer connections keep the previous
+// certificate, and each setting has its own certificate.
+//
+
+class SharedCertificate {
+public:
+  struct Setting {
+    rtc::KeyType key_type_ = rtc::KT_ECDSA;
+    std::string certificate_file_;      // PEM files to load instead of generating
+    std::string private_key_file_;
+    int rotation_ = 0;                  // In seconds, 0 doesn't rotate
+  };
+
+  // Returns nullptr on failure, so WebRTC generates a certificate by itself
+  static rtc::scoped_refptr<rtc::RTCCertificate> Get(const Setting& setting);
+
+private:
+  static rtc::scoped_refptr<rtc::RTCCertificate> Generate(const Setting& setting);
+  static rtc::scoped_refptr<rtc::RTCCertificate> Load(const Setting& setting);
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_CERTIFICATE_H__
@@ -20,7 +20,15 @@ enum CloseCode {
   CLOSE_GOING_AWAY    = 0x80000000,
   CLOSE_ABNORMAL,
   CLOSE_PROTOCOL_ERROR,
-  CLOSE_SIGNAL_ERROR
+  CLOSE_SIGNAL_ERROR,
+  CLOSE_REJECTED
+};
+
+
+enum SendPriority {
+  PRIORITY_HIGH       = 0,
+  PRIORITY_NORMAL,
+  PRIORITY_LOW
 };
 
 
@@ -4,10 +4,14 @@
 *  Ryan Lee
 */
 
+#include <algorithm>
+
 #include "control.h"
 #include "peer.h"
+#include "memoryaccounting.h"
 
 #include "webrtc/base/location.h"
+#include "webrtc/base/timeutils.h"
 #include "webrtc/base/json.h"
 #include "webrtc/base/signalthread.h"
 
@@ -34,7 +38,12 @@ Control::Control()
 }
 
 Control::Control(std::shared_ptr<Signal> signal)
-       : signal_(signal) {
+       : signal_(signal),
+         channel_created_(false),
+         peer_pool_filling_(false),
+         offers_scheduled_(false),
+         sweeping_(false),
+         send_budget_held_(false) {
 
   signal_->SignalOnCommandReceived_.connect(this, &Control::OnSignalCommandReceived);
   signal_->SignalOnClosed_.connect(this, &Control::OnSignalConnectionClosed);
@@ -44,7 +53,6 @@ Control::Control(std::shared_ptr<Signal> signal)
 Control::~Control() {
   LOG_F( INFO ) << "Starting";
 
-  peers_.clear();
   DeleteControl();
   signal_->SignalOnCommandReceived_.disconnect(this);
   signal_->SignalOnClosed_.disconnect(this);
@@ -72,15 +80,47 @@ bool Control::InitializeControl() {
   webrtc_thread_ = rtc::Thread::Current();
   RTC_DCHECK( webrtc_thread_ != nullptr );
 
+  accept_limiter_.Set( peer_setting_.accept_rate_, peer_setting_.accept_burst_ );
+
+  // The budget is shared by peers in the process. Keep the budget of other
+  // peers rather than changing it under them.
+  if ( peer_setting_.send_buffer_budget_ >= 0 && !send_budget_held_ ) {
+    send_budget_held_ = SendBudget::Set( static_cast<size_t>( peer_setting_.send_buffer_budget_ ) );
+    if ( !send_budget_held_ ) {
+      LOG_F( WARNING ) << "send_buffer_budget is ignored, other peers use " << SendBudget::budget();
+    }
+  }
+
+  // Generate the shared certificate ahead of the first connection
+  if ( peer_setting_.shared_certificate_ ) {
+    SharedCertificate::Get( peer_setting_.certificate_ );
+  }
+
   return true;
 }
 
 void Control::DeleteControl() {
   LOG_F( INFO ) << "Starting";
 
+  //
+  // Peers in the same process hold each other, and LocalTransport finds a
+  // peer while it is registered. Unregister them before the references are
+  // released, instead of in the destructor of a peer.
+  //
+
+  for ( auto& item : peers_ ) item.second->Shutdown();
+  for ( auto& peer : peer_pool_ ) peer->Shutdown();
+
+  peers_.clear();
+  ClearPeerPool();
   peer_connection_factory_ = NULL;
   fake_audio_capture_module_ = NULL;
 
+  if ( send_budget_held_ ) {
+    SendBudget::Release();
+    send_budget_held_ = false;
+  }
+
   LOG_F( INFO ) << "Done";
 }
 
@@ -157,6 +197,12 @@ void Control::Close(const CloseCode code, bool force_queuing) {
     ClosePeer(id, code);
   }
 
+  // Don't refill the pool, create offers and sweep after closing
+  peer_setting_.peer_pool_size_ = 0;
+  pending_offers_.clear();
+  sweeping_ = false;
+  ClearPeerPool();
+
   //
   // Close signal server
   //
@@ -195,6 +241,7 @@ void Control::ClosePeer( const string peer_id, const CloseCode code, bool force_
   Peer item = peer_found->second;
   peers_.erase( peer_found );
   item->Close(code);
+  ScheduleOffers();
 
   // 3. Leave channel on signal server
   LeaveChannel(peer_id);
@@ -206,15 +253,15 @@ void Control::ClosePeer( const string peer_id, const CloseCode code, bool force_
 // Send data to peer
 //
 
-void Control::Send(const string to, const char* data, const size_t size) {
+bool Control::Send(const string to, const char* data, const size_t size,
+                   const SendPriority priority) {
 
   typedef std::map<string, rtc::scoped_refptr<PeerControl>>::iterator it_type;
 
   it_type it = peers_.find(to);
-  if (it == peers_.end()) return;
+  if (it == peers_.end()) return false;
 
-  it->second->Send(data, size);
-  return;
+  return it->second->Send(data, size, priority);
 }
 
 bool Control::SyncSend(const string to, const char* data, const size_t size) {
@@ -244,6 +291,9 @@ void Control::OnPeerConnect(const string peer_id) {
   }
 
   peer_->OnConnect(peer_id);
+
+  // A connecting peer has been opened
+  ScheduleOffers();
   LOG_F( INFO ) << "Done, peer is " << peer_id;
 }
 
@@ -331,6 +381,19 @@ void Control::OnMessage(rtc::Message* msg) {
     param = static_cast<ControlMessageData*>(msg->pdata);
     Close((CloseCode)param->data_int32_);
     break;
+  case MSG_FILL_PEER_POOL:
+    param = static_cast<ControlMessageData*>(msg->pdata);
+    CreatePooledPeer();
+    break;
+  case MSG_CREATE_OFFERS:
+    param = static_cast<ControlMessageData*>(msg->pdata);
+    offers_scheduled_ = false;
+    CreatePendingOffers();
+    break;
+  case MSG_SWEEP_PEERS:
+    param = static_cast<ControlMessageData*>(msg->pdata);
+    SweepPeers();
+    break;
   default:
     LOG_F( WARNING ) << "Unknown message";
     break;
@@ -388,6 +451,9 @@ void Control::OnCommandReceived(const Json::Value& message) {
   else if (command == "ice_candidate") {
     AddIceCandidate(peer_id, data);
   }
+  else if (command == "ice_candidates") {
+    AddIceCandidates(peer_id, data);
+  }
 }
 
 void Control::OnSignalCommandReceived(const Json::Value& message) {
@@ -397,6 +463,12 @@ void Control::OnSignalCommandReceived(const Json::Value& message) {
 }
 
 void Control::OnSignalConnectionClosed(websocketpp::close::status::value code) {
+
+  //
+  // Signal reconnects by itself without closing peers. This is called
+  // only if the reconnection has finally failed.
+  //
+
   LOG_F(INFO) << "Enter, code is " << code;
   if (code != websocketpp::close::status::normal) {
     ControlMessageData *data = new ControlMessageData(CLOSE_SIGNAL_ERROR, ref_);
@@ -456,44 +528,168 @@ bool Control::CreatePeerFactory(
     return false;
   }
 
+  //
+  // The loopback network is ignored by default. Peers in the local mode are
+  // on the same host, so gather candidates on loopback as well.
+  //
+
+  if (peer_setting_.ice_mode_ == PeerSetting::ice_local) {
+    webrtc::PeerConnectionFactoryInterface::Options options;
+    options.network_ignore_mask = 0;
+    peer_connection_factory_->SetOptions(options);
+  }
+
   LOG_F( INFO ) << "Done";
   return true;
 }
 
 
+//
+// Peer pool
+//  Creating a peer connection and a data channel is on the critical path of
+//  a connection. Peers are created ahead one by one on the webrtc thread,
+//  and a new connection takes a peer from the pool.
+//
+
+Control::Peer Control::CreatePeer(const string& remote_id) {
+  MemoryScope memory_scope(MEMORY_PEER);
+
+  if ( !peer_pool_.empty() ) {
+    Peer peer = peer_pool_.front();
+    peer_pool_.pop_front();
+    peer->set_remote_id(remote_id);
+
+    FillPeerPool();
+    LOG_F( INFO ) << "Done, from the pool, peer is " << remote_id;
+    return peer;
+  }
+
+  Peer peer = new rtc::RefCountedObject<PeerControl>(peer_name_, remote_id, this, peer_connection_factory_, peer_setting_);
+  if ( !peer->Initialize() ) {
+    return nullptr;
+  }
+
+  return peer;
+}
+
+void Control::FillPeerPool() {
+
+  if ( peer_pool_filling_ ) return;
+  if ( peer_pool_.size() >= static_cast<size_t>(std::max(peer_setting_.peer_pool_size_, 0)) ) return;
+
+  //
+  // Create peers by posted messages one by one, so incoming commands are not
+  // blocked until the pool is full.
+  //
+
+  peer_pool_filling_ = true;
+  ControlMessageData *data = new ControlMessageData(0, ref_);
+  webrtc_thread_->Post(RTC_FROM_HERE, this, MSG_FILL_PEER_POOL, data);
+}
+
+void Control::CreatePooledPeer() {
+  MemoryScope memory_scope(MEMORY_PEER);
+
+  peer_pool_filling_ = false;
+
+  if ( !peer_connection_factory_ ) return;
+  if ( peer_pool_.size() >= static_cast<size_t>(std::max(peer_setting_.peer_pool_size_, 0)) ) return;
+
+  Peer peer = new rtc::RefCountedObject<PeerControl>(peer_name_, "", this, peer_connection_factory_, peer_setting_);
+  if ( !peer->Initialize() ) {
+    LOG_F( LERROR ) << "Failed to create a peer in the pool";
+    return;
+  }
+
+  peer_pool_.push_back(peer);
+  FillPeerPool();
+
+  LOG_F( INFO ) << "Done, pool size is " << peer_pool_.size();
+}
+
+void Control::ClearPeerPool() {
+  peer_pool_.clear();
+}
+
+
 //
 // Add ice candidate to local peer from remote peer
 //
 
+static bool ParseIceCandidate(const Json::Value& data, std::string* sdp_mid,
+                              int* sdp_mline_index, std::string* candidate) {
+
+  if ( !rtc::GetStringFromJsonObject( data, "sdp_mid", sdp_mid ) ) {
+    LOG_F( LERROR ) << "sdp_mid not found, " << data.toStyledString();
+    return false;
+  }
+
+  if ( !rtc::GetIntFromJsonObject( data, "sdp_mline_index", sdp_mline_index ) ) {
+    LOG_F( LERROR ) << "sdp_mline_index not found, " << data.toStyledString();
+    return false;
+  }
+
+  if ( !rtc::GetStringFromJsonObject( data, "candidate", candidate ) ) {
+    LOG_F( LERROR ) << "candidate not found, " << data.toStyledString();
+    return false;
+  }
+
+  return true;
+}
+
 void Control::AddIceCandidate(const string& peer_id, const Json::Value& data) {
 
   string sdp_mid;
   int sdp_mline_index;
   string candidate;
 
-  if ( !rtc::GetStringFromJsonObject( data, "sdp_mid", &sdp_mid ) ) {
-    LOG_F( LERROR ) << "sdp_mid not found, " << data.toStyledString();
+  if ( !ParseIceCandidate( data, &sdp_mid, &sdp_mline_index, &candidate ) ) {
     return;
   }
 
-  if ( !rtc::GetIntFromJsonObject( data, "sdp_mline_index", &sdp_mline_index ) ) {
-    LOG_F( LERROR ) << "sdp_mline_index not found, " << data.toStyledString();
+  auto peer = peers_.find( peer_id );
+  if ( peer == peers_.end() ) {
+    LOG_F( WARNING ) << "peer_id not found, peer_id is " << peer_id << " and " <<
+                        "data is " << data.toStyledString();
     return;
   }
 
-  if ( !rtc::GetStringFromJsonObject( data, "candidate", &candidate ) ) {
-    LOG_F( LERROR ) << "candidate not found, " << data.toStyledString();
+  peer->second->AddIceCandidate(sdp_mid, sdp_mline_index, candidate);
+  LOG_F( INFO ) << "Done, peer_id is " << peer_id;
+}
+
+//
+// Add a batch of ice candidates ('ice_candidates' command)
+//
+
+void Control::AddIceCandidates(const string& peer_id, const Json::Value& data) {
+
+  Json::Value candidates;
+  if ( !rtc::GetValueFromJsonObject( data, "candidates", &candidates ) ||
+       !candidates.isArray() ) {
+    LOG_F( LERROR ) << "candidates not found, " << data.toStyledString();
     return;
   }
 
-  if ( peers_.find( peer_id ) == peers_.end() ) {
-    LOG_F( WARNING ) << "peer_id not found, peer_id is " << peer_id << " and " <<
-                        "data is " << data.toStyledString();
+  auto peer = peers_.find( peer_id );
+  if ( peer == peers_.end() ) {
+    LOG_F( WARNING ) << "peer_id not found, peer_id is " << peer_id;
     return;
   }
 
-  peers_[peer_id]->AddIceCandidate(sdp_mid, sdp_mline_index, candidate);
-  LOG_F( INFO ) << "Done, peer_id is " << peer_id;
+  for ( Json::ArrayIndex i = 0; i < candidates.size(); i++ ) {
+    string sdp_mid;
+    int sdp_mline_index;
+    string candidate;
+
+    if ( !ParseIceCandidate( candidates[i], &sdp_mid, &sdp_mline_index, &candidate ) ) {
+      continue;
+    }
+
+    peer->second->AddIceCandidate(sdp_mid, sdp_mline_index, candidate);
+  }
+
+  LOG_F( INFO ) << "Done, peer_id is " << peer_id << ", candidates is " << candidates.size();
 }
 
 
@@ -520,10 +716,14 @@ void Control::OnOpen(const Json::Value& data) {
     return;
   }
 
+  if (channel_created_) {
+    LOG_F(INFO) << "Signal connection resumed, session_id is " << session_id;
+  }
+
   session_id_ = session_id;
 
   //
-  // Create channel
+  // Create channel. Re-create it when the signal connection is resumed.
   //
 
   CreateChannel(peer_name_);
@@ -557,6 +757,15 @@ void Control::OnChannelCreate(const Json::Value& data) {
     return;
   }
 
+  if (channel_created_) {
+    // Existing peers are still alive, so don't emit 'open' event again
+    LOG_F( INFO ) << "Channel re-created, " << peer_id;
+    return;
+  }
+
+  channel_created_ = true;
+  FillPeerPool();
+  StartSweeper();
   peer_->OnOpen(peer_id);
   LOG_F( INFO ) << "Done";
 }
@@ -604,7 +813,30 @@ void Control::OnChannelLeave(const Json::Value& data) {
 
 
 void Control::OnRemotePeerClose(const string& peer_id, const Json::Value& data) {
-  ClosePeer( peer_id, CLOSE_NORMAL );
+  string reason;
+
+  if ( !rtc::GetStringFromJsonObject( data, "reason", &reason ) ) {
+    ClosePeer( peer_id, CLOSE_NORMAL );
+    return;
+  }
+
+  //
+  // Rejected by the remote peer
+  //
+
+  if ( peers_.find( peer_id ) != peers_.end() ) {
+    ClosePeer( peer_id, CLOSE_REJECTED );
+    return;
+  }
+
+  // Rejected before the offer, while joining the channel of remote peer
+  LeaveChannel( peer_id );
+
+  if ( peer_ != nullptr ) {
+    peer_->OnClose( peer_id, CLOSE_REJECTED, reason );
+  }
+
+  LOG_F( INFO ) << "Rejected, peer is " << peer_id << ", reason is " << reason;
 }
 
 //
@@ -619,33 +851,283 @@ void Control::CreateOffer(const Json::Value& data) {
     return;
   }
 
+  //
+  // Queue the peers and create them in batches. An invalid or duplicated
+  // peer id is skipped without aborting the others.
+  //
+
   for (size_t i = 0; i < peers.size(); ++i) {
     string remote_id;
-    if (!rtc::GetStringFromJsonArray(peers, i, &remote_id)) {
+    if (!rtc::GetStringFromJsonArray(peers, i, &remote_id) || remote_id.empty()) {
       LOG_F(LERROR) << "Peer handshake failed - invalid peer id";
+      continue;
+    }
+
+    if (peers_.find(remote_id) != peers_.end() ||
+        std::find(pending_offers_.begin(), pending_offers_.end(), remote_id) != pending_offers_.end()) {
+      LOG_F(WARNING) << "Peer handshake is in progress, " << remote_id;
+      continue;
+    }
+
+    pending_offers_.push_back(remote_id);
+  }
+
+  CreatePendingOffers();
+  LOG_F( INFO ) << "Done, pending offers is " << pending_offers_.size();
+}
+
+//
+// Create peers and offers of pending_offers_.
+//  A peer connection is created on the webrtc thread, even if it's requested
+//  by other threads. So offers are created in batches on the webrtc thread,
+//  and other commands such as answers and candidates of peers created
+//  earlier are handled between batches. The number of connecting peers is
+//  limited by offer_concurrency_.
+//
+
+void Control::CreatePendingOffers() {
+
+  size_t batch = static_cast<size_t>(std::max(peer_setting_.offer_batch_size_, 1));
+  size_t connecting = 0;
+
+  if ( peer_setting_.offer_concurrency_ > 0 ) {
+    for ( auto& peer : peers_ ) {
+      if ( peer.second->state() == PeerControl::pConnecting ) connecting++;
+    }
+  }
+
+  for ( size_t created = 0; created < batch && !pending_offers_.empty(); created++ ) {
+
+    if ( peer_setting_.offer_concurrency_ > 0 &&
+         connecting >= static_cast<size_t>(peer_setting_.offer_concurrency_) ) {
+      // Resumed when a connecting peer is opened or closed
+      LOG_F( INFO ) << "Connecting peers reached the limit, " << connecting;
       return;
     }
 
-    Peer peer = new rtc::RefCountedObject<PeerControl>(peer_name_, remote_id, this, peer_connection_factory_);
-    if ( !peer->Initialize() ) {
-      LOG_F( LERROR ) << "Peer initialization failed";
+    string remote_id = pending_offers_.front();
+    pending_offers_.pop_front();
+
+    if ( !AdmitPeer(remote_id) ) {
+      RejectPeer(remote_id, "busy");
+      continue;
+    }
+
+    Peer peer = CreatePeer(remote_id);
+    if ( !peer ) {
+      LOG_F( LERROR ) << "Peer initialization failed, " << remote_id;
       OnPeerClose( remote_id, CLOSE_ABNORMAL );
-      return;
+      continue;
     }
 
     peers_.insert(std::pair<string, Peer>(remote_id, peer));
     peer->CreateOffer(NULL);
+    connecting++;
   }
 
-  LOG_F( INFO ) << "Done";
+  if ( !pending_offers_.empty() ) {
+    ScheduleOffers();
+  }
+}
+
+//
+// Admission control
+//  A burst of new peers could exhaust CPU by DTLS handshakes and make
+//  existing connections time out. New peers over the limits are rejected
+//  by 'peerclosed' command with a reason, so the remote peer closes
+//  with CLOSE_REJECTED.
+//
+
+bool Control::AdmitPeer(const string& remote_id) {
+
+  if ( peer_setting_.max_peers_ > 0 &&
+       peers_.size() >= static_cast<size_t>(peer_setting_.max_peers_) ) {
+    LOG_F( WARNING ) << "Too many peers, " << peers_.size();
+    return false;
+  }
+
+  if ( peer_setting_.max_handshakes_ > 0 ) {
+    size_t connecting = 0;
+    for ( auto& peer : peers_ ) {
+      if ( peer.second->state() == PeerControl::pConnecting ) connecting++;
+    }
+
+    if ( connecting >= static_cast<size_t>(peer_setting_.max_handshakes_) ) {
+      LOG_F( WARNING ) << "Too many handshakes, " << connecting;
+      return false;
+    }
+  }
+
+  if ( accept_limiter_.enabled() && accept_limiter_.Take() > 0 ) {
+    LOG_F( WARNING ) << "Accept rate exceeded, peer is " << remote_id;
+    return false;
+  }
+
+  return true;
+}
+
+void Control::RejectPeer(const string& remote_id, const string& reason) {
+  Json::Value data;
+  data["reason"] = reason;
+  SendCommand(remote_id, "peerclosed", data);
+  LOG_F( INFO ) << "Done, peer is " << remote_id << ", reason is " << reason;
+}
+
+//
+// Sweeper
+//  Peers are closed by ICE or data channel events, but a peer stuck in
+//  connecting or failed ICE is never closed by itself. Sweeper closes
+//  stale peers periodically, and the least recently active peers while
+//  estimated memory of peers is over the budget.
+//
+
+// A rough estimate of memory used by a peer connection and SCTP association
+static const size_t kPeerMemoryBytes = 256 * 1024;
+
+void Control::StartSweeper() {
+  if ( sweeping_ || peer_setting_.sweep_interval_ms_ <= 0 ) return;
+
+  sweeping_ = true;
+  ControlMessageData *data = new ControlMessageData(0, ref_);
+  webrtc_thread_->PostDelayed(RTC_FROM_HERE, peer_setting_.sweep_interval_ms_,
+                              this, MSG_SWEEP_PEERS, data);
+}
+
+void Control::SweepPeers() {
+
+  if ( !sweeping_ ) return;
+
+  const PeerSetting& setting = peer_setting_;
+  int64_t now = rtc::TimeMillis();
+  std::vector<std::pair<string, CloseCode>> evicted;
+  std::vector<Peer> active;
+  size_t memory = 0;
+
+  for ( auto& item : peers_ ) {
+    Peer& peer = item.second;
+
+    if ( peer->state() == PeerControl::pConnecting &&
+         setting.handshake_timeout_ms_ > 0 &&
+         now - peer->connecting_ms() >= setting.handshake_timeout_ms_ ) {
+      LOG_F( WARNING ) << "Handshake timeout, peer is " << item.first;
+      evicted.push_back(std::make_pair(item.first, CLOSE_ABNORMAL));
+      continue;
+    }
+
+    if ( peer->ice_failed_ms() > 0 &&
+         now - peer->ice_failed_ms() >= setting.ice_failed_timeout_ms_ ) {
+      LOG_F( WARNING ) << "ICE connection failed, peer is " << item.first;
+      evicted.push_back(std::make_pair(item.first, CLOSE_ABNORMAL));
+      continue;
+    }
+
+    if ( peer->state() == PeerControl::pOpen &&
+         setting.idle_timeout_ms_ > 0 &&
+         now - peer->last_activity_ms() >= setting.idle_timeout_ms_ ) {
+      LOG_F( INFO ) << "Idle timeout, peer is " << item.first;
+      evicted.push_back(std::make_pair(item.first, CLOSE_GOING_AWAY));
+      continue;
+    }
+
+    memory += kPeerMemoryBytes + static_cast<size_t>(peer->BufferedAmount());
+    if ( peer->state() == PeerControl::pOpen ) active.push_back(peer);
+  }
+
+  //
+  // Memory budget
+  //
+
+  if ( setting.max_peer_memory_ > 0 && memory > setting.max_peer_memory_ ) {
+    std::sort(active.begin(), active.end(), [] (const Peer& a, const Peer& b) {
+      return a->last_activity_ms() < b->last_activity_ms();
+    });
+
+    for ( auto& peer : active ) {
+      if ( memory <= setting.max_peer_memory_ ) break;
+
+      LOG_F( WARNING ) << "Over memory budget, peer is " << peer->remote_id();
+      memory -= std::min(memory, kPeerMemoryBytes + static_cast<size_t>(peer->BufferedAmount()));
+      evicted.push_back(std::make_pair(peer->remote_id(), CLOSE_GOING_AWAY));
+    }
+  }
+
+  for ( auto& peer : evicted ) {
+    ClosePeer(peer.first, peer.second);
+  }
+
+  sweeping_ = false;
+  StartSweeper();
+}
+
+void Control::ScheduleOffers() {
+  if ( offers_scheduled_ || pending_offers_.empty() ) return;
+
+  offers_scheduled_ = true;
+  ControlMessageData *data = new ControlMessageData(0, ref_);
+  webrtc_thread_->Post(RTC_FROM_HERE, this, MSG_CREATE_OFFERS, data);
 }
 
+//
+// The remote peer accepts 'ice_candidates' command. It is advertised in
+// 'offersdp' and 'answersdp', and older versions don't have it.
+//
+
+static bool RemoteBatching(const Json::Value& data) {
+  bool batching = false;
+  return rtc::GetBoolFromJsonObject( data, "ice_candidates", &batching ) && batching;
+}
+
+
 //
 // 'offersdp' command
 //
 
 void Control::ReceiveOfferSdp(const string& peer_id, const Json::Value& data) {
+  MemoryScope memory_scope(MEMORY_PEER);
   string sdp;
+  string token;
+
+  //
+  // Renegotiation of an existing peer, such as ICE restart
+  //
+
+  auto existing = peers_.find( peer_id );
+  if ( existing != peers_.end() && existing->second->state() == PeerControl::pOpen ) {
+    if ( !rtc::GetStringFromJsonObject( data, "sdp", &sdp ) ) {
+      LOG_F( LERROR ) << "sdp not found, peer_id is " << peer_id;
+      return;
+    }
+
+    existing->second->set_remote_batching( RemoteBatching( data ) );
+    existing->second->ReceiveOfferSdp( sdp );
+    LOG_F( INFO ) << "Done, renegotiation";
+    return;
+  }
+
+  if ( !AdmitPeer( peer_id ) ) {
+    RejectPeer( peer_id, "busy" );
+    LeaveChannel( peer_id );
+    OnPeerClose( peer_id, CLOSE_REJECTED );
+    return;
+  }
+
+  //
+  // A remote peer is in the same process. Use the in-process transport
+  // without creating a peer connection.
+  //
+
+  if ( peer_setting_.local_transport_ &&
+       rtc::GetStringFromJsonObject( data, "local", &token ) ) {
+    Peer peer = new rtc::RefCountedObject<PeerControl>(peer_name_, peer_id, this, peer_connection_factory_, peer_setting_);
+    peers_.insert(std::pair<string, Peer>(peer_id, peer));
+
+    if ( peer->ReceiveLocalOffer(token) ) {
+      LOG_F( INFO ) << "Done, in-process transport";
+      return;
+    }
+
+    peers_.erase(peer_id);
+  }
 
   if ( !rtc::GetStringFromJsonObject( data, "sdp", &sdp ) ) {
     LOG_F( LERROR ) << "sdp not found, peer_id is " << peer_id << " and " <<
@@ -653,14 +1135,15 @@ void Control::ReceiveOfferSdp(const string& peer_id, const Json::Value& data) {
     return;
   }
 
-  Peer peer = new rtc::RefCountedObject<PeerControl>(peer_name_, peer_id, this, peer_connection_factory_);
-  if ( !peer->Initialize() ) {
+  Peer peer = CreatePeer(peer_id);
+  if ( !peer ) {
     LOG_F( LERROR ) << "Peer initialization failed";
     OnPeerClose( peer_id, CLOSE_ABNORMAL );
     return;
   }
 
   peers_.insert(std::pair<string, Peer>(peer_id, peer));
+  peer->set_remote_batching(RemoteBatching(data));
   peer->ReceiveOfferSdp(sdp);
 
   LOG_F( INFO ) << "Done";
@@ -673,20 +1156,29 @@ void Control::ReceiveOfferSdp(const string& peer_id, const Json::Value& data) {
 
 void Control::ReceiveAnswerSdp(const string& peer_id, const Json::Value& data) {
   string sdp;
+  string token;
 
-  if ( !rtc::GetStringFromJsonObject( data, "sdp", &sdp ) ) {
-    LOG_F( LERROR ) << "sdp not found, peer_id is " << peer_id << " and " <<
+  auto peer = peers_.find(peer_id);
+  if ( peer == peers_.end() ) {
+    LOG_F( LERROR ) << "peer_id not found, peer_id is " << peer_id << " and " <<
                         "data is " << data.toStyledString();
     return;
   }
 
-  auto peer = peers_.find(peer_id);
-  if ( peer == peers_.end() ) {
-    LOG_F( LERROR ) << "peer_id not found, peer_id is " << peer_id << " and " <<
+  // A remote peer in the same process answered with its token
+  if ( rtc::GetStringFromJsonObject( data, "local", &token ) ) {
+    peer->second->ReceiveLocalAnswer(token);
+    LOG_F( INFO ) << "Done, in-process transport";
+    return;
+  }
+
+  if ( !rtc::GetStringFromJsonObject( data, "sdp", &sdp ) ) {
+    LOG_F( LERROR ) << "sdp not found, peer_id is " << peer_id << " and " <<
                         "data is " << data.toStyledString();
     return;
   }
 
+  peer->second->set_remote_batching(RemoteBatching(data));
   peer->second->ReceiveAnswerSdp(sdp);
   LOG_F( INFO ) << "Done";
 }
@@ -8,10 +8,12 @@
 #define __PEERAPI_CONTROL_H__
 
 #include <memory>
+#include <deque>
 
 #include "peer.h"
 #include "signalconnection.h"
 #include "controlobserver.h"
+#include "tokenbucket.h"
 
 #include "webrtc/base/sigslot.h"
 #include "fakeaudiocapturemodule.h"
@@ -43,7 +45,8 @@ public:
   // Negotiation and send data
   //
 
-  void Send(const string to, const char* data, const size_t size);
+  bool Send(const string to, const char* data, const size_t size,
+            const SendPriority priority = PRIORITY_NORMAL);
   bool SyncSend(const string to, const char* data, const size_t size);
 
   void Open(const string& user_id, const string& user_password, const string& peer_id);
@@ -55,6 +58,9 @@ public:
   void OnSignalCommandReceived(const Json::Value& message);
   void OnSignalConnectionClosed(websocketpp::close::status::value code);
 
+  void set_peer_setting(const PeerSetting& setting) { peer_setting_ = setting; }
+  const PeerSetting& peer_setting() const { return peer_setting_; }
+
   //
   // PeerObserver implementation
   //
@@ -80,7 +86,19 @@ protected:
   void LeaveChannel(const string name);
   bool CreatePeerFactory(const webrtc::MediaConstraintsInterface* constraints);
   void CreateOffer(const Json::Value& data);
+  void CreatePendingOffers();
+  void ScheduleOffers();
+  bool AdmitPeer(const string& remote_id);
+  void RejectPeer(const string& remote_id, const string& reason);
+
+  //
+  // Sweeper of stale peers
+  //
+
+  void StartSweeper();
+  void SweepPeers();
   void AddIceCandidate(const string& peer_id, const Json::Value& data);
+  void AddIceCandidates(const string& peer_id, const Json::Value& data);
   void ReceiveOfferSdp(const string& peer_id, const Json::Value& data);
   void ReceiveAnswerSdp(const string& peer_id, const Json::Value& data);
 
@@ -90,6 +108,17 @@ protected:
   void OnChannelLeave(const Json::Value& data);
   void OnRemotePeerClose(const string& peer_id, const Json::Value& data);
 
+  //
+  // Peer pool
+  //
+
+  using Peer = rtc::scoped_refptr<PeerControl>;
+
+  Peer CreatePeer(const string& remote_id);
+  void FillPeerPool();
+  void CreatePooledPeer();
+  void ClearPeerPool();
+
 
   // peer_name_: A name of local peer. Other peers can find this peer by peer_
   // user_id_: A user id to sign in signal server (could be 'anonymous' for guest user)
@@ -98,11 +127,31 @@ protected:
   string user_id_;
   string session_id_;
 
+  // channel_created_: The channel has been created once. If the signal
+  // connection is resumed, the channel is re-created without 'open' event.
+  bool channel_created_;
+
   std::shared_ptr<Signal> signal_;
   rtc::scoped_refptr<FakeAudioCaptureModule> fake_audio_capture_module_;
 
-  using Peer = rtc::scoped_refptr<PeerControl>;
   std::map<string, Peer> peers_;
+  PeerSetting peer_setting_;
+
+  // Peers created ahead, with the peer connection and the data channel
+  std::deque<Peer> peer_pool_;
+  bool peer_pool_filling_;
+
+  // Remote peers of 'createoffer' waiting to be created
+  std::deque<string> pending_offers_;
+  bool offers_scheduled_;
+
+  // Rate of new peers
+  TokenBucket accept_limiter_;
+
+  bool sweeping_;
+
+  // SendBudget has been set by this peer, and is released on DeleteControl()
+  bool send_budget_held_;
 
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
       peer_connection_factory_;
@@ -114,7 +163,10 @@ private:
     MSG_CLOSE,                      // Queue signout request
     MSG_CLOSE_PEER,                 // Close peer
     MSG_ON_PEER_CLOSE,              // Peer has been closed
-    MSG_ON_SIGLAL_CONNECTION_CLOSE  // Connection to signal server has been closed
+    MSG_ON_SIGLAL_CONNECTION_CLOSE, // Connection to signal server has been closed
+    MSG_FILL_PEER_POOL,             // Create a peer in the pool
+    MSG_CREATE_OFFERS,              // Create a next batch of pending offers
+    MSG_SWEEP_PEERS                 // Evict stale peers
   };
 
   struct ControlMessageData : public rtc::MessageData {
@@ -345,6 +345,174 @@ BOOST_AUTO_TEST_CASE( set_max_message_size ) {
     BOOST_CHECK_EQUAL(run_server_test(s,input), output);
 }
 
+struct write_recorder {
+    server * s;
+    std::string output;
+    std::vector<size_t> buffers;
+};
+
+websocketpp::lib::error_code record_write(write_recorder * r,
+    websocketpp::connection_hdl, char const * buf, size_t len)
+{
+    r->output.append(buf,len);
+    return websocketpp::lib::error_code();
+}
+
+websocketpp::lib::error_code record_vector_write(write_recorder * r,
+    websocketpp::connection_hdl hdl,
+    std::vector<websocketpp::transport::buffer> const & bufs)
+{
+    for (size_t i = 0; i < bufs.size(); i++) {
+        r->output.append(bufs[i].buf,bufs[i].len);
+    }
+    r->buffers.push_back(bufs.size());
+
+    // Frames sent while this write is outstanding are written together
+    if (r->buffers.size() == 1) {
+        r->s->send(hdl,"a",websocketpp::frame::opcode::text);
+        r->s->send(hdl,"b",websocketpp::frame::opcode::text);
+    }
+
+    return websocketpp::lib::error_code();
+}
+
+std::string run_write_batch_test(write_recorder & r, size_t batch_size) {
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // After the handshake, add a masked text frame "x" that is echoed
+    char frame[7] = {char(0x81), char(0x81), 0x00, 0x00, 0x00, 0x00, 'x'};
+    input.append(frame, 7);
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_message_handler(bind(&echo_func,&s,::_1,::_2));
+    s.set_write_batch_size(batch_size);
+    r.s = &s;
+
+    server::connection_ptr con = s.get_connection();
+    con->set_write_handler(bind(&record_write,&r,::_1,::_2,websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(bind(&record_vector_write,&r,::_1,::_2));
+    con->start();
+
+    std::stringstream channel;
+    channel << input;
+    channel >> *con;
+
+    return r.output.substr(r.output.find("\r\n\r\n") + 4);
+}
+
+BOOST_AUTO_TEST_CASE( write_batch ) {
+    std::string frames = "\x81\x01x\x81\x01" "a\x81\x01" "b";
+
+    // Header and payload of each frame and queued frames share a buffer
+    write_recorder r1;
+    BOOST_CHECK_EQUAL(run_write_batch_test(r1,16384), frames);
+    BOOST_REQUIRE_EQUAL(r1.buffers.size(), 2);
+    BOOST_CHECK_EQUAL(r1.buffers[0], 1);
+    BOOST_CHECK_EQUAL(r1.buffers[1], 1);
+
+    // Runs are limited to the batch size
+    write_recorder r2;
+    BOOST_CHECK_EQUAL(run_write_batch_test(r2,3), frames);
+    BOOST_REQUIRE_EQUAL(r2.buffers.size(), 2);
+    BOOST_CHECK_EQUAL(r2.buffers[0], 1);
+    BOOST_CHECK_EQUAL(r2.buffers[1], 2);
+
+    // Without coalescing headers and payloads are separate buffers
+    write_recorder r3;
+    BOOST_CHECK_EQUAL(run_write_batch_test(r3,0), frames);
+    BOOST_REQUIRE_EQUAL(r3.buffers.size(), 2);
+    BOOST_CHECK_EQUAL(r3.buffers[0], 2);
+    BOOST_CHECK_EQUAL(r3.buffers[1], 4);
+}
+
+struct read_recorder {
+    read_recorder() : messages(0), bytes(0) {}
+
+    size_t messages;
+    size_t bytes;
+};
+
+void record_message(read_recorder * r, websocketpp::connection_hdl,
+    message_ptr msg)
+{
+    r->messages++;
+    r->bytes += msg->get_payload().size();
+}
+
+// Masked frame with a zero masking key and a payload of len bytes
+std::string masked_frame(size_t len) {
+    std::string frame(1, char(0x82));
+    if (len < 126) {
+        frame += char(0x80 | len);
+    } else {
+        frame += char(0xff);
+        for (int i = 7; i >= 0; i--) {
+            frame += char((uint64_t(len) >> (8 * i)) & 0xff);
+        }
+    }
+    frame.append(4, char(0x00));
+    frame.append(len, 'x');
+    return frame;
+}
+
+server::connection_ptr run_read_test(server & s, read_recorder & r,
+    std::string const & frames)
+{
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_message_handler(bind(&record_message,&r,::_1,::_2));
+
+    std::stringstream output;
+    server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+
+    std::stringstream channel;
+    channel << input << frames;
+    channel >> *con;
+
+    return con;
+}
+
+BOOST_AUTO_TEST_CASE( read_buffer_growth ) {
+    std::string frames;
+    for (size_t i = 0; i < 1000; i++) {
+        frames += masked_frame(125);
+    }
+
+    // Reads that keep filling the buffer grow it up to the maximum
+    server s1;
+    s1.set_max_read_buffer_size(65536);
+    read_recorder r1;
+    server::connection_ptr con1 = run_read_test(s1,r1,frames);
+    BOOST_CHECK_EQUAL(r1.messages, 1000);
+    BOOST_CHECK_EQUAL(r1.bytes, 125000);
+    BOOST_CHECK_EQUAL(con1->get_read_buffer_size(), 65536);
+
+    // A maximum below the initial size keeps the initial size
+    server s2;
+    s2.set_max_read_buffer_size(0);
+    read_recorder r2;
+    server::connection_ptr con2 = run_read_test(s2,r2,frames);
+    BOOST_CHECK_EQUAL(r2.messages, 1000);
+    BOOST_CHECK_EQUAL(r2.bytes, 125000);
+    BOOST_CHECK_EQUAL(con2->get_read_buffer_size(),
+        size_t(websocketpp::config::core::connection_read_buffer_size));
+}
+
+BOOST_AUTO_TEST_CASE( read_message_spanning_buffers ) {
+    // A message larger than the read buffer, followed by a small one
+    server s;
+    read_recorder r;
+    run_read_test(s,r,masked_frame(200000) + masked_frame(10));
+    BOOST_CHECK_EQUAL(r.messages, 2);
+    BOOST_CHECK_EQUAL(r.bytes, 200010);
+}
+
 BOOST_AUTO_TEST_CASE( websocket_fail_parse_error ) {
     std::string input = "asdf\r\n\r\n";
 
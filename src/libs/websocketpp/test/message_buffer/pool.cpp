@@ -25,132 +25,160 @@
  *
  */
 //#define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE hybi_00_processor
+#define BOOST_TEST_MODULE message_buffer_pool
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
 #include <string>
 
-#include <websocketpp/processors/hybi00.hpp>
-#include <websocketpp/http/request.hpp>
-#include <websocketpp/http/response.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/message_buffer/pool.hpp>
 
+namespace pool = websocketpp::message_buffer::pool;
 
-BOOST_AUTO_TEST_CASE( exact_match ) {
-    websocketpp::http::parser::request r;
-    websocketpp::http::parser::response response;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+typedef websocketpp::message_buffer::message<pool::con_msg_manager>
+    message_type;
+typedef pool::con_msg_manager<message_type> con_msg_man_type;
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nOrigin: http://example.com\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+BOOST_AUTO_TEST_CASE( basic_get_message ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,512);
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","WjN}|M(6");
-
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(p.validate_handshake(r));
+    BOOST_CHECK(msg);
+    BOOST_CHECK_EQUAL(msg->get_opcode(), websocketpp::frame::opcode::TEXT);
+    BOOST_CHECK_GE(msg->get_raw_payload().capacity(), 1024);
+    BOOST_CHECK_EQUAL(manager->get_stats().allocated, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().reused, 0);
+}
 
-    websocketpp::uri_ptr u;
-    bool exception;
+BOOST_AUTO_TEST_CASE( recycle_message ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    message_type * raw = msg.get();
+
+    msg->set_payload("foo");
+    msg->set_header("bar");
+    msg->set_prepared(true);
+    msg->set_fin(false);
+    msg->set_terminal(true);
+    msg->set_compressed(true);
+    msg.reset();
+
+    BOOST_CHECK_EQUAL(manager->get_stats().recycled, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().pooled, 1);
+
+    // The recycled message is reused and reset to the state of a new one
+    msg = manager->get_message(websocketpp::frame::opcode::BINARY,200);
+
+    BOOST_CHECK_EQUAL(msg.get(), raw);
+    BOOST_CHECK_EQUAL(msg->get_opcode(), websocketpp::frame::opcode::BINARY);
+    BOOST_CHECK_EQUAL(msg->get_payload(), "");
+    BOOST_CHECK_EQUAL(msg->get_header(), "");
+    BOOST_CHECK(!msg->get_prepared());
+    BOOST_CHECK(msg->get_fin());
+    BOOST_CHECK(!msg->get_terminal());
+    BOOST_CHECK(!msg->get_compressed());
+
+    BOOST_CHECK_EQUAL(manager->get_stats().allocated, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().reused, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().pooled, 0);
+}
 
-    try {
-        u = p.get_uri(r);
-    } catch (const websocketpp::uri_exception& e) {
-        exception = true;
-    }
+BOOST_AUTO_TEST_CASE( size_classes ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
 
-    BOOST_CHECK(exception == false);
-    BOOST_CHECK(u->get_secure() == false);
-    BOOST_CHECK(u->get_host() == "www.example.com");
-    BOOST_CHECK(u->get_resource() == "/");
-    BOOST_CHECK(u->get_port() == websocketpp::URI_DEFAULT_PORT);
+    message_type::ptr small = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    message_type * raw = small.get();
+    small.reset();
 
-    p.process_handshake(r,response);
+    // A larger request is not fulfilled by a smaller class
+    message_type::ptr large = manager->get_message(websocketpp::frame::opcode::TEXT,5000);
+    BOOST_CHECK_NE(large.get(), raw);
+    BOOST_CHECK_GE(large->get_raw_payload().capacity(), 16384);
+    BOOST_CHECK_EQUAL(manager->get_stats().allocated, 2);
 
-    BOOST_CHECK(response.get_header("Connection") == "Upgrade");
-    BOOST_CHECK(response.get_header("Upgrade") == "websocket");
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Origin") == "http://example.com");
+    // A message that grew is recycled into the larger class
+    message_type::ptr grown = manager->get_message();
+    BOOST_CHECK_EQUAL(grown.get(), raw);
+    grown->set_payload(std::string(2000,'*'));
+    grown.reset();
 
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Location") == "ws://www.example.com/");
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Key3") == "n`9eBk9z$R8pOtVb");
+    message_type::ptr medium = manager->get_message(websocketpp::frame::opcode::TEXT,1024);
+    BOOST_CHECK_EQUAL(medium.get(), raw);
+    BOOST_CHECK_GE(medium->get_raw_payload().capacity(), 1024);
 }
 
-BOOST_AUTO_TEST_CASE( non_get_method ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
-
-    std::string handshake = "POST / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+BOOST_AUTO_TEST_CASE( oversized_message ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::BINARY,100000);
+    BOOST_CHECK_GE(msg->get_raw_payload().capacity(), 100000);
+    msg.reset();
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    BOOST_CHECK_EQUAL(manager->get_stats().released, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().pooled, 0);
 }
 
-BOOST_AUTO_TEST_CASE( old_http_version ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
-
-    std::string handshake = "GET / HTTP/1.0\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+BOOST_AUTO_TEST_CASE( max_pooled ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type(2));
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    std::vector<message_type::ptr> msgs;
+    for (int i = 0; i < 3; i++) {
+        msgs.push_back(manager->get_message(websocketpp::frame::opcode::TEXT,100));
+    }
+    msgs.clear();
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    BOOST_CHECK_EQUAL(manager->get_stats().recycled, 2);
+    BOOST_CHECK_EQUAL(manager->get_stats().released, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().pooled, 2);
 }
 
-BOOST_AUTO_TEST_CASE( missing_handshake_key1 ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( recycle_payload_view ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    message_type * raw = msg.get();
+    size_t capacity = msg->get_payload_capacity();
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\n\r\n";
+    // A view larger than any size class would be released if it was copied
+    std::string buffer(100000,'*');
+    msg->set_payload_view(buffer.data(),buffer.size());
+    msg.reset();
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    BOOST_CHECK_EQUAL(manager->get_stats().recycled, 1);
+    BOOST_CHECK_EQUAL(manager->get_stats().released, 0);
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    msg = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    BOOST_CHECK_EQUAL(msg.get(), raw);
+    BOOST_CHECK_EQUAL(msg->get_payload_capacity(), capacity);
+    BOOST_CHECK(!msg->has_payload_view());
+    BOOST_CHECK_EQUAL(buffer, std::string(100000,'*'));
 }
 
-BOOST_AUTO_TEST_CASE( missing_handshake_key2 ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( message_outlives_manager ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    message_type::ptr pooled = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    pooled.reset();
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    manager.reset();
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    msg->set_payload("foo");
+    BOOST_CHECK_EQUAL(msg->get_payload(), "foo");
+    msg.reset();
 }
 
-BOOST_AUTO_TEST_CASE( bad_host ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
-    websocketpp::uri_ptr u;
-    bool exception = false;
-
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com:70000\r\nConnection: upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+BOOST_AUTO_TEST_CASE( endpoint_managers ) {
+    pool::endpoint_msg_manager<con_msg_man_type> em;
+    BOOST_CHECK_NE(em.get_manager(), em.get_manager());
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
-
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
-
-    try {
-        u = p.get_uri(r);
-    } catch (const websocketpp::uri_exception& e) {
-        exception = true;
-    }
+    pool::shared_endpoint_msg_manager<con_msg_man_type> sem;
+    con_msg_man_type::ptr manager = sem.get_manager();
+    BOOST_CHECK_EQUAL(manager, sem.get_manager());
 
-    BOOST_CHECK(exception == true);
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,100);
+    msg.reset();
+    BOOST_CHECK_EQUAL(manager->get_stats().pooled, 1);
 }
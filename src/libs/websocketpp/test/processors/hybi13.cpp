@@ -491,6 +491,133 @@ BOOST_AUTO_TEST_CASE( prepare_data_frame ) {
 
 }
 
+BOOST_AUTO_TEST_CASE( prepare_data_frame_in_place ) {
+    processor_setup env1(false);
+    processor_setup env2(false);
+
+    message_ptr in = env1.msg_manager->get_message(websocketpp::frame::opcode::TEXT,3);
+    message_ptr out = env1.msg_manager->get_message();
+    message_ptr msg = env2.msg_manager->get_message(websocketpp::frame::opcode::TEXT,3);
+
+    in->set_payload("foo");
+    msg->set_payload("foo");
+
+    BOOST_CHECK( !env1.p.prepare_data_frame(in,out) );
+    BOOST_CHECK( !env2.p.prepare_data_frame(msg,msg) );
+
+    BOOST_CHECK( msg->get_prepared() );
+    BOOST_CHECK_EQUAL( msg->get_header(), out->get_header() );
+    BOOST_CHECK_EQUAL( msg->get_payload(), out->get_payload() );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_data_frame_in_place_compressed ) {
+    processor_setup_ext env1(true);
+    processor_setup_ext env2(true);
+
+    env1.req.replace_header("Sec-WebSocket-Extensions", "permessage-deflate");
+    env2.req.replace_header("Sec-WebSocket-Extensions", "permessage-deflate");
+    BOOST_CHECK( !env1.p.negotiate_extensions(env1.req).first );
+    BOOST_CHECK( !env2.p.negotiate_extensions(env2.req).first );
+
+    std::string payload(1000,'*');
+
+    message_ptr in = env1.msg_manager->get_message(websocketpp::frame::opcode::TEXT,payload.size());
+    message_ptr out = env1.msg_manager->get_message();
+    message_ptr msg = env2.msg_manager->get_message(websocketpp::frame::opcode::TEXT,payload.size());
+
+    in->set_payload(payload);
+    in->set_compressed(true);
+    msg->set_payload(payload);
+    msg->set_compressed(true);
+
+    BOOST_CHECK( !env1.p.prepare_data_frame(in,out) );
+    BOOST_CHECK( !env2.p.prepare_data_frame(msg,msg) );
+
+    BOOST_CHECK_LT( msg->get_payload().size(), payload.size() );
+    BOOST_CHECK_EQUAL( msg->get_header(), out->get_header() );
+    BOOST_CHECK_EQUAL( msg->get_payload(), out->get_payload() );
+}
+
+BOOST_AUTO_TEST_CASE( zero_copy_frame_unmasked ) {
+    processor_setup env(false);
+    env.p.set_zero_copy(true);
+
+    uint8_t frame[7] = {0x81, 0x05, 'h', 'e', 'l', 'l', 'o'};
+
+    BOOST_CHECK_EQUAL( env.p.consume(frame,7,env.ec), 7 );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+
+    message_ptr foo = env.p.get_message();
+
+    // The payload refers to the consumed buffer until it is detached
+    BOOST_CHECK( foo->has_payload_view() );
+    BOOST_CHECK_EQUAL( foo->get_payload_data(), reinterpret_cast<char *>(frame+2) );
+    BOOST_CHECK_EQUAL( foo->get_payload_size(), 5 );
+
+    BOOST_CHECK_EQUAL( foo->get_payload(), "hello" );
+    BOOST_CHECK( !foo->has_payload_view() );
+
+    frame[2] = 'j';
+    BOOST_CHECK_EQUAL( foo->get_payload(), "hello" );
+    BOOST_CHECK_EQUAL( std::string(foo->get_payload_data(),foo->get_payload_size()), "hello" );
+}
+
+BOOST_AUTO_TEST_CASE( zero_copy_frame_copied ) {
+    uint8_t frame[7] = {0x82, 0x05, 'h', 'e', 'l', 'l', 'o'};
+
+    // incomplete in the consumed buffer
+    processor_setup env1(false);
+    env1.p.set_zero_copy(true);
+
+    BOOST_CHECK_EQUAL( env1.p.consume(frame,4,env1.ec), 4 );
+    BOOST_CHECK_EQUAL( env1.p.consume(frame+4,3,env1.ec), 3 );
+    BOOST_CHECK( !env1.ec );
+    BOOST_CHECK_EQUAL( env1.p.ready(), true );
+
+    message_ptr foo = env1.p.get_message();
+    BOOST_CHECK( !foo->has_payload_view() );
+    BOOST_CHECK_EQUAL( foo->get_payload(), "hello" );
+
+    // fragmented
+    processor_setup env2(false);
+    env2.p.set_zero_copy(true);
+
+    uint8_t fragments[9] = {0x02, 0x02, 'h', 'e', 0x80, 0x03, 'l', 'l', 'o'};
+
+    BOOST_CHECK_EQUAL( env2.p.consume(fragments,9,env2.ec), 9 );
+    BOOST_CHECK( !env2.ec );
+    BOOST_CHECK_EQUAL( env2.p.ready(), true );
+
+    message_ptr bar = env2.p.get_message();
+    BOOST_CHECK( !bar->has_payload_view() );
+    BOOST_CHECK_EQUAL( bar->get_payload(), "hello" );
+
+    // masked
+    processor_setup env3(true);
+    env3.p.set_zero_copy(true);
+
+    uint8_t masked[11] = {0x82, 0x85, 0x00, 0x00, 0x00, 0x00, 'h', 'e', 'l', 'l', 'o'};
+
+    BOOST_CHECK_EQUAL( env3.p.consume(masked,11,env3.ec), 11 );
+    BOOST_CHECK( !env3.ec );
+    BOOST_CHECK_EQUAL( env3.p.ready(), true );
+
+    message_ptr baz = env3.p.get_message();
+    BOOST_CHECK( !baz->has_payload_view() );
+    BOOST_CHECK_EQUAL( baz->get_payload(), "hello" );
+}
+
+BOOST_AUTO_TEST_CASE( zero_copy_invalid_utf8 ) {
+    processor_setup env(false);
+    env.p.set_zero_copy(true);
+
+    uint8_t frame[4] = {0x81, 0x02, 0xC3, 0x28};
+
+    env.p.consume(frame,4,env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::invalid_utf8 );
+}
+
 BOOST_AUTO_TEST_CASE( single_frame_message_too_large ) {
     processor_setup env(true);
     
@@ -536,3 +536,80 @@ BOOST_AUTO_TEST_CASE( continuous_word_mask2 ) {
     frame::word_mask_circ(buffer,12,pkey);
     BOOST_CHECK( std::equal(buffer,buffer+12,unmasked) );
 }
+
+BOOST_AUTO_TEST_CASE( simd_mask_kernels ) {
+    frame::masking_key_type key;
+    key.c[0] = 0xEE;
+    key.c[1] = 0x70;
+    key.c[2] = 0xFB;
+    key.c[3] = 0xD5;
+
+    uint8_t input[300];
+    for (size_t i = 0; i < sizeof(input); ++i) {
+        input[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+
+    cpu::kernel kernels[] = {cpu::scalar, cpu::sse2, cpu::avx2, cpu::neon};
+
+    for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k) {
+        frame::simd::mask_function f = frame::simd::get_mask_function(kernels[k]);
+        if (!f) {
+            BOOST_CHECK( !cpu::is_supported(kernels[k]) );
+            continue;
+        }
+
+        // Every length and misalignment of input and output against the
+        // byte by byte reference
+        for (size_t offset = 0; offset < 4; ++offset) {
+            for (size_t length = 0; length + offset + 3 <= sizeof(input); ++length) {
+                uint8_t expected[300] = {0};
+                uint8_t output[304] = {0};
+
+                frame::byte_mask(input+offset,input+offset+length,expected,key,0);
+                f(input+offset,output+3,length,key.c);
+
+                BOOST_CHECK_MESSAGE( std::equal(expected,expected+length,output+3),
+                    cpu::get_kernel_name(kernels[k]) << " length " <<
+                    length << " offset " << offset );
+                BOOST_CHECK( output[3+length] == 0 );
+            }
+        }
+
+        // In place
+        uint8_t buffer[300];
+        uint8_t expected[300];
+        std::copy(input,input+sizeof(input),buffer);
+        frame::byte_mask(input+1,input+sizeof(input),expected,key,0);
+        f(buffer+1,buffer+1,sizeof(buffer)-1,key.c);
+        BOOST_CHECK( std::equal(expected,expected+sizeof(buffer)-1,buffer+1) );
+    }
+
+    BOOST_CHECK( cpu::is_supported(cpu::detect_kernel()) );
+}
+
+BOOST_AUTO_TEST_CASE( circ_mask_chunks ) {
+    frame::masking_key_type key;
+    key.c[0] = 0x12;
+    key.c[1] = 0x34;
+    key.c[2] = 0x56;
+    key.c[3] = 0x78;
+
+    uint8_t input[257];
+    uint8_t expected[257];
+    for (size_t i = 0; i < sizeof(input); ++i) {
+        input[i] = static_cast<uint8_t>(255 - i);
+    }
+    frame::byte_mask(input,input+sizeof(input),expected,key,0);
+
+    // Chunks of every size carry the key phase over
+    for (size_t chunk = 1; chunk <= 70; ++chunk) {
+        uint8_t output[257];
+        size_t pkey = frame::prepare_masking_key(key);
+        for (size_t i = 0; i < sizeof(input); i += chunk) {
+            size_t length = std::min(chunk,sizeof(input)-i);
+            pkey = frame::byte_mask_circ(input+i,output+i,length,pkey);
+        }
+        BOOST_CHECK_MESSAGE( std::equal(expected,expected+sizeof(input),output),
+            "chunk " << chunk );
+    }
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE utf8_validator
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <websocketpp/utf8_validator.hpp>
+
+using namespace websocketpp;
+
+namespace {
+
+/// Deterministic generator, so that a failure can be reproduced
+class generator {
+public:
+    explicit generator(uint32_t seed) : m_state(seed) {}
+
+    uint32_t next(uint32_t range) {
+        m_state = m_state * 1664525u + 1013904223u;
+        return (m_state >> 8) % range;
+    }
+private:
+    uint32_t m_state;
+};
+
+void append_codepoint(std::string & s, uint32_t cp) {
+    if (cp < 0x80) {
+        s += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        s += static_cast<char>(0xC0 | (cp >> 6));
+        s += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += static_cast<char>(0xE0 | (cp >> 12));
+        s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        s += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        s += static_cast<char>(0xF0 | (cp >> 18));
+        s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+/// Mostly ASCII text with valid codepoints and invalid sequences mixed in
+std::string random_text(generator & g) {
+    static char const * const invalid[] = {
+        "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xED\xA0\x80",
+        "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xC2", "\xE2\x82",
+        "\xF0\x9F\x98"
+    };
+    static uint32_t const boundaries[] = {
+        0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF, 0x10000, 0x10FFFF
+    };
+
+    std::string s;
+    size_t parts = g.next(12);
+    bool allow_invalid = g.next(4) == 0;
+
+    for (size_t i = 0; i < parts; ++i) {
+        uint32_t kind = g.next(10);
+        if (kind < 6) {
+            size_t length = g.next(g.next(2) ? 20 : 200);
+            for (size_t j = 0; j < length; ++j) {
+                s += static_cast<char>(g.next(0x80));
+            }
+        } else if (kind < 8) {
+            uint32_t cp;
+            do {
+                cp = g.next(0x110000);
+            } while (cp >= 0xD800 && cp < 0xE000);
+            append_codepoint(s, cp);
+        } else if (kind < 9) {
+            append_codepoint(s, boundaries[g.next(sizeof(boundaries)/sizeof(boundaries[0]))]);
+        } else if (allow_invalid) {
+            s += invalid[g.next(sizeof(invalid)/sizeof(invalid[0]))];
+        }
+    }
+    return s;
+}
+
+/// Reference validation by the state machine one byte at a time
+bool reference_decode(std::string const & s, bool & complete) {
+    utf8_validator::validator v;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (!v.consume(static_cast<uint8_t>(s[i]))) {
+            complete = false;
+            return false;
+        }
+    }
+    complete = v.complete();
+    return true;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( known_sequences ) {
+    BOOST_CHECK( utf8_validator::validate("") );
+    BOOST_CHECK( utf8_validator::validate("Hello, world! This line is longer than one vector.") );
+    BOOST_CHECK( utf8_validator::validate("\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5") );
+    BOOST_CHECK( utf8_validator::validate("0123456789abcdef0123456789abcdef\xF0\x9F\x98\x80 tail") );
+    BOOST_CHECK( !utf8_validator::validate("0123456789abcdef0123456789abcdef\xC0\x80") );
+    BOOST_CHECK( !utf8_validator::validate("0123456789abcdef0123456789abcdef\xED\xA0\x80") );
+    BOOST_CHECK( !utf8_validator::validate("0123456789abcdef0123456789abcdef\xE2\x82") );
+}
+
+BOOST_AUTO_TEST_CASE( fragmented_codepoint ) {
+    // A codepoint split across fragments after a run of ASCII
+    std::string s = std::string(40,'a') + "\xF0\x9F\x98\x80" + std::string(40,'b');
+
+    for (size_t split = 0; split <= s.size(); ++split) {
+        utf8_validator::validator v;
+        BOOST_CHECK( v.decode(s.data(),s.data()+split) );
+        BOOST_CHECK( v.decode(s.data()+split,s.data()+s.size()) );
+        BOOST_CHECK( v.complete() );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( differential_fuzz ) {
+    generator g(0x5EED);
+
+    for (size_t n = 0; n < 20000; ++n) {
+        std::string s = random_text(g);
+
+        bool expected_complete;
+        bool expected = reference_decode(s, expected_complete);
+
+        // Whole string
+        utf8_validator::validator v;
+        bool result = v.decode(s.begin(),s.end());
+        BOOST_REQUIRE_MESSAGE( result == expected, "case " << n );
+        if (result) {
+            BOOST_REQUIRE_MESSAGE( v.complete() == expected_complete, "case " << n );
+        }
+        BOOST_REQUIRE( utf8_validator::validate(s) == (expected && expected_complete) );
+
+        // Random fragments
+        utf8_validator::validator f;
+        bool fragment_result = true;
+        size_t i = 0;
+        while (i < s.size() && fragment_result) {
+            size_t length = std::min<size_t>(g.next(70), s.size() - i);
+            fragment_result = f.decode(s.data()+i,s.data()+i+length);
+            i += length;
+        }
+        BOOST_REQUIRE_MESSAGE( fragment_result == expected, "fragments of case " << n );
+        if (fragment_result) {
+            BOOST_REQUIRE_MESSAGE( f.complete() == expected_complete, "fragments of case " << n );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( ascii_kernels ) {
+    cpu::kernel kernels[] = {cpu::scalar, cpu::sse2, cpu::avx2, cpu::neon};
+    generator g(42);
+
+    for (size_t k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k) {
+        utf8_validator::simd::ascii_function f =
+            utf8_validator::simd::get_ascii_function(kernels[k]);
+        if (!f) {
+            BOOST_CHECK( !cpu::is_supported(kernels[k]) );
+            continue;
+        }
+
+        // A non-ASCII byte at every position of every length and alignment
+        std::vector<uint8_t> buffer(200);
+        for (size_t offset = 0; offset < 4; ++offset) {
+            for (size_t length = 0; length + offset <= 150; ++length) {
+                for (size_t pos = 0; pos <= length; ++pos) {
+                    for (size_t i = 0; i < buffer.size(); ++i) {
+                        buffer[i] = static_cast<uint8_t>(g.next(0x80));
+                    }
+                    if (pos < length) {
+                        buffer[offset+pos] = static_cast<uint8_t>(0x80 + g.next(0x80));
+                    }
+
+                    uint8_t const * begin = &buffer[0] + offset;
+                    BOOST_REQUIRE_MESSAGE( f(begin,begin+length) == begin+pos,
+                        cpu::get_kernel_name(kernels[k]) << " length " << length
+                        << " position " << pos << " offset " << offset );
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_CPU_HPP
+#define WEBSOCKETPP_COMMON_CPU_HPP
+
+/**
+ * This header detects instruction sets of vectorized kernels at compile time
+ * and at runtime. Define _WEBSOCKETPP_NO_SIMD_ to use only portable kernels.
+ *
+ * _WEBSOCKETPP_NO_SIMD_MASKING_ is an alias of _WEBSOCKETPP_NO_SIMD_, kept
+ * for builds that turned off the vectorized masking kernels with it.
+ */
+
+#if defined(_WEBSOCKETPP_NO_SIMD_MASKING_) && !defined(_WEBSOCKETPP_NO_SIMD_)
+    #define _WEBSOCKETPP_NO_SIMD_
+#endif
+
+#ifndef _WEBSOCKETPP_NO_SIMD_
+    #if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define _WEBSOCKETPP_SSE2_
+        #include <emmintrin.h>
+    #endif
+
+    // AVX2 is compiled for functions marked with _WEBSOCKETPP_AVX2_TARGET_
+    // only, and they may be called only if cpu::is_supported(cpu::avx2)
+    #if defined(_WEBSOCKETPP_SSE2_) && (defined(_MSC_VER) || \
+        defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || \
+        (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+        #define _WEBSOCKETPP_AVX2_
+        #include <immintrin.h>
+        #ifdef _MSC_VER
+            #include <intrin.h>
+            #define _WEBSOCKETPP_AVX2_TARGET_
+        #else
+            #define _WEBSOCKETPP_AVX2_TARGET_ __attribute__((target("avx2")))
+        #endif
+    #endif
+
+    #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define _WEBSOCKETPP_NEON_
+        #include <arm_neon.h>
+    #endif
+#endif
+
+namespace websocketpp {
+namespace cpu {
+
+/// Instruction sets of vectorized kernels
+enum kernel {
+    scalar = 0,
+    sse2,
+    avx2,
+    neon
+};
+
+#ifdef _WEBSOCKETPP_AVX2_
+/// Check whether the CPU and the OS support AVX2
+inline bool supports_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // AVX and OSXSAVE, then YMM state enabled by the OS
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+        return false;
+    }
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+/// Check whether a kernel is compiled in and supported by the running CPU
+inline bool is_supported(kernel k) {
+    switch (k) {
+        case scalar:
+            return true;
+#ifdef _WEBSOCKETPP_SSE2_
+        case sse2:
+            return true;
+#endif
+#ifdef _WEBSOCKETPP_AVX2_
+        case avx2:
+            return supports_avx2();
+#endif
+#ifdef _WEBSOCKETPP_NEON_
+        case neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/// Get a human readable name of a kernel
+inline char const * get_kernel_name(kernel k) {
+    switch (k) {
+        case scalar:
+            return "scalar";
+        case sse2:
+            return "sse2";
+        case avx2:
+            return "avx2";
+        case neon:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
+
+/// Detect the fastest kernel supported by the running CPU
+inline kernel detect_kernel() {
+    if (is_supported(avx2)) {
+        return avx2;
+    } else if (is_supported(sse2)) {
+        return sse2;
+    } else if (is_supported(neon)) {
+        return neon;
+    }
+    return scalar;
+}
+
+} // namespace cpu
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_CPU_HPP
@@ -218,6 +218,39 @@ struct minimal_server {
     ///
     static const size_t connection_read_buffer_size = 16384;
 
+    /// Maximum size the read buffer of a connection may grow to
+    /**
+     * Connections start reading into a buffer of connection_read_buffer_size
+     * bytes. When consecutive reads fill it, the buffer is doubled up to this
+     * size so that bursts of frames are read and processed in fewer runs. A
+     * value no larger than connection_read_buffer_size disables growth.
+     *
+     * The default is 128KB
+     */
+    static const size_t connection_max_read_buffer_size = 131072;
+
+    /// Maximum size of a coalesced write
+    /**
+     * Queued frames are copied into contiguous buffers of up to this many
+     * bytes, so that a run of small frames is written as one buffer. Over TLS
+     * this sends them in one record rather than a record per frame header and
+     * payload. Larger frames are written from their own buffers. A value of 0
+     * disables coalescing.
+     *
+     * The default is 16KB
+     */
+    static const size_t write_batch_size = 16384;
+
+    /// Delay before writing queued frames (in ms)
+    /**
+     * Frames queued while no write is outstanding are held for up to this
+     * long, or until write_batch_size bytes are queued, so that frames sent
+     * in quick succession go out in one write. Close frames are not delayed.
+     *
+     * The default is 0, which writes frames as soon as they are queued
+     */
+    static const long write_flush_delay = 0;
+
     /// Drop connections immediately on protocol error.
     /**
      * Drop connections on protocol error rather than sending a close frame.
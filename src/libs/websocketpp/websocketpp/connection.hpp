@@ -313,11 +313,20 @@ public:
       , m_close_handshake_timeout_dur(config::timeout_close_handshake)
       , m_pong_timeout_dur(config::timeout_pong)
       , m_max_message_size(config::max_message_size)
+      , m_zero_copy(false)
+      , m_write_batch_size(config::write_batch_size)
+      , m_write_flush_delay(config::write_flush_delay)
+      , m_max_read_buffer_size(config::connection_max_read_buffer_size)
       , m_state(session::state::connecting)
       , m_internal_state(session::internal_state::USER_INIT)
+      , m_buf(config::connection_read_buffer_size)
+      , m_buf_cursor(0)
+      , m_buf_offset(0)
+      , m_full_reads(0)
       , m_msg_manager(new con_msg_manager_type())
       , m_send_buffer_size(0)
       , m_write_flag(false)
+      , m_write_flush_due(false)
       , m_read_flag(true)
       , m_is_server(p_is_server)
       , m_alog(alog)
@@ -578,6 +587,125 @@ public:
             m_processor->set_max_message_size(new_value);
         }
     }
+
+    /// Get whether payloads are handled without copying
+    /**
+     * @see set_zero_copy
+     *
+     * @return Whether or not payloads are handled without copying
+     */
+    bool get_zero_copy() const {
+        return m_zero_copy;
+    }
+
+    /// Set whether payloads are handled without copying
+    /**
+     * When enabled, messages sent with the payload overloads of send are
+     * masked and framed in the buffer that holds their payload, and incoming
+     * single frame messages that are unmasked, uncompressed and complete in
+     * the read buffer are passed to the message handler as a view of that
+     * buffer.
+     *
+     * Use get_payload_data and get_payload_size to read such a message
+     * without copying it. A message that is still referenced when the
+     * message handler returns is detached, so it is safe to keep it, but a
+     * message handed to another thread must be detached with detach_payload
+     * inside the handler.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @param value Whether or not to handle payloads without copying
+     */
+    void set_zero_copy(bool value) {
+        m_zero_copy = value;
+        if (m_processor) {
+            m_processor->set_zero_copy(value);
+        }
+    }
+
+    /// Get maximum size of a coalesced write
+    /**
+     * @see set_write_batch_size
+     *
+     * @return The maximum size of a coalesced write in bytes
+     */
+    size_t get_write_batch_size() const {
+        return m_write_batch_size;
+    }
+
+    /// Set maximum size of a coalesced write
+    /**
+     * Queued frames are copied into contiguous buffers of up to this many
+     * bytes so that runs of small frames are written as one buffer. A value
+     * of 0 disables coalescing.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @param new_value The maximum size of a coalesced write in bytes
+     */
+    void set_write_batch_size(size_t new_value) {
+        m_write_batch_size = new_value;
+    }
+
+    /// Get delay before writing queued frames
+    /**
+     * @see set_write_flush_delay
+     *
+     * @return The write flush delay in ms
+     */
+    long get_write_flush_delay() const {
+        return m_write_flush_delay;
+    }
+
+    /// Set delay before writing queued frames
+    /**
+     * Frames queued while no write is outstanding are held for up to this
+     * long, or until write_batch_size bytes are queued, so that frames sent
+     * in quick succession go out in one write. Close frames are not delayed.
+     * A value of 0 writes frames as soon as they are queued.
+     *
+     * The default is set by the endpoint that creates the connection. To be
+     * effective, the transport you are using must support timers.
+     *
+     * @param dur The write flush delay in ms
+     */
+    void set_write_flush_delay(long dur) {
+        m_write_flush_delay = dur;
+    }
+
+    /// Get maximum size of the read buffer
+    /**
+     * @see set_max_read_buffer_size
+     *
+     * @return The maximum size of the read buffer in bytes
+     */
+    size_t get_max_read_buffer_size() const {
+        return m_max_read_buffer_size;
+    }
+
+    /// Set maximum size of the read buffer
+    /**
+     * The read buffer starts at config::connection_read_buffer_size bytes and
+     * is doubled, up to this size, when consecutive reads fill it. A value no
+     * larger than the current buffer size stops further growth.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @param new_value The maximum size of the read buffer in bytes
+     */
+    void set_max_read_buffer_size(size_t new_value) {
+        m_max_read_buffer_size = new_value;
+    }
+
+    /// Get the current size of the read buffer
+    /**
+     * @see set_max_read_buffer_size
+     *
+     * @return The current size of the read buffer in bytes
+     */
+    size_t get_read_buffer_size() const {
+        return m_buf.size();
+    }
     
     /// Get maximum HTTP message body size
     /**
@@ -1280,13 +1408,34 @@ public:
         return m_msg_manager->get_message(op, size);
     }
 
+    /// Get the message manager of this connection
+    /**
+     * The message manager creates the message buffers of this connection. A
+     * pooling manager can be queried for its allocation counters.
+     *
+     * @return A pointer to the connection message manager
+     */
+    con_msg_manager_ptr get_message_manager() const {
+        return m_msg_manager;
+    }
+
     ////////////////////////////////////////////////////////////////////////
     // The remaining public member functions are for internal/policy use  //
     // only. Do not call from application code unless you understand what //
     // you are doing.                                                     //
     ////////////////////////////////////////////////////////////////////////
 
-    
+    /// Set the message manager of this connection
+    /**
+     * Called by the endpoint with a manager from its endpoint message
+     * manager. Must be called before the connection is started.
+     *
+     * @param manager The connection message manager to use
+     */
+    void set_message_manager(con_msg_manager_ptr manager) {
+        m_msg_manager = manager;
+    }
+
 
     void read_handshake(size_t num_bytes);
 
@@ -1336,6 +1485,24 @@ public:
      * non-zero otherwise.
      */
     void handle_write_frame(lib::error_code const & ec);
+
+    /// Decide whether to hold queued frames for the write flush delay
+    /**
+     * Starts the write flush timer if frames should be held. Must be called
+     * while holding m_write_lock.
+     *
+     * @return true if write_frame should not write yet
+     */
+    bool delay_write();
+
+    /// Write frames held for the write flush delay
+    void handle_write_flush_timer(lib::error_code const & ec);
+
+    /// Double the read buffer up to the maximum read buffer size
+    /**
+     * Must only be called between reads, when no message refers to m_buf.
+     */
+    void grow_read_buffer();
 // protected:
     // This set of methods would really like to be protected, but doing so 
     // requires that the endpoint be able to friend the connection. This is 
@@ -1430,6 +1597,19 @@ private:
      */
     processor_ptr get_processor(int version) const;
 
+    /// Prepare a data message and add it to the write queue
+    /**
+     * Implements send. If in_place is set an unprepared message is masked and
+     * framed in its own payload buffer rather than copied into a new
+     * outgoing message. This is only safe for messages that the connection
+     * created itself.
+     *
+     * @param msg The message to send
+     * @param in_place Whether or not to prepare msg in its own buffer
+     * @return An error code
+     */
+    lib::error_code send_message(message_ptr msg, bool in_place);
+
     /// Add a message to the write queue
     /**
      * Adds a message to the write queue and updates any associated shared state
@@ -1516,6 +1696,10 @@ private:
     long                    m_close_handshake_timeout_dur;
     long                    m_pong_timeout_dur;
     size_t                  m_max_message_size;
+    bool                    m_zero_copy;
+    size_t                  m_write_batch_size;
+    long                    m_write_flush_delay;
+    size_t                  m_max_read_buffer_size;
 
     /// External connection state
     /**
@@ -1539,8 +1723,18 @@ private:
     mutex_type              m_write_lock;
 
     // connection resources
-    char                    m_buf[config::connection_read_buffer_size];
+    /// Buffer of transport reads
+    /**
+     * Grows from config::connection_read_buffer_size up to
+     * m_max_read_buffer_size while reads keep filling it. Frame data that
+     * arrived with the handshake starts at m_buf_offset and ends at
+     * m_buf_cursor.
+     */
+    std::vector<char>       m_buf;
     size_t                  m_buf_cursor;
+    size_t                  m_buf_offset;
+    /// Number of consecutive reads that filled m_buf
+    size_t                  m_full_reads;
     termination_handler     m_termination_handler;
     con_msg_manager_ptr     m_msg_manager;
     timer_ptr               m_handshake_timer;
@@ -1583,12 +1777,30 @@ private:
     /// from going out of scope before the write is complete.
     std::vector<message_ptr> m_current_msgs;
 
+    /// Contiguous copy of the coalesced frames of the current write
+    /**
+     * Lock m_write_lock
+     */
+    std::string m_write_batch;
+
     /// True if there is currently an outstanding transport write
     /**
      * Lock m_write_lock
      */
     bool m_write_flag;
 
+    /// Timer of frames held for the write flush delay
+    /**
+     * Lock m_write_lock
+     */
+    timer_ptr m_write_flush_timer;
+
+    /// True if the next write_frame should write without delay
+    /**
+     * Lock m_write_lock
+     */
+    bool m_write_flush_due;
+
     /// True if this connection is presently reading new data
     bool m_read_flag;
 
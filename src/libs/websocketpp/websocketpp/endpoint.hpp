@@ -82,6 +82,9 @@ public:
     /// Type of RNG
     typedef typename config::rng_type rng_type;
 
+    /// Type of the endpoint message manager
+    typedef typename config::endpoint_msg_manager_type endpoint_msg_manager_type;
+
     // TODO: organize these
     typedef typename connection_type::termination_handler termination_handler;
 
@@ -97,6 +100,10 @@ public:
       , m_pong_timeout_dur(config::timeout_pong)
       , m_max_message_size(config::max_message_size)
       , m_max_http_body_size(config::max_http_body_size)
+      , m_zero_copy(false)
+      , m_write_batch_size(config::write_batch_size)
+      , m_write_flush_delay(config::write_flush_delay)
+      , m_max_read_buffer_size(config::connection_max_read_buffer_size)
       , m_is_server(p_is_server)
     {
         m_alog.set_channels(config::alog_level);
@@ -144,7 +151,12 @@ public:
          , m_pong_timeout_dur(o.m_pong_timeout_dur)
          , m_max_message_size(o.m_max_message_size)
          , m_max_http_body_size(o.m_max_http_body_size)
+         , m_zero_copy(o.m_zero_copy)
+         , m_write_batch_size(o.m_write_batch_size)
+         , m_write_flush_delay(o.m_write_flush_delay)
+         , m_max_read_buffer_size(o.m_max_read_buffer_size)
 
+         , m_msg_manager(std::move(o.m_msg_manager))
          , m_rng(std::move(o.m_rng))
          , m_is_server(o.m_is_server)         
         {}
@@ -467,6 +479,102 @@ public:
         m_max_http_body_size = new_value;
     }
 
+    /// Get whether new connections handle payloads without copying
+    /**
+     * @see set_zero_copy
+     *
+     * @return Whether or not new connections handle payloads without copying
+     */
+    bool get_zero_copy() const {
+        return m_zero_copy;
+    }
+
+    /// Set whether new connections handle payloads without copying
+    /**
+     * Sets the zero copy mode of connections created by this endpoint. See
+     * connection::set_zero_copy for the requirements this places on message
+     * handlers. The default is false.
+     *
+     * @param value Whether or not new connections handle payloads without
+     * copying
+     */
+    void set_zero_copy(bool value) {
+        m_zero_copy = value;
+    }
+
+    /// Get default maximum size of a coalesced write
+    /**
+     * @see set_write_batch_size
+     *
+     * @return The maximum size of a coalesced write in bytes
+     */
+    size_t get_write_batch_size() const {
+        return m_write_batch_size;
+    }
+
+    /// Set default maximum size of a coalesced write
+    /**
+     * Sets the maximum size of a coalesced write of new connections created
+     * by this endpoint. See connection::set_write_batch_size.
+     *
+     * The default is set by the write_batch_size value from the template
+     * config
+     *
+     * @param new_value The maximum size of a coalesced write in bytes
+     */
+    void set_write_batch_size(size_t new_value) {
+        m_write_batch_size = new_value;
+    }
+
+    /// Get default delay before writing queued frames
+    /**
+     * @see set_write_flush_delay
+     *
+     * @return The write flush delay in ms
+     */
+    long get_write_flush_delay() const {
+        return m_write_flush_delay;
+    }
+
+    /// Set default delay before writing queued frames
+    /**
+     * Sets the write flush delay of new connections created by this
+     * endpoint. See connection::set_write_flush_delay.
+     *
+     * The default is set by the write_flush_delay value from the template
+     * config
+     *
+     * @param dur The write flush delay in ms
+     */
+    void set_write_flush_delay(long dur) {
+        scoped_lock_type guard(m_mutex);
+        m_write_flush_delay = dur;
+    }
+
+    /// Get default maximum size of the read buffer
+    /**
+     * @see set_max_read_buffer_size
+     *
+     * @return The maximum size of the read buffer in bytes
+     */
+    size_t get_max_read_buffer_size() const {
+        return m_max_read_buffer_size;
+    }
+
+    /// Set default maximum size of the read buffer
+    /**
+     * Sets the size up to which the read buffers of new connections created
+     * by this endpoint may grow. See connection::set_max_read_buffer_size.
+     *
+     * The default is set by the connection_max_read_buffer_size value from
+     * the template config
+     *
+     * @param new_value The maximum size of the read buffer in bytes
+     */
+    void set_max_read_buffer_size(size_t new_value) {
+        m_max_read_buffer_size = new_value;
+    }
+
     /*************************************/
     /* Connection pass through functions */
     /*************************************/
@@ -683,6 +791,12 @@ private:
     long                        m_pong_timeout_dur;
     size_t                      m_max_message_size;
     size_t                      m_max_http_body_size;
+    bool                        m_zero_copy;
+    size_t                      m_write_batch_size;
+    long                        m_write_flush_delay;
+    size_t                      m_max_read_buffer_size;
+
+    endpoint_msg_manager_type   m_msg_manager;
 
     rng_type m_rng;
 
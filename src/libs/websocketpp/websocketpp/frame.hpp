@@ -29,8 +29,10 @@
 #define WEBSOCKETPP_FRAME_HPP
 
 #include <algorithm>
+#include <cstring>
 #include <string>
 
+#include <websocketpp/common/cpu.hpp>
 #include <websocketpp/common/system_error.hpp>
 #include <websocketpp/common/network.hpp>
 
@@ -610,6 +612,9 @@ inline size_t prepare_masking_key(const masking_key_type& key) {
  * to zero and less than sizeof(size_t).
  */
 inline size_t circshift_prepared_key(size_t prepared_key, size_t offset) {
+    if (offset == 0) {
+        return prepared_key;
+    }
     if (lib::net::is_little_endian()) {
         size_t temp = prepared_key << (sizeof(size_t)-offset)*8;
         return (prepared_key >> offset*8) | temp;
@@ -619,6 +624,198 @@ inline size_t circshift_prepared_key(size_t prepared_key, size_t offset) {
     }
 }
 
+/// Buffer masking kernels
+/**
+ * Each kernel XORs length bytes of input with a four byte key, starting with
+ * key[0] at input[0], and writes the result to output. Input and output may be
+ * the same buffer, but must not otherwise overlap. There are no alignment
+ * requirements.
+ *
+ * mask() dispatches to the fastest kernel supported by the running CPU. The
+ * kernels are exposed individually for testing and benchmarking.
+ */
+namespace simd {
+
+typedef void (*mask_function)(uint8_t const * input, uint8_t * output,
+    size_t length, uint8_t const * key);
+
+/// Portable kernel masking a machine word at a time
+inline void mask_scalar(uint8_t const * input, uint8_t * output, size_t length,
+    uint8_t const * key)
+{
+    size_t word_key;
+    uint8_t * word_key_bytes = reinterpret_cast<uint8_t *>(&word_key);
+    for (size_t i = 0; i < sizeof(size_t); ++i) {
+        word_key_bytes[i] = key[i % 4];
+    }
+
+    size_t i = 0;
+    for (; i + sizeof(size_t) <= length; i += sizeof(size_t)) {
+        size_t word;
+        std::memcpy(&word, input + i, sizeof(size_t));
+        word ^= word_key;
+        std::memcpy(output + i, &word, sizeof(size_t));
+    }
+
+    for (; i < length; ++i) {
+        output[i] = input[i] ^ key[i % 4];
+    }
+}
+
+#ifdef _WEBSOCKETPP_SSE2_
+/// SSE2 kernel masking 16 bytes at a time
+inline void mask_sse2(uint8_t const * input, uint8_t * output, size_t length,
+    uint8_t const * key)
+{
+    int32_t key32;
+    std::memcpy(&key32, key, 4);
+    __m128i const vkey = _mm_set1_epi32(key32);
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i const * in = reinterpret_cast<__m128i const *>(input + i);
+        __m128i * out = reinterpret_cast<__m128i *>(output + i);
+        __m128i a = _mm_loadu_si128(in);
+        __m128i b = _mm_loadu_si128(in + 1);
+        __m128i c = _mm_loadu_si128(in + 2);
+        __m128i d = _mm_loadu_si128(in + 3);
+        _mm_storeu_si128(out, _mm_xor_si128(a, vkey));
+        _mm_storeu_si128(out + 1, _mm_xor_si128(b, vkey));
+        _mm_storeu_si128(out + 2, _mm_xor_si128(c, vkey));
+        _mm_storeu_si128(out + 3, _mm_xor_si128(d, vkey));
+    }
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i const * in = reinterpret_cast<__m128i const *>(input + i);
+        __m128i * out = reinterpret_cast<__m128i *>(output + i);
+        _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(in), vkey));
+    }
+
+    mask_scalar(input + i, output + i, length - i, key);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_AVX2_
+/// AVX2 kernel masking 32 bytes at a time
+/**
+ * Must be called only if the CPU supports AVX2.
+ */
+_WEBSOCKETPP_AVX2_TARGET_
+inline void mask_avx2(uint8_t const * input, uint8_t * output, size_t length,
+    uint8_t const * key)
+{
+    int32_t key32;
+    std::memcpy(&key32, key, 4);
+    __m256i const vkey = _mm256_set1_epi32(key32);
+
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i const * in = reinterpret_cast<__m256i const *>(input + i);
+        __m256i * out = reinterpret_cast<__m256i *>(output + i);
+        __m256i a = _mm256_loadu_si256(in);
+        __m256i b = _mm256_loadu_si256(in + 1);
+        __m256i c = _mm256_loadu_si256(in + 2);
+        __m256i d = _mm256_loadu_si256(in + 3);
+        _mm256_storeu_si256(out, _mm256_xor_si256(a, vkey));
+        _mm256_storeu_si256(out + 1, _mm256_xor_si256(b, vkey));
+        _mm256_storeu_si256(out + 2, _mm256_xor_si256(c, vkey));
+        _mm256_storeu_si256(out + 3, _mm256_xor_si256(d, vkey));
+    }
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i const * in = reinterpret_cast<__m256i const *>(input + i);
+        __m256i * out = reinterpret_cast<__m256i *>(output + i);
+        _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(in), vkey));
+    }
+
+    // The tail is masked by SSE2 with the same key phase
+    mask_sse2(input + i, output + i, length - i, key);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_NEON_
+/// NEON kernel masking 16 bytes at a time
+inline void mask_neon(uint8_t const * input, uint8_t * output, size_t length,
+    uint8_t const * key)
+{
+    uint8_t key_bytes[16];
+    for (size_t i = 0; i < 16; ++i) {
+        key_bytes[i] = key[i % 4];
+    }
+    uint8x16_t const vkey = vld1q_u8(key_bytes);
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        uint8x16_t a = vld1q_u8(input + i);
+        uint8x16_t b = vld1q_u8(input + i + 16);
+        uint8x16_t c = vld1q_u8(input + i + 32);
+        uint8x16_t d = vld1q_u8(input + i + 48);
+        vst1q_u8(output + i, veorq_u8(a, vkey));
+        vst1q_u8(output + i + 16, veorq_u8(b, vkey));
+        vst1q_u8(output + i + 32, veorq_u8(c, vkey));
+        vst1q_u8(output + i + 48, veorq_u8(d, vkey));
+    }
+
+    for (; i + 16 <= length; i += 16) {
+        vst1q_u8(output + i, veorq_u8(vld1q_u8(input + i), vkey));
+    }
+
+    mask_scalar(input + i, output + i, length - i, key);
+}
+#endif
+
+/// Get the function of a kernel, or null if it is not supported
+inline mask_function get_mask_function(cpu::kernel k) {
+    if (!cpu::is_supported(k)) {
+        return NULL;
+    }
+
+    switch (k) {
+#ifdef _WEBSOCKETPP_SSE2_
+        case cpu::sse2:
+            return &mask_sse2;
+#endif
+#ifdef _WEBSOCKETPP_AVX2_
+        case cpu::avx2:
+            return &mask_avx2;
+#endif
+#ifdef _WEBSOCKETPP_NEON_
+        case cpu::neon:
+            return &mask_neon;
+#endif
+        default:
+            return &mask_scalar;
+    }
+}
+
+/// Mask with the fastest kernel supported by the running CPU
+/**
+ * The kernel is detected once per process. Inputs shorter than a vector are
+ * masked by the scalar kernel directly.
+ *
+ * @param input buffer to mask or unmask
+ *
+ * @param output buffer to store the output. May be the same as input.
+ *
+ * @param length length of input and output
+ *
+ * @param key four bytes of the masking key, starting at the first byte of
+ * input
+ */
+inline void mask(uint8_t const * input, uint8_t * output, size_t length,
+    uint8_t const * key)
+{
+    if (length < 16) {
+        mask_scalar(input, output, length, key);
+        return;
+    }
+
+    static mask_function const function = get_mask_function(cpu::detect_kernel());
+    function(input, output, length, key);
+}
+
+} // namespace simd
+
 /// Byte by byte mask/unmask
 /**
  * Iterator based byte by byte masking and unmasking for WebSocket payloads.
@@ -682,8 +879,8 @@ void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
  * word_mask_circ but works with exact sized buffers.
  *
  * Buffer based word by word masking and unmasking for WebSocket payloads.
- * Masking is done in word by word chunks with the remainder not divisible by
- * the word size done byte by byte.
+ * Masking is done by the fastest kernel of simd::mask with the remainder not
+ * divisible by the vector size done byte by byte.
  *
  * input and output must both be at least length bytes. Exactly length bytes
  * will be written.
@@ -699,18 +896,7 @@ void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
 inline void word_mask_exact(uint8_t* input, uint8_t* output, size_t length,
     const masking_key_type& key)
 {
-    size_t prepared_key = prepare_masking_key(key);
-    size_t n = length/sizeof(size_t);
-    size_t* input_word = reinterpret_cast<size_t*>(input);
-    size_t* output_word = reinterpret_cast<size_t*>(output);
-
-    for (size_t i = 0; i < n; i++) {
-        output_word[i] = input_word[i] ^ prepared_key;
-    }
-
-    for (size_t i = n*sizeof(size_t); i < length; i++) {
-        output[i] = input[i] ^ key.c[i%4];
-    }
+    simd::mask(input, output, length, key.c);
 }
 
 /// Exact word aligned mask/unmask (in place)
@@ -807,10 +993,9 @@ inline size_t word_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
 /**
  * Performs a circular mask/unmask in byte sized chunks using pre-prepared keys
  * that store state between calls. Best for providing streaming masking or
- * unmasking of small chunks at a time of a larger message. Requires that the
- * underlying allocated size of the data buffer be a multiple of the word size.
- * Data in the buffer after `length` will be overwritten only with the same
- * values that were originally present.
+ * unmasking of small chunks at a time of a larger message. Masking is done by
+ * the fastest kernel of simd::mask, so chunks of any size and alignment are
+ * masked at vector speed.
  *
  * word_mask returns a copy of prepared_key circularly shifted based on the
  * length value. The returned value may be fed back into byte_mask when more
@@ -830,9 +1015,7 @@ inline size_t byte_mask_circ(uint8_t * input, uint8_t * output, size_t length,
     uint32_converter key;
     key.i = prepared_key;
 
-    for (size_t i = 0; i < length; ++i) {
-        output[i] = input[i] ^ key.c[i % 4];
-    }
+    simd::mask(input, output, length, key.c);
 
     return circshift_prepared_key(prepared_key,length % 4);
 }
@@ -87,7 +87,7 @@ lib::error_code connection<config>::send(std::string const & payload,
     msg->append_payload(payload);
     msg->set_compressed(true);
 
-    return send(msg);
+    return send_message(msg,m_zero_copy);
 }
 
 template <typename config>
@@ -97,11 +97,18 @@ lib::error_code connection<config>::send(void const * payload, size_t len,
     message_ptr msg = m_msg_manager->get_message(op,len);
     msg->append_payload(payload,len);
 
-    return send(msg);
+    return send_message(msg,m_zero_copy);
 }
 
 template <typename config>
 lib::error_code connection<config>::send(typename config::message_type::ptr msg)
+{
+    return send_message(msg,false);
+}
+
+template <typename config>
+lib::error_code connection<config>::send_message(message_ptr msg,
+    bool in_place)
 {
     if (m_alog.static_test(log::alevel::devel)) {
         m_alog.write(log::alevel::devel,"connection send");
@@ -124,7 +131,9 @@ lib::error_code connection<config>::send(typename config::message_type::ptr msg)
         write_push(outgoing_msg);
         needs_writing = !m_write_flag && !m_send_queue.empty();
     } else {
-        outgoing_msg = m_msg_manager->get_message();
+        // The payload buffer of msg is only reused when this connection owns
+        // msg, user messages may be sent to more than one connection.
+        outgoing_msg = in_place ? msg : m_msg_manager->get_message();
 
         if (!outgoing_msg) {
             return error::make_error_code(error::no_outgoing_buffers);
@@ -787,8 +796,8 @@ void connection<config>::read_handshake(size_t num_bytes) {
 
     transport_con_type::async_read_at_least(
         num_bytes,
-        m_buf,
-        config::connection_read_buffer_size,
+        &m_buf[0],
+        m_buf.size(),
         lib::bind(
             &type::handle_read_handshake,
             type::get_shared(),
@@ -841,7 +850,7 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
     }
 
     // Boundaries checking. TODO: How much of this should be done?
-    if (bytes_transferred > config::connection_read_buffer_size) {
+    if (bytes_transferred > m_buf.size()) {
         m_elog.write(log::elevel::fatal,"Fatal boundaries checking error.");
         this->terminate(make_error_code(error::general));
         return;
@@ -849,7 +858,7 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
 
     size_t bytes_processed = 0;
     try {
-        bytes_processed = m_request.consume(m_buf,bytes_transferred);
+        bytes_processed = m_request.consume(&m_buf[0],bytes_transferred);
     } catch (http::exception &e) {
         // All HTTP exceptions will result in this request failing and an error
         // response being returned. No more bytes will be read in this con.
@@ -886,7 +895,7 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
             if (bytes_transferred-bytes_processed >= 8) {
                 m_request.replace_header(
                     "Sec-WebSocket-Key3",
-                    std::string(m_buf+bytes_processed,m_buf+bytes_processed+8)
+                    std::string(&m_buf[bytes_processed],&m_buf[bytes_processed]+8)
                 );
                 bytes_processed += 8;
             } else {
@@ -906,11 +915,11 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
             }
         }
 
-        // The remaining bytes in m_buf are frame data. Copy them to the
-        // beginning of the buffer and note the length. They will be read after
-        // the handshake completes and before more bytes are read.
-        std::copy(m_buf+bytes_processed,m_buf+bytes_transferred,m_buf);
-        m_buf_cursor = bytes_transferred-bytes_processed;
+        // The remaining bytes in m_buf are frame data. Note where they start
+        // and end. They will be read in place after the handshake completes
+        // and before more bytes are read.
+        m_buf_offset = bytes_processed;
+        m_buf_cursor = bytes_transferred;
 
 
         m_internal_state = istate::PROCESS_HTTP_REQUEST;
@@ -928,8 +937,8 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
         // read at least 1 more byte
         transport_con_type::async_read_at_least(
             1,
-            m_buf,
-            config::connection_read_buffer_size,
+            &m_buf[0],
+            m_buf.size(),
             lib::bind(
                 &type::handle_read_handshake,
                 type::get_shared(),
@@ -1018,13 +1027,15 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
     }
 
     // Boundaries checking. TODO: How much of this should be done?
-    /*if (bytes_transferred > config::connection_read_buffer_size) {
+    /*if (bytes_transferred > m_buf.size()) {
         m_elog.write(log::elevel::fatal,"Fatal boundaries checking error");
         this->terminate(make_error_code(error::general));
         return;
     }*/
 
-    size_t p = 0;
+    // Frame data read with the handshake starts after it
+    size_t p = m_buf_offset;
+    m_buf_offset = 0;
 
     if (m_alog.static_test(log::alevel::devel)) {
         std::stringstream s;
@@ -1043,12 +1054,12 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
 
         if (m_alog.static_test(log::alevel::devel)) {
             std::stringstream s;
-            s << "Processing Bytes: " << utility::to_hex(reinterpret_cast<uint8_t*>(m_buf)+p,bytes_transferred-p);
+            s << "Processing Bytes: " << utility::to_hex(reinterpret_cast<uint8_t*>(&m_buf[0])+p,bytes_transferred-p);
             m_alog.write(log::alevel::devel,s.str());
         }
 
         p += m_processor->consume(
-            reinterpret_cast<uint8_t*>(m_buf)+p,
+            reinterpret_cast<uint8_t*>(&m_buf[0])+p,
             bytes_transferred-p,
             consume_ec
         );
@@ -1099,15 +1110,53 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
                 } else if (m_message_handler) {
                     m_message_handler(m_connection_hdl, msg);
                 }
+
+                // A zero copy payload refers to m_buf, which the next read
+                // overwrites or grow_read_buffer frees. Copy it if the handler
+                // kept the message.
+                if (msg->has_payload_view() && msg.use_count() > 1) {
+                    msg->detach_payload();
+                }
             } else {
                 process_control_frame(msg);
             }
         }
     }
 
+    // All frames in the buffer have been dispatched, so nothing refers to it
+    // any more. Reads that keep filling it indicate a burst that a larger
+    // buffer would take in fewer runs through this handler.
+    if (bytes_transferred == m_buf.size()) {
+        if (++m_full_reads >= 2) {
+            grow_read_buffer();
+        }
+    } else {
+        m_full_reads = 0;
+    }
+
     read_frame();
 }
 
+template <typename config>
+void connection<config>::grow_read_buffer() {
+    m_full_reads = 0;
+
+    if (m_buf.size() >= m_max_read_buffer_size) {
+        return;
+    }
+
+    size_t size = (std::min)(m_buf.size() * 2, m_max_read_buffer_size);
+
+    if (m_alog.static_test(log::alevel::devel)) {
+        std::stringstream s;
+        s << "growing read buffer from " << m_buf.size() << " to " << size
+          << " bytes";
+        m_alog.write(log::alevel::devel,s.str());
+    }
+
+    std::vector<char>(size).swap(m_buf);
+}
+
 /// Issue a new transport read unless reading is paused.
 template <typename config>
 void connection<config>::read_frame() {
@@ -1115,17 +1164,20 @@ void connection<config>::read_frame() {
         return;
     }
     
+    // Wait for the bytes the processor needs to make progress, such as the
+    // rest of a frame header or payload, rather than running
+    // handle_read_frame on every partial read. Responsiveness is unchanged as
+    // nothing can be dispatched before those bytes arrive.
+    size_t num_bytes = 1;
+    if (m_processor) {
+        num_bytes = (std::max)(m_processor->get_bytes_needed(), size_t(1));
+        num_bytes = (std::min)(num_bytes, m_buf.size());
+    }
+
     transport_con_type::async_read_at_least(
-        // std::min wont work with undefined static const values.
-        // TODO: is there a more elegant way to do this?
-        // Need to determine if requesting 1 byte or the exact number of bytes
-        // is better here. 1 byte lets us be a bit more responsive at a
-        // potential expense of additional runs through handle_read_frame
-        /*(m_processor->get_bytes_needed() > config::connection_read_buffer_size ?
-         config::connection_read_buffer_size : m_processor->get_bytes_needed())*/
-        1,
-        m_buf,
-        config::connection_read_buffer_size,
+        num_bytes,
+        &m_buf[0],
+        m_buf.size(),
         m_handle_read_frame
     );
 }
@@ -1528,8 +1580,8 @@ void connection<config>::handle_send_http_request(lib::error_code const & ec) {
 
     transport_con_type::async_read_at_least(
         1,
-        m_buf,
-        config::connection_read_buffer_size,
+        &m_buf[0],
+        m_buf.size(),
         lib::bind(
             &type::handle_read_http_response,
             type::get_shared(),
@@ -1582,7 +1634,7 @@ void connection<config>::handle_read_http_response(lib::error_code const & ec,
     size_t bytes_processed = 0;
     // TODO: refactor this to use error codes rather than exceptions
     try {
-        bytes_processed = m_response.consume(m_buf,bytes_transferred);
+        bytes_processed = m_response.consume(&m_buf[0],bytes_transferred);
     } catch (http::exception & e) {
         m_elog.write(log::elevel::rerror,
             std::string("error in handle_read_http_response: ")+e.what());
@@ -1637,18 +1689,18 @@ void connection<config>::handle_read_http_response(lib::error_code const & ec,
             m_open_handler(m_connection_hdl);
         }
 
-        // The remaining bytes in m_buf are frame data. Copy them to the
-        // beginning of the buffer and note the length. They will be read after
-        // the handshake completes and before more bytes are read.
-        std::copy(m_buf+bytes_processed,m_buf+bytes_transferred,m_buf);
-        m_buf_cursor = bytes_transferred-bytes_processed;
+        // The remaining bytes in m_buf are frame data. Note where they start
+        // and end. They will be read in place after the handshake completes
+        // and before more bytes are read.
+        m_buf_offset = bytes_processed;
+        m_buf_cursor = bytes_transferred;
 
         this->handle_read_frame(lib::error_code(), m_buf_cursor);
     } else {
         transport_con_type::async_read_at_least(
             1,
-            m_buf,
-            config::connection_read_buffer_size,
+            &m_buf[0],
+            m_buf.size(),
             lib::bind(
                 &type::handle_read_http_response,
                 type::get_shared(),
@@ -1703,6 +1755,15 @@ void connection<config>::terminate(lib::error_code const & ec) {
         m_handshake_timer.reset();
     }
 
+    // Cancel write flush timer
+    {
+        scoped_lock_type lock(m_write_lock);
+        if (m_write_flush_timer) {
+            m_write_flush_timer->cancel();
+            m_write_flush_timer.reset();
+        }
+    }
+
     terminate_status tstat = unknown;
     if (ec) {
         m_ec = ec;
@@ -1801,6 +1862,12 @@ void connection<config>::write_frame() {
             return;
         }
 
+        // Hold the queued frames for the write flush delay. The flush timer
+        // calls write_frame again.
+        if (this->delay_write()) {
+            return;
+        }
+
         // pull off all the messages that are ready to write.
         // stop if we get a message marked terminal
         message_ptr next_message = write_pop();
@@ -1824,13 +1891,47 @@ void connection<config>::write_frame() {
         }
     }
 
+    // Frames up to m_write_batch_size bytes are copied into runs of
+    // m_write_batch of at most that size, each written as one buffer. The
+    // batch is reserved up front because the buffers point into it.
     typename std::vector<message_ptr>::iterator it;
+    size_t batch_bytes = 0;
+    for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
+        size_t bytes = (*it)->get_header().size() + (*it)->get_payload().size();
+        if (bytes <= m_write_batch_size) {
+            batch_bytes += bytes;
+        }
+    }
+    m_write_batch.reserve(batch_bytes);
+
+    size_t run = 0;
     for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
         std::string const & header = (*it)->get_header();
         std::string const & payload = (*it)->get_payload();
+        size_t bytes = header.size() + payload.size();
+
+        if (bytes > m_write_batch_size ||
+            m_write_batch.size() - run + bytes > m_write_batch_size)
+        {
+            if (m_write_batch.size() > run) {
+                m_send_buffer.push_back(transport::buffer(
+                    m_write_batch.data() + run, m_write_batch.size() - run));
+                run = m_write_batch.size();
+            }
+        }
+
+        if (bytes <= m_write_batch_size) {
+            m_write_batch.append(header);
+            m_write_batch.append(payload);
+        } else {
+            m_send_buffer.push_back(transport::buffer(header.c_str(),header.size()));
+            m_send_buffer.push_back(transport::buffer(payload.c_str(),payload.size()));
+        }
+    }
 
-        m_send_buffer.push_back(transport::buffer(header.c_str(),header.size()));
-        m_send_buffer.push_back(transport::buffer(payload.c_str(),payload.size()));   
+    if (m_write_batch.size() > run) {
+        m_send_buffer.push_back(transport::buffer(
+            m_write_batch.data() + run, m_write_batch.size() - run));
     }
 
     // Print detailed send stats if those log levels are enabled
@@ -1839,7 +1940,8 @@ void connection<config>::write_frame() {
         std::stringstream general,header,payload;
         
         general << "Dispatching write containing " << m_current_msgs.size()
-                <<" message(s) containing ";
+                <<" message(s) in " << m_send_buffer.size()
+                << " buffer(s) containing ";
         header << "Header Bytes: \n";
         payload << "Payload Bytes: \n";
         
@@ -1892,6 +1994,7 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
     bool terminal = m_current_msgs.back()->get_terminal();
 
     m_send_buffer.clear();
+    m_write_batch.clear();
     m_current_msgs.clear();
     // TODO: recycle instead of deleting
 
@@ -1914,6 +2017,9 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
         m_write_flag = false;
 
         needs_writing = !m_send_queue.empty();
+
+        // Frames queued during the write have already waited for it
+        m_write_flush_due = needs_writing;
     }
 
     if (needs_writing) {
@@ -1924,6 +2030,67 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
     }
 }
 
+template <typename config>
+bool connection<config>::delay_write() {
+    bool due = m_write_flush_due;
+    m_write_flush_due = false;
+
+    if (due || m_write_flush_delay <= 0 || m_send_queue.empty() ||
+        m_send_buffer_size >= m_write_batch_size ||
+        m_send_queue.back()->get_terminal())
+    {
+        if (m_write_flush_timer) {
+            m_write_flush_timer->cancel();
+            m_write_flush_timer.reset();
+        }
+        return false;
+    }
+
+    if (m_write_flush_timer) {
+        return true;
+    }
+
+    m_write_flush_timer = transport_con_type::set_timer(
+        m_write_flush_delay,
+        lib::bind(
+            &type::handle_write_flush_timer,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
+
+    // Transports without timers write immediately
+    if (!m_write_flush_timer) {
+        return false;
+    }
+
+    return true;
+}
+
+template <typename config>
+void connection<config>::handle_write_flush_timer(lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        return;
+    } else if (ec) {
+        log_err(log::elevel::devel,"handle_write_flush_timer",ec);
+    }
+
+    {
+        scoped_lock_type lock(m_write_lock);
+
+        // The frames were written before the timer expired
+        if (!m_write_flush_timer) {
+            return;
+        }
+
+        m_write_flush_timer.reset();
+        m_write_flush_due = true;
+    }
+
+    this->write_frame();
+}
+
 template <typename config>
 std::vector<int> const & connection<config>::get_supported_versions() const
 {
@@ -2199,6 +2366,7 @@ connection<config>::get_processor(int version) const {
     
     // Settings not configured by the constructor
     p->set_max_message_size(m_max_message_size);
+    p->set_zero_copy(m_zero_copy);
     
     return p;
 }
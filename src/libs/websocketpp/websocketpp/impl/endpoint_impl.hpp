@@ -54,6 +54,7 @@ endpoint<connection,config>::create_connection() {
     // connection_hdl hdl(reinterpret_cast<void*>(new connection_weak_ptr(con)));
 
     con->set_handle(w);
+    con->set_message_manager(m_msg_manager.get_manager());
 
     // Copy default handlers from the endpoint
     con->set_open_handler(m_open_handler);
@@ -80,6 +81,18 @@ endpoint<connection,config>::create_connection() {
         con->set_max_message_size(m_max_message_size);
     }
     con->set_max_http_body_size(m_max_http_body_size);
+    if (m_zero_copy) {
+        con->set_zero_copy(true);
+    }
+    if (m_write_batch_size != config::write_batch_size) {
+        con->set_write_batch_size(m_write_batch_size);
+    }
+    if (m_write_flush_delay != config::write_flush_delay) {
+        con->set_write_flush_delay(m_write_flush_delay);
+    }
+    if (m_max_read_buffer_size != config::connection_max_read_buffer_size) {
+        con->set_max_read_buffer_size(m_max_read_buffer_size);
+    }
 
     lib::error_code ec;
 
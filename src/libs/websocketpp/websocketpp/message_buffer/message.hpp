@@ -98,7 +98,9 @@ public:
       , m_prepared(false)
       , m_fin(true)
       , m_terminal(false)
-      , m_compressed(false) {}
+      , m_compressed(false)
+      , m_view(NULL)
+      , m_view_size(0) {}
 
     /// Construct a message and fill in some values
     /**
@@ -111,6 +113,8 @@ public:
       , m_fin(true)
       , m_terminal(false)
       , m_compressed(false)
+      , m_view(NULL)
+      , m_view_size(0)
     {
         m_payload.reserve(size);
     }
@@ -241,20 +245,101 @@ public:
 
     /// Get a reference to the payload string
     /**
+     * If the payload is a view of an external buffer it is copied into the
+     * payload string first.
+     *
      * @return A const reference to the message's payload string
      */
     std::string const & get_payload() const {
+        detach_payload();
         return m_payload;
     }
 
     /// Get a non-const reference to the payload string
     /**
+     * If the payload is a view of an external buffer it is copied into the
+     * payload string first.
+     *
      * @return A reference to the message's payload string
      */
     std::string & get_raw_payload() {
+        detach_payload();
         return m_payload;
     }
 
+    /// Get a pointer to the payload bytes
+    /**
+     * Unlike get_payload this does not copy a payload view. The pointer is
+     * valid until the payload is modified or, for a view, until the buffer it
+     * points into is reused.
+     *
+     * @return A pointer to the first byte of the payload
+     */
+    char const * get_payload_data() const {
+        return m_view ? m_view : m_payload.data();
+    }
+
+    /// Get the size of the payload in bytes
+    /**
+     * @return The size of the payload in bytes
+     */
+    size_t get_payload_size() const {
+        return m_view ? m_view_size : m_payload.size();
+    }
+
+    /// Get the capacity of the payload string
+    /**
+     * Unlike get_raw_payload().capacity() this does not copy a payload view,
+     * which is not counted. Used by message managers to pool the message.
+     *
+     * @return The capacity of the payload string in bytes
+     */
+    size_t get_payload_capacity() const {
+        return m_payload.capacity();
+    }
+
+    /// Return whether or not the payload is a view of an external buffer
+    /**
+     * @see set_payload_view
+     *
+     * @return Whether or not the payload is a view of an external buffer
+     */
+    bool has_payload_view() const {
+        return m_view != NULL;
+    }
+
+    /// Set the payload to a view of an external buffer
+    /**
+     * The message refers to the bytes in place instead of owning a copy of
+     * them. This is used by protocol processors to deliver payloads that are
+     * complete in the connection read buffer without copying them. The buffer
+     * must outlive every access to the payload, or detach_payload must be
+     * called before it is reused.
+     *
+     * Under normal circumstances this should not be called by end users
+     *
+     * @param payload A pointer to the first byte of the payload
+     * @param len The length of the payload in bytes
+     */
+    void set_payload_view(char const * payload, size_t len) {
+        m_payload.clear();
+        m_view = payload;
+        m_view_size = len;
+    }
+
+    /// Copy a payload view into the payload string
+    /**
+     * Does nothing if the payload is not a view. After this call the message
+     * no longer refers to the external buffer.
+     */
+    void detach_payload() const {
+        if (m_view) {
+            m_payload.assign(m_view, m_view_size);
+            m_view = NULL;
+            m_view_size = 0;
+        }
+    }
+
     /// Set payload data
     /**
      * Set the message buffer's payload to the given value.
@@ -262,6 +347,8 @@ public:
      * @param payload A string to set the payload to.
      */
     void set_payload(std::string const & payload) {
+        m_view = NULL;
+        m_view_size = 0;
         m_payload = payload;
     }
 
@@ -273,6 +360,8 @@ public:
      * @param len The length of new payload in bytes.
      */
     void set_payload(void const * payload, size_t len) {
+        m_view = NULL;
+        m_view_size = 0;
         m_payload.reserve(len);
         char const * pl = static_cast<char const *>(payload);
         m_payload.assign(pl, pl + len);
@@ -285,6 +374,7 @@ public:
      * @param payload A string containing the data array to append.
      */
     void append_payload(std::string const & payload) {
+        detach_payload();
         m_payload.append(payload);
     }
 
@@ -296,10 +386,28 @@ public:
      * @param len The length of payload in bytes
      */
     void append_payload(void const * payload, size_t len) {
+        detach_payload();
         m_payload.reserve(m_payload.size()+len);
         m_payload.append(static_cast<char const *>(payload),len);
     }
 
+    /// Reset the message to the state of a new message
+    /**
+     * Used by message managers to reuse a recycled message. Clears the
+     * payload but keeps its capacity. The opcode is left unchanged.
+     */
+    void reset() {
+        m_header.clear();
+        m_extension_data.clear();
+        m_payload.clear();
+        m_view = NULL;
+        m_view_size = 0;
+        m_prepared = false;
+        m_fin = true;
+        m_terminal = false;
+        m_compressed = false;
+    }
+
     /// Recycle the message
     /**
      * A request to recycle this message was received. Forward that request to
@@ -326,12 +434,16 @@ private:
     con_msg_man_weak_ptr        m_manager;
     std::string                 m_header;
     std::string                 m_extension_data;
-    std::string                 m_payload;
+    mutable std::string         m_payload;
     frame::opcode::value        m_opcode;
     bool                        m_prepared;
     bool                        m_fin;
     bool                        m_terminal;
     bool                        m_compressed;
+
+    // Payload view set by set_payload_view, NULL if the payload is m_payload
+    mutable char const *        m_view;
+    mutable size_t              m_view_size;
 };
 
 } // namespace message_buffer
@@ -25,12 +25,15 @@
  *
  */
 
-#ifndef WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
-#define WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+
+#ifndef WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
+#define WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
 
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/frame.hpp>
 
-#include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace message_buffer {
@@ -42,35 +45,37 @@ namespace message_buffer {
  *
  * # connection_message_manager:
  * An object that manages all of the message_buffers associated with a given
- * connection. Implements the get_message_buffer(size) method that returns
- * a message buffer at least size bytes long.
+ * connection. Implements the get_message(op,size) method that returns a
+ * message buffer at least size bytes long.
  *
  * Message buffers are reference counted with shared ownership semantics. Once
  * requested from the manager the requester and it's associated downstream code
  * may keep a pointer to the message indefinitely at a cost of extra resource
- * usage. Once the reference count drops to the point where the manager is the
- * only reference the messages is recycled using whatever method is implemented
- * in the manager.
+ * usage. Once the reference count drops to zero the message deleter offers the
+ * message to the manager, which recycles it using whatever method it
+ * implements.
  *
  * # endpoint_message_manager:
  * An object that manages connection_message_managers. Implements the
- * get_message_manager() method. This is used once by each connection to
- * request the message manager that they are supposed to use to manage message
- * buffers for their own use.
+ * get_manager() method. This is used once by each connection to request the
+ * message manager that they are supposed to use to manage message buffers for
+ * their own use.
  *
  * TYPES OF CONNECTION_MESSAGE_MANAGERS
  * - allocate a message with the exact size every time one is requested
- * - maintain a pool of pre-allocated messages and return one when needed.
- *   Recycle previously used messages back into the pool
+ *   (alloc::con_msg_manager)
+ * - maintain a pool of pre-allocated messages in size classes and return one
+ *   when needed. Recycle previously used messages back into the free list of
+ *   their size class (pool::con_msg_manager)
  *
  * TYPES OF ENDPOINT_MESSAGE_MANAGERS
  *  - allocate a new connection manager for each connection. Message pools
  *    become connection specific. This increases memory usage but improves
- *    concurrency.
+ *    concurrency (pool::endpoint_msg_manager)
  *  - allocate a single connection manager and share a pointer to it with all
  *    connections created by this endpoint. The message pool will be shared
  *    among all connections, improving memory usage and performance at the cost
- *    of reduced concurrency
+ *    of reduced concurrency (pool::shared_endpoint_msg_manager)
  */
 
 /// Custom deleter for use in shared_ptrs to message.
@@ -92,105 +97,205 @@ void message_deleter(T* msg) {
     }
 }
 
-/// Represents a buffer for a single WebSocket message.
+namespace pool {
+
+/// Number of payload size classes of a pool
+static size_t const size_classes = 5;
+
+/// Payload capacity of each size class in bytes
 /**
+ * A message is taken from the smallest class that holds the requested size.
+ * Messages for larger payloads are allocated and freed as they are requested.
+ */
+static size_t const size_class_bytes[size_classes] = {
+    256, 1024, 4096, 16384, 65536
+};
+
+/// Allocation counters of a connection message manager
+struct stats {
+    stats()
+      : allocated(0)
+      , reused(0)
+      , recycled(0)
+      , released(0)
+      , pooled(0) {}
+
+    /// Messages allocated because no pooled message was available
+    size_t allocated;
+    /// Requests fulfilled by a pooled message
+    size_t reused;
+    /// Messages returned to the pool
+    size_t recycled;
+    /// Messages freed because they did not fit in the pool
+    size_t released;
+    /// Messages currently in the pool
+    size_t pooled;
+};
+
+/// A connection message manager that maintains a pool of messages that is
+/// used to fulfill get_message requests.
+/**
+ * Released messages keep their payload capacity and are returned to the free
+ * list of their size class, up to max_pooled messages per class. A request is
+ * fulfilled from the free list of the smallest class that holds it, so a
+ * connection that has warmed up does not allocate for messages up to the
+ * largest class.
  *
- *
+ * Messages may be released on any thread. A message that outlives its manager
+ * is freed.
  */
-template <typename con_msg_manager>
-class message {
+template <typename message>
+class con_msg_manager
+  : public lib::enable_shared_from_this<con_msg_manager<message> >
+{
 public:
-    typedef lib::shared_ptr<message> ptr;
+    typedef con_msg_manager<message> type;
+    typedef lib::shared_ptr<con_msg_manager> ptr;
+    typedef lib::weak_ptr<con_msg_manager> weak_ptr;
 
-    typedef typename con_msg_manager::weak_ptr con_msg_man_ptr;
+    typedef typename message::ptr message_ptr;
 
-    message(con_msg_man_ptr manager, size_t size = 128)
-      : m_manager(manager)
-      , m_payload(size) {}
+    /// Construct a manager that keeps up to max_pooled messages per class
+    explicit con_msg_manager(size_t max_pooled = 16)
+      : m_max_pooled(max_pooled) {}
 
-    frame::opcode::value get_opcode() const {
-        return m_opcode;
-    }
-    const std::string& get_header() const {
-        return m_header;
-    }
-    const std::string& get_extension_data() const {
-        return m_extension_data;
-    }
-    const std::string& get_payload() const {
-        return m_payload;
+    ~con_msg_manager() {
+        for (size_t i = 0; i < size_classes; i++) {
+            for (size_t j = 0; j < m_free[i].size(); j++) {
+                delete m_free[i][j];
+            }
+        }
     }
 
-    /// Recycle the message
+    /// Get an empty message buffer
     /**
-     * A request to recycle this message was received. Forward that request to
-     * the connection message manager for processing. Errors and exceptions
-     * from the manager's recycle member function should be passed back up the
-     * call chain. The caller to message::recycle will deal with them.
-     *
-     * Recycle must *only* be called by the message shared_ptr's destructor.
-     * Once recycled successfully, ownership of the memory has been passed to
-     * another system and must not be accessed again.
-     *
-     * @return true if the message was successfully recycled, false otherwise.
+     * @return A shared pointer to an empty message from the smallest class
      */
-    bool recycle() {
-        typename con_msg_manager::ptr shared = m_manager.lock();
+    message_ptr get_message() {
+        message * msg = this->acquire(0);
 
-        if (shared) {
-            return shared->(recycle(this));
+        if (msg) {
+            msg->reset();
         } else {
-            return false;
+            msg = new message(type::shared_from_this());
+            msg->get_raw_payload().reserve(size_class_bytes[0]);
         }
-    }
-private:
-    con_msg_man_ptr             m_manager;
-
-    frame::opcode::value        m_opcode;
-    std::string                 m_header;
-    std::string                 m_extension_data;
-    std::string                 m_payload;
-};
-
-namespace alloc {
-
-/// A connection message manager that allocates a new message for each
-/// request.
-template <typename message>
-class con_msg_manager {
-public:
-    typedef lib::shared_ptr<con_msg_manager> ptr;
-    typedef lib::weak_ptr<con_msg_manager> weak_ptr;
 
-    typedef typename message::ptr message_ptr;
+        return message_ptr(msg,&message_deleter<message>);
+    }
 
-    /// Get a message buffer with specified size
+    /// Get a message buffer with specified size and opcode
     /**
+     * @param op The opcode to use
      * @param size Minimum size in bytes to request for the message payload.
      *
-     * @return A shared pointer to a new message with specified size.
+     * @return A shared pointer to a message with at least the specified size.
      */
-    message_ptr get_message(size_t size) const {
-        return lib::make_shared<message>(size);
+    message_ptr get_message(frame::opcode::value op,size_t size) {
+        message * msg = this->acquire(size);
+
+        if (msg) {
+            msg->reset();
+            msg->set_opcode(op);
+        } else {
+            size_t c = get_size_class(size);
+            msg = new message(type::shared_from_this(),op,
+                c < size_classes ? size_class_bytes[c] : size);
+        }
+
+        return message_ptr(msg,&message_deleter<message>);
     }
 
     /// Recycle a message
     /**
-     * This method shouldn't be called. If it is, return false to indicate an
-     * error. The rest of the method recycle chain should notice this and free
-     * the memory.
+     * Called by the message deleter. Returns the message to the free list of
+     * the largest class its payload capacity holds.
      *
      * @param msg The message to be recycled.
      *
-     * @return true if the message was successfully recycled, false otherwse.
+     * @return true if the message was returned to the pool, false if the
+     * caller should free it.
      */
     bool recycle(message * msg) {
-        return false;
+        // A payload view is not copied only to be thrown away
+        size_t capacity = msg->get_payload_capacity();
+
+        // Payloads that shrank below the smallest class or grew past the
+        // largest one are not kept
+        size_t c = size_classes;
+        if (capacity >= size_class_bytes[0]
+            && capacity <= size_class_bytes[size_classes-1])
+        {
+            c = 0;
+            while (c+1 < size_classes && size_class_bytes[c+1] <= capacity) {
+                c++;
+            }
+        }
+
+        scoped_lock_type guard(m_lock);
+
+        if (c >= size_classes || m_free[c].size() >= m_max_pooled) {
+            m_stats.released++;
+            return false;
+        }
+
+        m_free[c].push_back(msg);
+        m_stats.recycled++;
+        m_stats.pooled++;
+        return true;
+    }
+
+    /// Get the allocation counters of this manager
+    stats get_stats() const {
+        scoped_lock_type guard(m_lock);
+        return m_stats;
+    }
+
+    /// Get the maximum number of pooled messages per size class
+    size_t get_max_pooled() const {
+        return m_max_pooled;
+    }
+private:
+    typedef lib::lock_guard<lib::mutex> scoped_lock_type;
+
+    /// Index of the smallest class that holds size, size_classes if none
+    static size_t get_size_class(size_t size) {
+        size_t c = 0;
+        while (c < size_classes && size_class_bytes[c] < size) {
+            c++;
+        }
+        return c;
+    }
+
+    /// Take a pooled message that holds size bytes, or NULL to allocate one
+    message * acquire(size_t size) {
+        size_t c = get_size_class(size);
+
+        scoped_lock_type guard(m_lock);
+
+        if (c >= size_classes || m_free[c].empty()) {
+            m_stats.allocated++;
+            return NULL;
+        }
+
+        message * msg = m_free[c].back();
+        m_free[c].pop_back();
+        m_stats.reused++;
+        m_stats.pooled--;
+        return msg;
     }
+
+    size_t const                m_max_pooled;
+    std::vector<message *>      m_free[size_classes];
+    stats                       m_stats;
+    mutable lib::mutex          m_lock;
 };
 
-/// An endpoint message manager that allocates a new manager for each
-/// connection.
+/// An endpoint message manager that allocates a new pool for each connection.
+/**
+ * Pools are connection specific. This increases memory usage but the pools
+ * are not contended.
+ */
 template <typename con_msg_manager>
 class endpoint_msg_manager {
 public:
@@ -198,27 +303,35 @@ public:
 
     /// Get a pointer to a connection message manager
     /**
-     * @return A pointer to the requested connection message manager.
+     * @return A pointer to a new connection message manager.
      */
     con_msg_man_ptr get_manager() const {
-        return lib::make_shared<con_msg_manager>();
+        return con_msg_man_ptr(lib::make_shared<con_msg_manager>());
     }
 };
 
-} // namespace alloc
-
-namespace pool {
-
-/// A connection messages manager that maintains a pool of messages that is
-/// used to fulfill get_message requests.
-class con_msg_manager {
-
-};
+/// An endpoint message manager that shares one pool with all connections.
+/**
+ * The pool is shared among all connections created by the endpoint, which
+ * improves memory usage at the cost of contention on the pool lock.
+ */
+template <typename con_msg_manager>
+class shared_endpoint_msg_manager {
+public:
+    typedef typename con_msg_manager::ptr con_msg_man_ptr;
 
-/// An endpoint manager that maintains a shared pool of connection managers
-/// and returns an appropriate one for the requesting connection.
-class endpoint_msg_manager {
+    shared_endpoint_msg_manager()
+      : m_manager(lib::make_shared<con_msg_manager>()) {}
 
+    /// Get a pointer to the connection message manager
+    /**
+     * @return A pointer to the shared connection message manager.
+     */
+    con_msg_man_ptr get_manager() const {
+        return m_manager;
+    }
+private:
+    con_msg_man_ptr m_manager;
 };
 
 } // namespace pool
@@ -226,4 +339,4 @@ class endpoint_msg_manager {
 } // namespace message_buffer
 } // namespace websocketpp
 
-#endif // WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#endif // WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
@@ -419,8 +419,20 @@ public:
                             break;
                         }
                         
+                        // A single frame message that is already complete
+                        // in buf needs no unmasking, decompression or
+                        // reassembly, so in zero copy mode its payload is
+                        // left in buf.
+                        m_payload_view = base::m_zero_copy
+                            && frame::get_fin(m_basic_header)
+                            && !frame::get_masked(m_basic_header)
+                            && !(m_permessage_deflate.is_enabled()
+                                 && frame::get_rsv1(m_basic_header))
+                            && m_bytes_needed <= len - p;
+
                         m_data_msg = msg_metadata(
-                            m_msg_manager->get_message(op,m_bytes_needed),
+                            m_msg_manager->get_message(op,
+                                m_payload_view ? 0 : m_bytes_needed),
                             frame::get_masking_key(m_basic_header,m_extended_header)
                         );
                         
@@ -455,7 +467,11 @@ public:
             } else if (m_state == APPLICATION) {
                 size_t bytes_to_process = (std::min)(m_bytes_needed,len-p);
 
-                if (bytes_to_process > 0) {
+                if (m_payload_view) {
+                    p += this->process_payload_view(buf+p,ec);
+
+                    if (ec) {break;}
+                } else if (bytes_to_process > 0) {
                     p += this->process_payload_bytes(buf+p,bytes_to_process,ec);
 
                     if (ec) {break;}
@@ -494,13 +510,12 @@ public:
      * @return A code indicating errors, if any
      */
     lib::error_code finalize_message() {
-        std::string & out = m_current_msg->msg_ptr->get_raw_payload();
-
         // if the frame is compressed, append the compression
         // trailer and flush the compression buffer.
         if (m_permessage_deflate.is_enabled()
             && m_current_msg->msg_ptr->get_compressed())
         {
+            std::string & out = m_current_msg->msg_ptr->get_raw_payload();
             uint8_t trailer[4] = {0x00, 0x00, 0xff, 0xff};
 
             // Decompress current buffer into the message buffer
@@ -526,6 +541,7 @@ public:
     void reset_headers() {
         m_state = HEADER_BASIC;
         m_bytes_needed = frame::BASIC_HEADER_LENGTH;
+        m_payload_view = false;
 
         m_basic_header.b0 = 0x00;
         m_basic_header.b1 = 0x00;
@@ -574,7 +590,8 @@ public:
      * Performs validation, masking, compression, etc. will return an error if
      * there was an error, otherwise msg will be ready to be written
      *
-     * TODO: tests
+     * in and out may be the same message, in which case the payload is
+     * masked in place.
      *
      * @param in An unprepared message to prepare
      * @param out A message to be overwritten with the prepared message
@@ -616,8 +633,15 @@ public:
 
         // prepare payload
         if (compressed) {
-            // compress and store in o after header.
-            m_permessage_deflate.compress(i,o);
+            // compress and store in o after header. compress appends, so
+            // when preparing in place compress into a new buffer first.
+            if (in == out) {
+                std::string compressed_payload;
+                m_permessage_deflate.compress(i,compressed_payload);
+                o.swap(compressed_payload);
+            } else {
+                m_permessage_deflate.compress(i,o);
+            }
 
             if (o.size() < 4) {
                 return make_error_code(error::general);
@@ -780,7 +804,6 @@ protected:
         if (frame::get_masked(m_basic_header)) {
             m_current_msg->prepared_key = frame::byte_mask_circ(
                 buf, len, m_current_msg->prepared_key);
-            // TODO: SIMD masking
         }
 
         std::string & out = m_current_msg->msg_ptr->get_raw_payload();
@@ -813,6 +836,35 @@ protected:
         return len;
     }
 
+    /// Sets the message payload to a view of a complete frame payload in buf
+    /**
+     * Zero copy counterpart of process_payload_bytes for frames selected by
+     * consume. The payload must be unmasked, uncompressed and all
+     * m_bytes_needed bytes must be in buf. Text payloads are validated in
+     * place.
+     *
+     * @param buf Input buffer
+     * @return Number of bytes processed or zero in case of an error
+     */
+    size_t process_payload_view(uint8_t * buf, lib::error_code& ec)
+    {
+        size_t len = m_bytes_needed;
+
+        if (m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT) {
+            if (!m_current_msg->validator.decode(buf,buf+len)) {
+                ec = make_error_code(error::invalid_utf8);
+                return 0;
+            }
+        }
+
+        m_current_msg->msg_ptr->set_payload_view(
+            reinterpret_cast<char const *>(buf),len);
+
+        m_bytes_needed = 0;
+
+        return len;
+    }
+
     /// Validate an incoming basic header
     /**
      * Validates an incoming hybi13 basic header.
@@ -939,8 +991,11 @@ protected:
     void masked_copy (std::string const & i, std::string & o,
         frame::masking_key_type key) const
     {
-        frame::byte_mask(i.begin(),i.end(),o.begin(),key);
-        // TODO: SIMD masking
+        if (i.empty()) {
+            return;
+        }
+        frame::simd::mask(reinterpret_cast<uint8_t const *>(i.data()),
+            reinterpret_cast<uint8_t *>(&o[0]), i.size(), key.c);
     }
 
     /// Generic prepare control frame with opcode and payload.
@@ -1046,6 +1101,10 @@ protected:
     // Overall state of the processor
     state m_state;
 
+    // Whether the payload of the current frame is delivered as a view of the
+    // consumed buffer
+    bool m_payload_view;
+
     // Extensions
     permessage_deflate_type m_permessage_deflate;
 };
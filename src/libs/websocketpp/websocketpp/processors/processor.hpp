@@ -169,6 +169,7 @@ public:
       : m_secure(secure)
       , m_server(p_is_server)
       , m_max_message_size(config::max_message_size)
+      , m_zero_copy(false)
     {}
 
     virtual ~processor() {}
@@ -204,6 +205,30 @@ public:
         m_max_message_size = new_value;
     }
 
+    /// Get whether payloads are handled without copying
+    /**
+     * @see set_zero_copy
+     */
+    bool get_zero_copy() const {
+        return m_zero_copy;
+    }
+
+    /// Set whether payloads are handled without copying
+    /**
+     * When enabled, processors that support it deliver unmasked, uncompressed
+     * single frame messages that are complete in the buffer passed to consume
+     * as views of that buffer rather than copying them into the message. The
+     * caller must use or detach such a message before it reuses the buffer.
+     *
+     * Processors that do not support zero copy ignore this setting. The
+     * default is false.
+     *
+     * @param value Whether or not to handle payloads without copying
+     */
+    void set_zero_copy(bool value) {
+        m_zero_copy = value;
+    }
+
     /// Returns whether or not the permessage_compress extension is implemented
     /**
      * Compile time flag that indicates whether this processor has implemented
@@ -399,6 +424,7 @@ protected:
     bool const m_secure;
     bool const m_server;
     size_t m_max_message_size;
+    bool m_zero_copy;
 };
 
 } // namespace processor
@@ -29,8 +29,10 @@
 #ifndef UTF8_VALIDATOR_HPP
 #define UTF8_VALIDATOR_HPP
 
+#include <websocketpp/common/cpu.hpp>
 #include <websocketpp/common/stdint.hpp>
 
+#include <cstring>
 #include <string>
 
 namespace websocketpp {
@@ -77,6 +79,156 @@ inline uint32_t decode(uint32_t * state, uint32_t * codep, uint8_t byte) {
   return *state;
 }
 
+/// ASCII scanning kernels
+/**
+ * Each kernel returns a pointer to the first byte in [begin,end) that is not
+ * ASCII, or end if all of them are ASCII. ASCII bytes don't change the state
+ * of the decoder between codepoints, so the validator skips runs of them a
+ * vector at a time instead of running the state machine on each byte.
+ *
+ * skip_ascii() dispatches to the fastest kernel supported by the running
+ * CPU. The kernels are exposed individually for testing and benchmarking.
+ */
+namespace simd {
+
+typedef uint8_t const * (*ascii_function)(uint8_t const * begin,
+    uint8_t const * end);
+
+/// Portable kernel checking a machine word at a time
+inline uint8_t const * skip_ascii_scalar(uint8_t const * begin,
+    uint8_t const * end)
+{
+    size_t high_bits;
+    std::memset(&high_bits, 0x80, sizeof(size_t));
+
+    while (static_cast<size_t>(end - begin) >= sizeof(size_t)) {
+        size_t word;
+        std::memcpy(&word, begin, sizeof(size_t));
+        if (word & high_bits) {
+            break;
+        }
+        begin += sizeof(size_t);
+    }
+
+    while (begin != end && *begin < 0x80) {
+        ++begin;
+    }
+    return begin;
+}
+
+#ifdef _WEBSOCKETPP_SSE2_
+/// SSE2 kernel checking 16 bytes at a time
+inline uint8_t const * skip_ascii_sse2(uint8_t const * begin,
+    uint8_t const * end)
+{
+    while (end - begin >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(begin));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+        begin += 16;
+    }
+
+    // Finds the non-ASCII byte within the last vector
+    return skip_ascii_scalar(begin, end);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_AVX2_
+/// AVX2 kernel checking 32 bytes at a time
+/**
+ * Must be called only if the CPU supports AVX2.
+ */
+_WEBSOCKETPP_AVX2_TARGET_
+inline uint8_t const * skip_ascii_avx2(uint8_t const * begin,
+    uint8_t const * end)
+{
+    while (end - begin >= 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(begin));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(begin + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0) {
+            break;
+        }
+        begin += 64;
+    }
+
+    while (end - begin >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(begin));
+        if (_mm256_movemask_epi8(v) != 0) {
+            break;
+        }
+        begin += 32;
+    }
+
+    return skip_ascii_sse2(begin, end);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_NEON_
+/// NEON kernel checking 16 bytes at a time
+inline uint8_t const * skip_ascii_neon(uint8_t const * begin,
+    uint8_t const * end)
+{
+    while (end - begin >= 16) {
+        uint8x16_t v = vld1q_u8(begin);
+        uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) &
+            0x8080808080808080ull)
+        {
+            break;
+        }
+        begin += 16;
+    }
+
+    return skip_ascii_scalar(begin, end);
+}
+#endif
+
+/// Get the function of a kernel, or null if it is not supported
+inline ascii_function get_ascii_function(cpu::kernel k) {
+    if (!cpu::is_supported(k)) {
+        return NULL;
+    }
+
+    switch (k) {
+#ifdef _WEBSOCKETPP_SSE2_
+        case cpu::sse2:
+            return &skip_ascii_sse2;
+#endif
+#ifdef _WEBSOCKETPP_AVX2_
+        case cpu::avx2:
+            return &skip_ascii_avx2;
+#endif
+#ifdef _WEBSOCKETPP_NEON_
+        case cpu::neon:
+            return &skip_ascii_neon;
+#endif
+        default:
+            return &skip_ascii_scalar;
+    }
+}
+
+/// Skip ASCII bytes with the fastest kernel supported by the running CPU
+/**
+ * The kernel is detected once per process. Inputs shorter than a vector are
+ * checked by the scalar kernel directly.
+ *
+ * @param begin Start of the input
+ * @param end End of the input
+ * @return The first byte that is not ASCII, or end
+ */
+inline uint8_t const * skip_ascii(uint8_t const * begin, uint8_t const * end) {
+    if (end - begin < 16) {
+        return skip_ascii_scalar(begin, end);
+    }
+
+    static ascii_function const function =
+        get_ascii_function(cpu::detect_kernel());
+    return function(begin, end);
+}
+
+} // namespace simd
+
 /// Provides streaming UTF8 validation functionality
 class validator {
 public:
@@ -117,6 +269,88 @@ public:
         return true;
     }
 
+    /// Advance validator state with input from a contiguous buffer
+    /**
+     * Runs of ASCII between codepoints are skipped by simd::skip_ascii. The
+     * state is kept across calls, so a message may be validated in fragments
+     * split at any byte.
+     *
+     * @param begin Pointer to the start of the input range
+     * @param end Pointer to the end of the input range
+     * @return Whether or not decoding the bytes resulted in a validation error.
+     */
+    bool decode (uint8_t const * begin, uint8_t const * end) {
+        while (begin != end) {
+            if (m_state == utf8_accept && *begin < 0x80) {
+                begin = simd::skip_ascii(begin, end);
+                if (begin == end) {
+                    break;
+                }
+            }
+
+            if (utf8_validator::decode(&m_state,&m_codepoint,*begin) ==
+                utf8_reject)
+            {
+                return false;
+            }
+            ++begin;
+        }
+        return true;
+    }
+
+    /// Advance validator state with input from a contiguous buffer
+    /**
+     * @see decode(uint8_t const *, uint8_t const *)
+     */
+    bool decode (uint8_t * begin, uint8_t * end) {
+        return decode(const_cast<uint8_t const *>(begin),
+            const_cast<uint8_t const *>(end));
+    }
+
+    /// Advance validator state with input from a char buffer
+    /**
+     * @see decode(uint8_t const *, uint8_t const *)
+     */
+    bool decode (char const * begin, char const * end) {
+        return decode(reinterpret_cast<uint8_t const *>(begin),
+            reinterpret_cast<uint8_t const *>(end));
+    }
+
+    /// Advance validator state with input from a char buffer
+    /**
+     * @see decode(uint8_t const *, uint8_t const *)
+     */
+    bool decode (char * begin, char * end) {
+        return decode(const_cast<char const *>(begin),
+            const_cast<char const *>(end));
+    }
+
+    /// Advance validator state with input from a string
+    /**
+     * @see decode(uint8_t const *, uint8_t const *)
+     */
+    bool decode (std::string::const_iterator begin,
+        std::string::const_iterator end)
+    {
+        if (begin == end) {
+            return true;
+        }
+        char const * data = &*begin;
+        return decode(data, data + (end - begin));
+    }
+
+    /// Advance validator state with input from a string
+    /**
+     * @see decode(uint8_t const *, uint8_t const *)
+     */
+    bool decode (std::string::iterator begin, std::string::iterator end) {
+        if (begin == end) {
+            return true;
+        }
+        char const * data = &*begin;
+        return decode(data, data + (end - begin));
+    }
+
     /// Return whether the input sequence ended on a valid utf8 codepoint
     /**
      * @return Whether or not the input sequence ended on a valid codepoint.
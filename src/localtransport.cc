@@ -0,0 +1,57 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <map>
+#include <mutex>
+
+#include "webrtc/base/helpers.h"
+
+#include "localtransport.h"
+#include "peer.h"
+
+namespace peerapi {
+
+namespace {
+
+std::mutex& RegistryLock() {
+  static std::mutex lock;
+  return lock;
+}
+
+std::map<std::string, PeerControl*>& Registry() {
+  static std::map<std::string, PeerControl*> registry;
+  return registry;
+}
+
+} // namespace
+
+std::string LocalTransport::Register(PeerControl* peer) {
+  std::string token = rtc::CreateRandomUuid();
+
+  std::lock_guard<std::mutex> guard(RegistryLock());
+  Registry()[token] = peer;
+  return token;
+}
+
+void LocalTransport::Unregister(const std::string& token) {
+  if (token.empty()) return;
+
+  std::lock_guard<std::mutex> guard(RegistryLock());
+  Registry().erase(token);
+}
+
+rtc::scoped_refptr<PeerControl> LocalTransport::Find(const std::string& token) {
+  std::lock_guard<std::mutex> guard(RegistryLock());
+
+  // A peer unregisters itself on closing, and Control shuts down its peers
+  // before releasing them. So a registered peer has another reference and
+  // it is safe to add one while holding the lock.
+  auto found = Registry().find(token);
+  if (found == Registry().end()) return nullptr;
+  return rtc::scoped_refptr<PeerControl>(found->second);
+}
+
+} // namespace peerapi
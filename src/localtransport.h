@@ -0,0 +1,40 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_LOCALTRANSPORT_H__
+#define __PEERAPI_LOCALTRANSPORT_H__
+
+#include <string>
+
+#include "webrtc/base/scoped_ref_ptr.h"
+
+namespace peerapi {
+
+class PeerControl;
+
+//
+// class LocalTransport
+//
+// A process-wide registry of peers that accept the in-process transport.
+// A peer registers itself and sends the token in 'offersdp' or 'answersdp'.
+// If the remote peer finds the token, both peers are in the same process
+// and exchange data by posting to each other's thread, instead of
+// DTLS/SCTP over a loopback network.
+//
+
+class LocalTransport {
+public:
+  // Returns a token to find the peer
+  static std::string Register(PeerControl* peer);
+  static void Unregister(const std::string& token);
+
+  // Returns nullptr if the token is not in this process
+  static rtc::scoped_refptr<PeerControl> Find(const std::string& token);
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_LOCALTRANSPORT_H__
@@ -67,6 +67,8 @@
 #include "webrtc/base/constructormagic.h"
 #include "webrtc/base/thread_annotations.h"
 
+#include "memoryaccounting.h"
+
 namespace peerapi {
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -218,6 +220,10 @@ class LogMessage {
                             LoggingSeverity severity,
                             const std::string& tag);
 
+  // Allocations while this message is built and written. It is declared
+  // first to cover the members below.
+  MemoryScope memory_scope_{MEMORY_LOGGING};
+
   // The ostream that buffers the formatted message before output
   std::ostringstream print_stream_;
 
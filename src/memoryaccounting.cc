@@ -0,0 +1,194 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include "memoryaccounting.h"
+
+#if defined(PEERAPI_MEMORY_ACCOUNTING)
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#endif
+
+namespace peerapi {
+
+#if defined(PEERAPI_MEMORY_ACCOUNTING)
+
+namespace {
+
+//
+// A header before each block keeps its tag and size, so a block is
+// counted to its subsystem wherever it is freed. The header is 16 bytes
+// to keep the alignment of malloc().
+//
+
+struct alignas(16) BlockHeader {
+  size_t size_;
+  uint32_t tag_;
+  uint32_t magic_;
+};
+
+const uint32_t kBlockMagic = 0x5045454d;
+
+struct Counter {
+  std::atomic<int64_t> bytes_;
+  std::atomic<int64_t> peak_bytes_;
+  std::atomic<int64_t> blocks_;
+};
+
+// Zero-initialized before any dynamic initialization
+Counter counters[MEMORY_TAGS];
+
+thread_local MemoryTag current_tag = MEMORY_OTHER;
+
+void* Allocate(size_t size) {
+  BlockHeader* header = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+  if (header == nullptr) return nullptr;
+
+  header->size_ = size;
+  header->tag_ = current_tag;
+  header->magic_ = kBlockMagic;
+
+  Counter& counter = counters[current_tag];
+  int64_t bytes = counter.bytes_.fetch_add(size, std::memory_order_relaxed) + size;
+  counter.blocks_.fetch_add(1, std::memory_order_relaxed);
+
+  int64_t peak = counter.peak_bytes_.load(std::memory_order_relaxed);
+  while (bytes > peak &&
+         !counter.peak_bytes_.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+  }
+
+  return header + 1;
+}
+
+void Free(void* ptr) {
+  if (ptr == nullptr) return;
+
+  BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+  if (header->magic_ != kBlockMagic || header->tag_ >= MEMORY_TAGS) {
+    // Not allocated by Allocate(). It is a bug of the caller, so crash here
+    // rather than corrupting the heap silently.
+    std::abort();
+  }
+
+  Counter& counter = counters[header->tag_];
+  counter.bytes_.fetch_sub(header->size_, std::memory_order_relaxed);
+  counter.blocks_.fetch_sub(1, std::memory_order_relaxed);
+
+  header->magic_ = 0;
+  std::free(header);
+}
+
+void* AllocateOrThrow(size_t size) {
+  for (;;) {
+    void* ptr = Allocate(size);
+    if (ptr != nullptr) return ptr;
+
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+
+} // namespace
+
+MemoryScope::MemoryScope(MemoryTag tag) : previous_(current_tag) {
+  current_tag = tag;
+}
+
+MemoryScope::~MemoryScope() {
+  current_tag = previous_;
+}
+
+bool MemoryAccounting::enabled() {
+  return true;
+}
+
+MemoryCounter MemoryAccounting::Get(MemoryTag tag) {
+  MemoryCounter counter;
+  if (tag < 0 || tag >= MEMORY_TAGS) return counter;
+
+  counter.bytes_ = static_cast<size_t>(counters[tag].bytes_.load());
+  counter.peak_bytes_ = static_cast<size_t>(counters[tag].peak_bytes_.load());
+  counter.blocks_ = static_cast<size_t>(counters[tag].blocks_.load());
+  return counter;
+}
+
+#else
+
+bool MemoryAccounting::enabled() {
+  return false;
+}
+
+MemoryCounter MemoryAccounting::Get(MemoryTag) {
+  return MemoryCounter();
+}
+
+#endif // PEERAPI_MEMORY_ACCOUNTING
+
+const char* MemoryAccounting::name(MemoryTag tag) {
+  switch (tag) {
+  case MEMORY_OTHER: return "other";
+  case MEMORY_SIGNAL: return "signal";
+  case MEMORY_PEER: return "peer";
+  case MEMORY_CHANNEL: return "channel";
+  case MEMORY_LOGGING: return "logging";
+  default: return "";
+  }
+}
+
+} // namespace peerapi
+
+
+#if defined(PEERAPI_MEMORY_ACCOUNTING)
+
+//
+// Replacements of the global operator new and delete
+//
+
+void* operator new(std::size_t size) {
+  return peerapi::AllocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size) {
+  return peerapi::AllocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return peerapi::Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return peerapi::Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  peerapi::Free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  peerapi::Free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  peerapi::Free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  peerapi::Free(ptr);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, std::size_t) noexcept {
+  peerapi::Free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  peerapi::Free(ptr);
+}
+#endif
+
+#endif // PEERAPI_MEMORY_ACCOUNTING
@@ -0,0 +1,62 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_MEMORYACCOUNTING_H__
+#define __PEERAPI_MEMORYACCOUNTING_H__
+
+#include <cstddef>
+
+namespace peerapi {
+
+//
+// Memory accounting
+//
+// If built with PEERAPI_MEMORY_ACCOUNTING, the global operator new and
+// delete are replaced and count heap blocks by a subsystem. Allocations
+// are attributed to the innermost MemoryScope of the allocating thread,
+// and a block is counted to the same subsystem when it is freed on any
+// thread. Allocations by malloc(), such as SCTP buffers of usrsctp, are
+// not counted. Otherwise MemoryScope does nothing and counters are zero.
+//
+
+enum MemoryTag {
+  MEMORY_OTHER = 0,     // Not in any scope, including threads of WebRTC
+  MEMORY_SIGNAL,        // Signal server connection and commands
+  MEMORY_PEER,          // Peer connections and negotiation
+  MEMORY_CHANNEL,       // Data channel buffers and send queues
+  MEMORY_LOGGING,
+  MEMORY_TAGS
+};
+
+struct MemoryCounter {
+  size_t bytes_ = 0;          // Allocated and not freed
+  size_t peak_bytes_ = 0;
+  size_t blocks_ = 0;         // Allocated and not freed
+};
+
+class MemoryAccounting {
+public:
+  static bool enabled();
+  static const char* name(MemoryTag tag);
+  static MemoryCounter Get(MemoryTag tag);
+};
+
+class MemoryScope {
+public:
+#if defined(PEERAPI_MEMORY_ACCOUNTING)
+  explicit MemoryScope(MemoryTag tag);
+  ~MemoryScope();
+
+private:
+  MemoryTag previous_;
+#else
+  explicit MemoryScope(MemoryTag) {}
+#endif
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_MEMORYACCOUNTING_H__
@@ -4,15 +4,32 @@
 *  Ryan Lee
 */
 
+#include <algorithm>
 #include "control.h"
 #include "peer.h"
+#include "localtransport.h"
+#include "memoryaccounting.h"
 #include "webrtc/api/test/fakeconstraints.h"
+#include "webrtc/base/location.h"
+#include "webrtc/base/thread.h"
+#include "webrtc/base/timeutils.h"
 #include "webrtc/pc/test/mockpeerconnectionobservers.h"
 
 #include "logging.h"
 
 namespace peerapi {
 
+//
+// struct PeerSetting
+//
+
+PeerSetting::PeerSetting() {
+  webrtc::PeerConnectionInterface::IceServer ice_server;
+  ice_server.uri = "stun:stun.l.google.com:19302";
+  ice_servers_.push_back(ice_server);
+}
+
+
 //
 // class PeerControl
 //
@@ -21,23 +38,49 @@ PeerControl::PeerControl(const string local_id,
                          const string remote_id,
                          PeerObserver* observer,
                          rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
-                             peer_connection_factory)
+                             peer_connection_factory,
+                         const PeerSetting& setting)
     : local_id_(local_id),
       remote_id_(remote_id),
       control_(observer),
+      setting_(setting),
       peer_connection_factory_(peer_connection_factory),
-      state_(pClosed) {
-
+      state_(pClosed),
+      connecting_ms_(0),
+      last_activity_ms_(0),
+      ice_failed_ms_(0),
+      offerer_(false),
+      renegotiating_(false),
+      ice_restarting_(false),
+      drain_posted_(false),
+      draining_(false),
+      budget_reserved_(0),
+      budget_needed_(0),
+      pending_candidates_(Json::arrayValue),
+      remote_batching_(false),
+      thread_(rtc::Thread::Current()),
+      local_buffered_(0),
+      local_needed_(0) {
+
+  scheduler_.set_weights(setting_.send_weights_[PRIORITY_HIGH],
+                         setting_.send_weights_[PRIORITY_NORMAL],
+                         setting_.send_weights_[PRIORITY_LOW]);
 }
 
 PeerControl::~PeerControl() {
   RTC_DCHECK(state_ == pClosed);
+  LocalTransport::Unregister(local_token_);
+  ReleaseSendBudget();
+
+  // Messages posted to this peer without a reference, such as "writable"
+  thread_->Clear(this);
   DeletePeerConnection();
   LOG_F( INFO ) << "Done";
 }
 
 
 bool PeerControl::Initialize() {
+  MemoryScope memory_scope(MEMORY_PEER);
 
   if (!CreatePeerConnection()) {
     LOG_F(LS_ERROR) << "CreatePeerConnection failed";
@@ -46,7 +89,8 @@ bool PeerControl::Initialize() {
   }
 
   webrtc::DataChannelInit init;
-  const string data_channel_name = string("peer_data_") + remote_id_;
+  const string data_channel_name = remote_id_.empty() ? string("peer_data") :
+                                   string("peer_data_") + remote_id_;
   if (!CreateDataChannel(data_channel_name, init)) {
     LOG_F(LS_ERROR) << "CreateDataChannel failed";
     DeletePeerConnection();
@@ -57,15 +101,101 @@ bool PeerControl::Initialize() {
   return true;
 }
 
-bool PeerControl::Send(const char* buffer, const size_t size) {
+bool PeerControl::Send(const char* buffer, const size_t size,
+                       const SendPriority priority) {
   RTC_DCHECK( state_ == pOpen );
+  MemoryScope memory_scope(MEMORY_CHANNEL);
   
   if ( state_ != pOpen ) {
     LOG_F( WARNING ) << "Send data when a peer state is not opened";
     return false;
   }
 
-  return local_data_channel_->Send(buffer, size);
+  last_activity_ms_ = rtc::TimeMillis();
+
+  rtc::scoped_refptr<PeerControl> remote = local_remote();
+  if ( remote ) {
+    return SendLocal(remote, buffer, size);
+  }
+
+  if ( !ReserveSendBudget(size) ) {
+    LOG_F( WARNING ) << "Send budget is exhausted, peer is " << remote_id_;
+    return false;
+  }
+
+  if ( !setting_.send_scheduler_ ) {
+    bool sent = local_data_channel_->Send(buffer, size);
+    UpdateSendBudget();
+    return sent;
+  }
+
+  //
+  // Queue by priority and drain on the webrtc thread. The data channel is
+  // proxied to that thread, so draining here could block the caller.
+  //
+
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> guard(scheduler_lock_);
+    if ( scheduler_.bytes() + size <= setting_.send_buffer_size_ ) {
+      scheduler_.Push(priority, buffer, size);
+      queued = true;
+    }
+  }
+
+  if ( !queued ) {
+    LOG_F( WARNING ) << "Send queue is full, peer is " << remote_id_;
+    {
+      std::lock_guard<std::mutex> guard(budget_lock_);
+      budget_reserved_ -= std::min(budget_reserved_, size);
+    }
+    SendBudget::Adjust(-static_cast<long long>(size));
+    return false;
+  }
+
+  if ( rtc::Thread::Current() == thread_ ) {
+    DrainSendQueue();
+  }
+  else if ( !drain_posted_.exchange(true) ) {
+    thread_->Post(RTC_FROM_HERE, this, MSG_DRAIN_SEND_QUEUE);
+  }
+
+  return true;
+}
+
+void PeerControl::DrainSendQueue() {
+  MemoryScope memory_scope(MEMORY_CHANNEL);
+  drain_posted_ = false;
+
+  // The data channel may notify OnBufferedAmountChange within Send()
+  if ( draining_ ) return;
+  if ( state_ != pOpen || local_data_channel_ == nullptr ) return;
+
+  draining_ = true;
+
+  while ( local_data_channel_->BufferedAmount() < setting_.send_watermark_ ) {
+    string message;
+    SendPriority priority;
+    {
+      std::lock_guard<std::mutex> guard(scheduler_lock_);
+      if ( !scheduler_.Pop(&message, &priority) ) break;
+    }
+
+    //
+    // Send() has already returned true for the message. If the buffer of
+    // the data channel is full, keep it at the front of its queue and retry
+    // on OnBufferedAmountChange.
+    //
+
+    if ( !local_data_channel_->Send(message.data(), message.size()) ) {
+      std::lock_guard<std::mutex> guard(scheduler_lock_);
+      scheduler_.Requeue(priority, &message);
+      LOG_F( WARNING ) << "Data channel is full, peer is " << remote_id_;
+      break;
+    }
+  }
+
+  draining_ = false;
 }
 
 bool PeerControl::SyncSend(const char* buffer, const size_t size) {
@@ -76,7 +206,96 @@ bool PeerControl::SyncSend(const char* buffer, const size_t size) {
     return false;
   }
 
-  return local_data_channel_->SyncSend(buffer, size);
+  // Messages of the in-process transport are not buffered
+  if ( IsLocal() ) {
+    return Send(buffer, size);
+  }
+
+  last_activity_ms_ = rtc::TimeMillis();
+
+  if ( !ReserveSendBudget(size) ) {
+    LOG_F( WARNING ) << "Send budget is exhausted, peer is " << remote_id_;
+    return false;
+  }
+
+  bool sent = local_data_channel_->SyncSend(buffer, size);
+  UpdateSendBudget();
+  return sent;
+}
+
+//
+// A peer reserves the process-wide SendBudget before sending, and keeps its
+// reservation equal to the buffered amount and queued bytes afterwards.
+//
+
+bool PeerControl::ReserveSendBudget(const size_t size) {
+  if ( !SendBudget::Reserve(size) ) {
+    {
+      std::lock_guard<std::mutex> guard(budget_lock_);
+      budget_needed_ = size;
+    }
+
+    // Emit "writable" when the budget has room for the message
+    SendBudget::Wait(this, size);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(budget_lock_);
+  budget_reserved_ += size;
+  budget_needed_ = 0;
+  return true;
+}
+
+// The budget has room for the message failed to send last time, otherwise
+// wait for it
+bool PeerControl::CheckSendBudget() {
+  size_t needed;
+  {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    needed = std::max<size_t>(budget_needed_, 1);
+  }
+
+  if ( SendBudget::available(needed) ) return true;
+
+  SendBudget::Wait(this, needed);
+  return false;
+}
+
+void PeerControl::UpdateSendBudget() {
+  size_t amount = static_cast<size_t>(BufferedAmount());
+  {
+    std::lock_guard<std::mutex> guard(scheduler_lock_);
+    amount += scheduler_.bytes();
+  }
+
+  long long delta;
+  {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    delta = static_cast<long long>(amount) - static_cast<long long>(budget_reserved_);
+    budget_reserved_ = amount;
+  }
+
+  if ( delta != 0 ) SendBudget::Adjust(delta);
+}
+
+void PeerControl::ReleaseSendBudget() {
+  SendBudget::Unwait(this);
+
+  size_t reserved;
+  {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    reserved = budget_reserved_;
+    budget_reserved_ = 0;
+    local_buffered_ = 0;
+    local_needed_ = 0;
+  }
+
+  if ( reserved > 0 ) SendBudget::Adjust(-static_cast<long long>(reserved));
+}
+
+void PeerControl::OnSendBudgetAvailable() {
+  // Called with the lock of SendBudget held, on any thread
+  thread_->Post(RTC_FROM_HERE, this, MSG_SEND_BUDGET_AVAILABLE);
 }
 
 bool PeerControl::IsWritable() {
@@ -86,9 +305,35 @@ bool PeerControl::IsWritable() {
     return false;
   }
 
+  if ( !CheckSendBudget() ) return false;
+
+  if ( IsLocal() ) {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    if ( local_buffered_ < setting_.send_buffer_size_ ) return true;
+
+    // Emitted by OnLocalDelivered()
+    local_needed_ = std::max<size_t>(local_needed_, 1);
+    return false;
+  }
+
+  if ( setting_.send_scheduler_ ) {
+    std::lock_guard<std::mutex> guard(scheduler_lock_);
+    if ( !scheduler_.empty() ) return false;
+  }
+
   return local_data_channel_->IsWritable();
 }
 
+uint64_t PeerControl::BufferedAmount() {
+  if ( IsLocal() ) {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    return local_buffered_;
+  }
+
+  if ( local_data_channel_ == nullptr ) return 0;
+  return local_data_channel_->BufferedAmount();
+}
+
 void PeerControl::Close(const CloseCode code) {
 //  LOG_F_IF(state_ != pOpen, WARNING) << "Closing peer when it is not opened";
 
@@ -97,7 +342,55 @@ void PeerControl::Close(const CloseCode code) {
     return;
   }
 
+  CloseInternal();
+  control_->OnPeerClose(remote_id_, code);
+}
+
+//
+// A remote peer in the same process could hold the last reference of this
+// peer after Control has been deleted. Close it and detach the data channels
+// so nothing calls back into Control.
+//
+
+void PeerControl::Shutdown() {
+  // A pooled peer is not opened, but it could have registered for an offer
+  CloseInternal();
+
+  DeletePeerConnection();
+  control_ = nullptr;
+  LOG_F( INFO ) << "Done";
+}
+
+void PeerControl::CloseInternal() {
   state_ = pClosing;
+  pending_candidates_.clear();
+  local_pending_.clear();
+
+  {
+    std::lock_guard<std::mutex> guard(scheduler_lock_);
+    scheduler_.Clear();
+  }
+
+  ReleaseSendBudget();
+
+  //
+  // Notify a remote peer in the same process. It breaks the reference cycle
+  // between two peers as well.
+  //
+
+  LocalTransport::Unregister(local_token_);
+  local_token_.clear();
+
+  rtc::scoped_refptr<PeerControl> remote;
+  {
+    std::lock_guard<std::mutex> guard(local_lock_);
+    remote.swap(local_remote_);
+  }
+
+  if ( remote ) {
+    remote->thread_->Post(RTC_FROM_HERE, remote.get(), MSG_LOCAL_CLOSE,
+                          new LocalMessageData(remote, nullptr, 0));
+  }
 
   LOG_F( INFO ) << "Close data-channel of remote_id_ " << remote_id_;
 
@@ -114,8 +407,6 @@ void PeerControl::Close(const CloseCode code) {
   }
 
   state_ = pClosed;
-  control_->OnPeerClose(remote_id_, code);
-
 }
 
 
@@ -123,6 +414,8 @@ void PeerControl::CreateOffer(const webrtc::MediaConstraintsInterface* constrain
   RTC_DCHECK( state_ == pClosed );
 
   state_ = pConnecting;
+  connecting_ms_ = rtc::TimeMillis();
+  offerer_ = true;
   peer_connection_->CreateOffer(this, constraints);
   LOG_F( INFO ) << "Done";
 }
@@ -132,12 +425,24 @@ void PeerControl::CreateAnswer(const webrtc::MediaConstraintsInterface* constrai
   RTC_DCHECK( state_ == pClosed );
 
   state_ = pConnecting;
+  connecting_ms_ = rtc::TimeMillis();
   peer_connection_->CreateAnswer(this, constraints);
   LOG_F( INFO ) << "Done";
 }
 
 
 void PeerControl::ReceiveOfferSdp(const string& sdp) {
+  MemoryScope memory_scope(MEMORY_PEER);
+
+  // An offer of ICE restart from the remote peer
+  if ( state_ == pOpen ) {
+    renegotiating_ = true;
+    SetRemoteDescription(webrtc::SessionDescriptionInterface::kOffer, sdp);
+    peer_connection_->CreateAnswer(this, NULL);
+    LOG_F( INFO ) << "Done, renegotiation";
+    return;
+  }
+
   RTC_DCHECK( state_ == pClosed);
   SetRemoteDescription(webrtc::SessionDescriptionInterface::kOffer, sdp);
   CreateAnswer(NULL);
@@ -146,16 +451,162 @@ void PeerControl::ReceiveOfferSdp(const string& sdp) {
 
 
 void PeerControl::ReceiveAnswerSdp(const string& sdp) {
-  RTC_DCHECK( state_ == pConnecting );
+  RTC_DCHECK( state_ == pConnecting || renegotiating_ );
+  MemoryScope memory_scope(MEMORY_PEER);
+  renegotiating_ = false;
   SetRemoteDescription(webrtc::SessionDescriptionInterface::kAnswer, sdp);
   LOG_F( INFO ) << "Done";
 }
 
+//
+// In-process transport
+//  1. An offerer registers itself and sends the token with 'offersdp'
+//  2. If the token is found, an answerer skips the peer connection and
+//     sends its own token with 'answersdp' instead of sdp
+//  3. The offerer finds the answerer and releases the peer connection
+//
+
+bool PeerControl::ReceiveLocalOffer(const string& token) {
+  RTC_DCHECK( state_ == pClosed );
+
+  rtc::scoped_refptr<PeerControl> remote = LocalTransport::Find(token);
+  if ( !remote ) return false;
+
+  local_token_ = LocalTransport::Register(this);
+  {
+    std::lock_guard<std::mutex> guard(local_lock_);
+    local_remote_ = remote;
+  }
+
+  state_ = pConnecting;
+  connecting_ms_ = rtc::TimeMillis();
+
+  Json::Value data;
+  data["local"] = local_token_;
+  control_->SendCommand(remote_id_, "answersdp", data);
+
+  OpenLocal();
+  LOG_F( INFO ) << "Done";
+  return true;
+}
+
+void PeerControl::ReceiveLocalAnswer(const string& token) {
+  if ( state_ != pConnecting ) {
+    LOG_F( WARNING ) << "Invalid state";
+    return;
+  }
+
+  rtc::scoped_refptr<PeerControl> remote = LocalTransport::Find(token);
+  if ( !remote ) {
+    LOG_F( LERROR ) << "Local peer not found, " << remote_id_;
+    control_->ClosePeer( remote_id_, CLOSE_ABNORMAL, FORCE_QUEUING_ON );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(local_lock_);
+    local_remote_ = remote;
+  }
+
+  // Data goes through the in-process transport
+  pending_candidates_.clear();
+  DeletePeerConnection();
+
+  OpenLocal();
+  LOG_F( INFO ) << "Done";
+}
+
+//
+// Data of the in-process transport is limited like a data channel. Bytes
+// posted to the remote peer count against send_buffer_size_ and SendBudget
+// until the remote peer handles them, then "writable" is emitted if a send
+// has failed.
+//
+
+bool PeerControl::SendLocal(rtc::scoped_refptr<PeerControl> remote,
+                            const char* buffer, const size_t size) {
+  if ( !ReserveSendBudget(size) ) {
+    LOG_F( WARNING ) << "Send budget is exhausted, peer is " << remote_id_;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    if ( local_buffered_ + size > setting_.send_buffer_size_ ) {
+      local_needed_ = size;
+      budget_reserved_ -= std::min(budget_reserved_, size);
+    }
+    else {
+      local_buffered_ += size;
+      local_needed_ = 0;
+      remote->thread_->Post(RTC_FROM_HERE, remote.get(), MSG_LOCAL_MESSAGE,
+                            new LocalMessageData(remote, buffer, size, this));
+      return true;
+    }
+  }
+
+  LOG_F( WARNING ) << "Send buffer is full, peer is " << remote_id_;
+  SendBudget::Adjust(-static_cast<long long>(size));
+  return false;
+}
+
+// Called when the remote peer has handled or dropped a message
+void PeerControl::OnLocalDelivered(const size_t size) {
+  size_t released;
+  bool writable = false;
+  {
+    std::lock_guard<std::mutex> guard(budget_lock_);
+    local_buffered_ -= std::min(local_buffered_, size);
+
+    // Nothing to release if this peer has been closed
+    released = std::min(budget_reserved_, size);
+    budget_reserved_ -= released;
+
+    if ( local_needed_ > 0 &&
+         local_buffered_ + local_needed_ <= setting_.send_buffer_size_ ) {
+      local_needed_ = 0;
+      writable = true;
+    }
+  }
+
+  if ( released > 0 ) SendBudget::Adjust(-static_cast<long long>(released));
+  if ( writable ) thread_->Post(RTC_FROM_HERE, this, MSG_LOCAL_WRITABLE);
+}
+
+bool PeerControl::IsLocal() {
+  std::lock_guard<std::mutex> guard(local_lock_);
+  return local_remote_ != nullptr;
+}
+
+void PeerControl::OpenLocal() {
+  LOG_F( INFO ) << "Peers are connected in process, " << remote_id_ << " and " << local_id_;
+
+  state_ = pOpen;
+  last_activity_ms_ = rtc::TimeMillis();
+  control_->OnPeerConnect(remote_id_);
+  control_->OnPeerWritable(local_id_);
+
+  // Deliver messages that arrived earlier than 'answersdp'
+  std::vector<string> pending;
+  pending.swap(local_pending_);
+
+  for ( auto& message : pending ) {
+    if ( state_ != pOpen ) break;
+    control_->OnPeerMessage(remote_id_, message.data(), message.size());
+  }
+}
+
+rtc::scoped_refptr<PeerControl> PeerControl::local_remote() {
+  std::lock_guard<std::mutex> guard(local_lock_);
+  return local_remote_;
+}
+
 void PeerControl::OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel) {
   LOG_F( INFO ) << "remote_id_ is " << remote_id_;
 
   PeerDataChannelObserver* Observer = new PeerDataChannelObserver(channel);
   remote_data_channel_ = std::unique_ptr<PeerDataChannelObserver>(Observer);
+  remote_data_channel_->set_max_buffer_size(setting_.send_buffer_size_);
   Attach(remote_data_channel_.get());
 
   LOG_F( INFO ) << "Done";
@@ -184,9 +635,14 @@ void PeerControl::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConn
 
   case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionDisconnected:
     //
-    // Peer disconnected and notify it to control that makes control trigger closing
+    // Peer disconnected and notify it to control that makes control trigger closing,
+    // or restart ICE if the grace period is set
     //
     LOG_F( INFO ) << "new_state is " << "kIceConnectionDisconnected";
+    if ( setting_.ice_restart_grace_ms_ > 0 && state_ == pOpen ) {
+      BeginIceRestart();
+      break;
+    }
     OnPeerDisconnected();
     break;
   case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionNew:
@@ -197,12 +653,24 @@ void PeerControl::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConn
     break;
   case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionConnected:
     LOG_F( INFO ) << "new_state is " << "kIceConnectionConnected";
+    ice_failed_ms_ = 0;
+    EndIceRestart();
     break;
   case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionCompleted:
     LOG_F( INFO ) << "new_state is " << "kIceConnectionCompleted";
+    ice_failed_ms_ = 0;
+    EndIceRestart();
     break;
   case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionFailed:
+    //
+    // Control evicts the peer by ice_failed_timeout_ms_
+    //
     LOG_F( INFO ) << "new_state is " << "kIceConnectionFailed";
+    if ( setting_.ice_restart_grace_ms_ > 0 && state_ == pOpen ) {
+      BeginIceRestart();
+      break;
+    }
+    ice_failed_ms_ = rtc::TimeMillis();
     break;
   default:
     break;
@@ -210,7 +678,52 @@ void PeerControl::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConn
 }
 
 
+//
+// ICE restart
+//  The offerer creates an offer with ice_restart, and the answerer answers
+//  it as renegotiation of the existing peer. DTLS and SCTP association are
+//  kept, so the data channel stays open during the grace period.
+//
+
+void PeerControl::BeginIceRestart() {
+
+  if ( !ice_restarting_ ) {
+    ice_restarting_ = true;
+    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, setting_.ice_restart_grace_ms_,
+                                        this, MSG_ICE_RESTART_TIMEOUT);
+  }
+
+  if ( !offerer_ || renegotiating_ || peer_connection_ == nullptr ) {
+    LOG_F( INFO ) << "Waiting for ICE restart, peer is " << remote_id_;
+    return;
+  }
+
+  renegotiating_ = true;
+
+  webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+  options.ice_restart = true;
+  peer_connection_->CreateOffer(this, options);
+
+  LOG_F( INFO ) << "Restart ICE, peer is " << remote_id_;
+}
+
+void PeerControl::EndIceRestart() {
+  if ( !ice_restarting_ ) return;
+
+  ice_restarting_ = false;
+  rtc::Thread::Current()->Clear(this, MSG_ICE_RESTART_TIMEOUT);
+  LOG_F( INFO ) << "ICE connection recovered, peer is " << remote_id_;
+}
+
+void PeerControl::OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) {
+  if (new_state == webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+    // No more candidates, so don't wait for the batching window
+    SendIceCandidates();
+  }
+}
+
 void PeerControl::OnIceCandidate(const webrtc::IceCandidateInterface* candidate) {
+  MemoryScope memory_scope(MEMORY_PEER);
   string sdp;
   if (!candidate->ToString(&sdp)) return;
 
@@ -220,11 +733,88 @@ void PeerControl::OnIceCandidate(const webrtc::IceCandidateInterface* candidate)
   data["sdp_mline_index"] = candidate->sdp_mline_index();
   data["candidate"] = sdp;
 
-  control_->SendCommand(remote_id_, "ice_candidate", data);
-  LOG_F( INFO ) << "Done";
+  if (setting_.ice_candidate_batch_ms_ <= 0 || !remote_batching_) {
+    control_->SendCommand(remote_id_, "ice_candidate", data);
+    LOG_F( INFO ) << "Done";
+    return;
+  }
+
+  //
+  // Coalesce candidates within the batching window
+  //
+
+  if (pending_candidates_.empty()) {
+    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, setting_.ice_candidate_batch_ms_,
+                                        this, MSG_SEND_ICE_CANDIDATES);
+  }
+
+  pending_candidates_.append(data);
+  LOG_F( INFO ) << "Queued";
+}
+
+void PeerControl::SendIceCandidates() {
+  if (pending_candidates_.empty()) return;
+
+  Json::Value candidates(Json::arrayValue);
+  candidates.swap(pending_candidates_);
+
+  if (candidates.size() == 1) {
+    control_->SendCommand(remote_id_, "ice_candidate", candidates[0]);
+  }
+  else {
+    Json::Value data;
+    data["candidates"] = candidates;
+    control_->SendCommand(remote_id_, "ice_candidates", data);
+  }
+
+  LOG_F( INFO ) << "Done, candidates is " << candidates.size();
+}
+
+void PeerControl::OnMessage(rtc::Message* msg) {
+  switch (msg->message_id) {
+  case MSG_SEND_ICE_CANDIDATES:
+    SendIceCandidates();
+    break;
+  case MSG_LOCAL_MESSAGE: {
+    LocalMessageData* data = static_cast<LocalMessageData*>(msg->pdata);
+    if ( state_ == pOpen ) {
+      last_activity_ms_ = rtc::TimeMillis();
+      control_->OnPeerMessage(remote_id_, data->data_.data(), data->data_.size());
+    }
+    else if ( state_ == pConnecting ) {
+      local_pending_.push_back(data->data_);
+    }
+    delete data;
+    break;
+  }
+  case MSG_DRAIN_SEND_QUEUE:
+    DrainSendQueue();
+    break;
+  case MSG_LOCAL_WRITABLE:
+  case MSG_SEND_BUDGET_AVAILABLE:
+    if ( state_ != pOpen ) break;
+    if ( setting_.send_scheduler_ ) DrainSendQueue();
+    if ( IsWritable() ) control_->OnPeerWritable( remote_id_ );
+    break;
+  case MSG_ICE_RESTART_TIMEOUT:
+    LOG_F( WARNING ) << "ICE restart timeout, peer is " << remote_id_;
+    ice_restarting_ = false;
+    renegotiating_ = false;
+    OnPeerDisconnected();
+    break;
+  case MSG_LOCAL_CLOSE:
+    // The message data could hold the last reference of this peer
+    OnPeerDisconnected();
+    delete msg->pdata;
+    break;
+  default:
+    LOG_F( WARNING ) << "Unknown message";
+    break;
+  }
 }
 
 void PeerControl::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
+  MemoryScope memory_scope(MEMORY_PEER);
 
   // This callback should take the ownership of |desc|.
   std::unique_ptr<webrtc::SessionDescriptionInterface> owned_desc(desc);
@@ -232,7 +822,7 @@ void PeerControl::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
 
   if (!desc->ToString(&sdp)) return;
 
-  if ( state_ != pConnecting ) {
+  if ( state_ != pConnecting && !renegotiating_ ) {
     LOG_F( WARNING ) << "Invalid state";
     return;
   }
@@ -244,12 +834,23 @@ void PeerControl::OnSuccess(webrtc::SessionDescriptionInterface* desc) {
   // Send message to other peer
   Json::Value data;
 
+  // Advertise that this peer accepts 'ice_candidates' command
+  data["ice_candidates"] = true;
+
   if (desc->type() == webrtc::SessionDescriptionInterface::kOffer) {
     data["sdp"] = sdp;
+
+    // A remote peer in the same process may answer with the token
+    if (setting_.local_transport_ && !renegotiating_) {
+      if (local_token_.empty()) local_token_ = LocalTransport::Register(this);
+      data["local"] = local_token_;
+    }
+
     control_->SendCommand(remote_id_, "offersdp", data);
   }
   else if (desc->type() == webrtc::SessionDescriptionInterface::kAnswer) {
     data["sdp"] = sdp;
+    renegotiating_ = false;
     control_->SendCommand(remote_id_, "answersdp", data);
   }
   LOG_F( INFO ) << "Done";
@@ -267,6 +868,7 @@ void PeerControl::OnPeerOpened() {
  
     // Fianlly, data-channel has been opened.
     state_ = pOpen;
+    last_activity_ms_ = rtc::TimeMillis();
     control_->OnPeerConnect(remote_id_);
     control_->OnPeerWritable(local_id_);
   }
@@ -297,14 +899,28 @@ void PeerControl::OnPeerDisconnected() {
 
 void PeerControl::OnPeerMessage(const webrtc::DataBuffer& buffer) {
   string data;
+  last_activity_ms_ = rtc::TimeMillis();
   control_->OnPeerMessage(remote_id_, buffer.data.data<char>(), buffer.data.size());
 }
 
 void PeerControl::OnBufferedAmountChange(const uint64_t previous_amount) {
+  UpdateSendBudget();
+
+  // Writable only when the send queues have been drained as well
+  if ( setting_.send_scheduler_ ) {
+    DrainSendQueue();
+    std::lock_guard<std::mutex> guard(scheduler_lock_);
+    if ( !scheduler_.empty() ) return;
+  }
+
   if ( !local_data_channel_->IsWritable() ) {
     LOG_F( LERROR ) << "local_data_channel_ is not writable";
     return;
   }
+
+  // Emitted by MSG_SEND_BUDGET_AVAILABLE instead
+  if ( !CheckSendBudget() ) return;
+
   control_->OnPeerWritable( remote_id_ );
 }
 
@@ -327,6 +943,7 @@ bool PeerControl::CreateDataChannel(
     return false;
   }
 
+  local_data_channel_->set_max_buffer_size(setting_.send_buffer_size_);
   Attach(local_data_channel_.get());
 
   LOG_F( INFO ) << "Done";
@@ -335,6 +952,10 @@ bool PeerControl::CreateDataChannel(
 
 void PeerControl::AddIceCandidate(const string& sdp_mid, int sdp_mline_index,
                                   const string& candidate) {
+  MemoryScope memory_scope(MEMORY_PEER);
+
+  // Candidates of the peer connection released by the in-process transport
+  if ( peer_connection_ == nullptr ) return;
 
   std::unique_ptr<webrtc::IceCandidateInterface> owned_candidate(
     webrtc::CreateIceCandidate(sdp_mid, sdp_mline_index, candidate, NULL));
@@ -354,9 +975,25 @@ bool PeerControl::CreatePeerConnection() {
 
   // CreatePeerConnection with RTCConfiguration.
   webrtc::PeerConnectionInterface::RTCConfiguration config;
-  webrtc::PeerConnectionInterface::IceServer ice_server;
-  ice_server.uri = "stun:stun.l.google.com:19302";
-  config.servers.push_back(ice_server);
+
+  if (setting_.ice_mode_ == PeerSetting::ice_local) {
+    // Host candidates only. Loopback network is enabled by Control.
+    config.tcp_candidate_policy =
+        webrtc::PeerConnectionInterface::kTcpCandidatePolicyDisabled;
+  }
+  else {
+    config.servers = setting_.ice_servers_;
+  }
+
+  // Gather candidates before the local description is set
+  config.ice_candidate_pool_size = setting_.ice_candidate_pool_size_;
+
+  // Without a certificate, a key pair is generated for this peer connection
+  if (setting_.shared_certificate_) {
+    rtc::scoped_refptr<rtc::RTCCertificate> certificate =
+        SharedCertificate::Get(setting_.certificate_);
+    if (certificate) config.certificates.push_back(certificate);
+  }
 
   peer_connection_ = peer_connection_factory_->CreatePeerConnection(
     config, &constraints, NULL, NULL, this);
@@ -484,10 +1121,11 @@ void PeerDataChannelObserver::OnMessage(const webrtc::DataBuffer& buffer) {
 }
 
 bool PeerDataChannelObserver::Send(const char* buffer, const size_t size) {
+  MemoryScope memory_scope(MEMORY_CHANNEL);
   rtc::CopyOnWriteBuffer rtcbuffer(buffer, size);
   webrtc::DataBuffer databuffer(rtcbuffer, true);
 
-  if ( channel_->buffered_amount() >= max_buffer_size_ ) {
+  if ( channel_->buffered_amount() + size > max_buffer_size_ ) {
     LOG_F( LERROR ) << "Buffer is full";
     return false;
   }
@@ -496,6 +1134,7 @@ bool PeerDataChannelObserver::Send(const char* buffer, const size_t size) {
 }
 
 bool PeerDataChannelObserver::SyncSend(const char* buffer, const size_t size) {
+  MemoryScope memory_scope(MEMORY_CHANNEL);
   rtc::CopyOnWriteBuffer rtcbuffer(buffer, size);
   webrtc::DataBuffer databuffer(rtcbuffer, true);
 
@@ -7,18 +7,111 @@
 #ifndef __PEERAPI_PEER_H__
 #define __PEERAPI_PEER_H__
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <memory>
+#include <vector>
 #include "webrtc/api/datachannelinterface.h"
 #include "webrtc/api/peerconnectioninterface.h"
 #include "webrtc/base/scoped_ref_ptr.h"
 #include "webrtc/api/jsep.h"
 #include "webrtc/base/json.h"
+#include "webrtc/base/messagehandler.h"
+#include "webrtc/base/thread.h"
 #include "common.h"
+#include "certificate.h"
+#include "sendscheduler.h"
+#include "sendbudget.h"
 
 namespace peerapi {
 
+//
+// struct PeerSetting
+//
+// Settings of PeerControl. Control applies the same setting to all peers.
+//
+
+struct PeerSetting {
+  enum IceMode {
+    ice_default,    // Gather candidates with ice_servers_
+    ice_local       // Host and loopback candidates only, without STUN/TURN
+  };
+
+  PeerSetting();
+
+  webrtc::PeerConnectionInterface::IceServers ice_servers_;
+  IceMode ice_mode_ = ice_default;
+
+  // Use the in-process transport if a remote peer is in the same process
+  bool local_transport_ = true;
+
+  // A number of peers created ahead of connections, and a number of ICE
+  // candidates gathered ahead by each peer connection.
+  int peer_pool_size_ = 0;
+  int ice_candidate_pool_size_ = 0;
+
+  // Peers of a 'createoffer' command are created in batches of
+  // offer_batch_size_. offer_concurrency_ limits the number of connecting
+  // peers, 0 is unlimited.
+  int offer_batch_size_ = 8;
+  int offer_concurrency_ = 0;
+
+  // Admission control. New peers over the limits are rejected, 0 is unlimited.
+  //  max_peers_: Peers connected or connecting
+  //  max_handshakes_: Peers connecting
+  //  accept_rate_/accept_burst_: New peers per second
+  int max_peers_ = 0;
+  int max_handshakes_ = 0;
+  double accept_rate_ = 0;
+  double accept_burst_ = 1;
+
+  // Sweeper evicts stale peers every sweep_interval_ms_. Idle and handshake
+  // timeouts of 0 are disabled.
+  //  idle_timeout_ms_: An opened peer without sending or receiving data
+  //  handshake_timeout_ms_: A peer stuck in connecting
+  //  ice_failed_timeout_ms_: A peer since ICE connection has failed. 0 evicts
+  //                          it at the next sweep.
+  //  max_peer_memory_: Estimated memory of peers in bytes. Least recently
+  //                    active peers are evicted over it.
+  int sweep_interval_ms_ = 1000;
+  int idle_timeout_ms_ = 0;
+  int handshake_timeout_ms_ = 30000;
+  int ice_failed_timeout_ms_ = 0;
+  size_t max_peer_memory_ = 0;
+
+  // If ICE connection is disconnected or failed, restart ICE by
+  // renegotiation and close the peer only if it doesn't recover within
+  // this time in milliseconds. The data channel and its buffered data are
+  // kept. 0 closes the peer immediately on disconnection.
+  int ice_restart_grace_ms_ = 0;
+
+  // Messages are queued by priority and passed to the data channel while
+  // its buffered amount is below send_watermark_
+  bool send_scheduler_ = false;
+  size_t send_watermark_ = 256 * 1024;
+  int send_weights_[SendScheduler::kPriorities] = { 16, 4, 1 };
+
+  // Limits of data waiting to be sent.
+  //  send_buffer_size_: Buffered data of the data channel of a peer, and
+  //                     its send queues as well
+  //  send_buffer_budget_: All peers of the process. 0 is unlimited and a
+  //                       negative value keeps the current budget. It is
+  //                       ignored while other peers hold a different one.
+  size_t send_buffer_size_ = 16 * 1024 * 1024;
+  long long send_buffer_budget_ = -1;
+
+  // Use a DTLS certificate shared by all peer connections in the process
+  bool shared_certificate_ = true;
+  SharedCertificate::Setting certificate_;
+
+  // Local ice candidates gathered within this window (in milliseconds) are
+  // sent as one 'ice_candidates' command. 0 sends each candidate immediately.
+  // Candidates are batched only if the remote peer has advertised the
+  // command in its offer or answer, so older versions get each candidate.
+  int ice_candidate_batch_ms_ = 50;
+};
+
 //
 // class PeerObserver
 //
@@ -43,7 +136,9 @@ class PeerDataChannelObserver;
 class PeerControl
       : public webrtc::CreateSessionDescriptionObserver,
         public webrtc::PeerConnectionObserver,
-        public sigslot::has_slots<> {
+        public sigslot::has_slots<>,
+        public rtc::MessageHandler,
+        public SendBudgetObserver {
 
 public:
 
@@ -53,7 +148,8 @@ public:
                        const string remote_session_id,
                        PeerObserver* observer,
                        rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
-                           peer_connection_factory);
+                           peer_connection_factory,
+                       const PeerSetting& setting = PeerSetting());
 
   ~PeerControl();
 
@@ -66,18 +162,34 @@ public:
 
   const string& local_id() const { return local_id_; }
   const string& remote_id() const { return remote_id_; }
+
+  // A peer created ahead in the pool has no remote id until it is taken
+  void set_remote_id(const string& remote_id) { remote_id_ = remote_id; }
+
+  // The remote peer accepts 'ice_candidates' command
+  void set_remote_batching(bool batching) { remote_batching_ = batching; }
   const PeerState state() const { return state_ ; }
 
+  // Timestamps of rtc::TimeMillis(). ice_failed_ms() is 0 unless ICE has failed.
+  int64_t connecting_ms() const { return connecting_ms_; }
+  int64_t last_activity_ms() const { return last_activity_ms_; }
+  int64_t ice_failed_ms() const { return ice_failed_ms_; }
+  uint64_t BufferedAmount();
+
   //
   // APIs
   //
 
   bool Initialize();
-  bool Send(const char* buffer, const size_t size);
+  bool Send(const char* buffer, const size_t size,
+            const SendPriority priority = PRIORITY_NORMAL);
   bool SyncSend(const char* buffer, const size_t size);
   bool IsWritable();
   void Close(const CloseCode code);
 
+  // Closes without notifying the observer, when Control is being deleted
+  void Shutdown();
+
   //
   // PeerConnection
   //
@@ -89,6 +201,14 @@ public:
   void ReceiveOfferSdp(const string& sdp);
   void ReceiveAnswerSdp(const string& sdp);
 
+  //
+  // In-process transport
+  //
+
+  bool ReceiveLocalOffer(const string& token);
+  void ReceiveLocalAnswer(const string& token);
+  bool IsLocal();
+
   //
   // PeerConnectionObserver implementation.
   //
@@ -99,7 +219,7 @@ public:
   void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel) override;
   void OnRenegotiationNeeded() override {}
   void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state) override; 
-  void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override {}
+  void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
   void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
   void OnIceConnectionReceivingChange(bool receiving) override {}
 
@@ -119,6 +239,9 @@ public:
   void OnPeerMessage(const webrtc::DataBuffer& buffer);
   void OnBufferedAmountChange(const uint64_t previous_amount);
 
+  // implements the MessageHandler interface
+  void OnMessage(rtc::Message* msg) override;
+
 protected:
 
   bool CreatePeerConnection();
@@ -129,6 +252,22 @@ protected:
   void SetRemoteDescription(const string& type, const string& sdp);
   void Attach(PeerDataChannelObserver* datachannel);
   void Detach(PeerDataChannelObserver* datachannel);
+  void CloseInternal();
+  void SendIceCandidates();
+  void DrainSendQueue();
+  bool ReserveSendBudget(const size_t size);
+  bool CheckSendBudget();
+  void UpdateSendBudget();
+  void ReleaseSendBudget();
+
+  // implements the SendBudgetObserver interface
+  void OnSendBudgetAvailable() override;
+  void BeginIceRestart();
+  void EndIceRestart();
+  void OpenLocal();
+  bool SendLocal(rtc::scoped_refptr<PeerControl> remote, const char* buffer, const size_t size);
+  void OnLocalDelivered(const size_t size);
+  rtc::scoped_refptr<PeerControl> local_remote();
 
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peer_connection_factory_;
@@ -140,7 +279,78 @@ protected:
 
   PeerState state_;
 
+  int64_t connecting_ms_;
+  std::atomic<int64_t> last_activity_ms_;
+  int64_t ice_failed_ms_;
+
+  // ICE restart
+  //  offerer_: This peer has created the first offer, and offers again
+  //  renegotiating_: An offer or answer of ICE restart is in progress
+  //  ice_restarting_: Waiting for ICE connection within the grace period
+  bool offerer_;
+  bool renegotiating_;
+  bool ice_restarting_;
+
+  // Send queues by priority. Guarded by scheduler_lock_, drained on thread_
+  SendScheduler scheduler_;
+  std::mutex scheduler_lock_;
+  std::atomic<bool> drain_posted_;
+  bool draining_;
+
+  // Bytes of SendBudget used by this peer, and needed by the last failed
+  // send. Guarded by budget_lock_
+  size_t budget_reserved_;
+  size_t budget_needed_;
+  std::mutex budget_lock_;
+
   PeerObserver* control_;
+  PeerSetting setting_;
+
+  // Local ice candidates waiting to be sent
+  Json::Value pending_candidates_;
+  bool remote_batching_;
+
+  // In-process transport
+  //  local_token_: A token of this peer in LocalTransport
+  //  local_remote_: A remote peer in the same process. Guarded by local_lock_
+  //  local_pending_: Messages received before this peer is opened
+  //  local_buffered_: Bytes sent but not delivered to the remote peer yet,
+  //                   limited by send_buffer_size_. Guarded by budget_lock_
+  //  local_needed_: Bytes of the last send failed by the limit. "writable"
+  //                 is emitted when they fit. Guarded by budget_lock_
+  rtc::Thread* thread_;
+  string local_token_;
+  rtc::scoped_refptr<PeerControl> local_remote_;
+  std::mutex local_lock_;
+  std::vector<string> local_pending_;
+  size_t local_buffered_;
+  size_t local_needed_;
+
+private:
+
+  enum {
+    MSG_SEND_ICE_CANDIDATES,        // Batching window of ice candidates has passed
+    MSG_LOCAL_MESSAGE,              // Message from a peer in the same process
+    MSG_LOCAL_CLOSE,                // A peer in the same process has been closed
+    MSG_ICE_RESTART_TIMEOUT,        // ICE connection hasn't recovered within the grace period
+    MSG_DRAIN_SEND_QUEUE,           // Pass queued messages to the data channel
+    MSG_SEND_BUDGET_AVAILABLE,      // Send budget of the process has been freed
+    MSG_LOCAL_WRITABLE              // A peer in the same process has received sent data
+  };
+
+  // The bytes are returned to sender_ when the message is handled or
+  // dropped with the queue of a closed peer
+  struct LocalMessageData : public rtc::MessageData {
+    LocalMessageData(rtc::scoped_refptr<PeerControl> ref, const char* buffer, const size_t size,
+                     rtc::scoped_refptr<PeerControl> sender = nullptr)
+        : ref_(ref), data_(buffer, size), sender_(sender) {}
+    ~LocalMessageData() {
+      if ( sender_ ) sender_->OnLocalDelivered(data_.size());
+    }
+    rtc::scoped_refptr<PeerControl> ref_;
+    string data_;
+    rtc::scoped_refptr<PeerControl> sender_;
+  };
 
 };
 
@@ -165,6 +375,7 @@ public:
   uint64_t BufferedAmount();
   bool IsWritable();
   const webrtc::DataChannelInterface::DataState state() const;
+  void set_max_buffer_size(const size_t size) { max_buffer_size_ = size; }
 
   // sigslots
   sigslot::signal0<> SignalOnOpen_;
@@ -176,7 +387,7 @@ protected:
 
 private:
 
-  const size_t max_buffer_size_ = 16 * 1024 * 1024;
+  size_t max_buffer_size_ = 16 * 1024 * 1024;
 
   rtc::scoped_refptr<webrtc::DataChannelInterface> channel_;
   webrtc::DataChannelInterface::DataState state_;
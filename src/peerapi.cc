@@ -10,6 +10,7 @@
 #include "peerapi.h"
 #include "control.h"
 #include "logging.h"
+#include "memoryaccounting.h"
 
 namespace peerapi {
 
@@ -43,7 +44,11 @@ Peer::~Peer() {
 }
 
 void Peer::Run() {
-  rtc::ThreadManager::Instance()->CurrentThread()->Run();
+  rtc::Thread* thread = rtc::ThreadManager::Instance()->CurrentThread();
+  thread->Run();
+
+  // Run() again after Stop() processes messages as well
+  thread->Restart();
   LOG_F( INFO ) << "Done";
 }
 
@@ -65,7 +70,12 @@ void Peer::Open() {
   //
 
   if ( signal_ == nullptr ) {
-    signal_ = std::make_shared<peerapi::Signal>( setting_.signal_uri_ );
+    std::shared_ptr<peerapi::SignalIoService> io_service;
+    if ( setting_.signal_threads_ > 0 ) {
+      io_service = peerapi::SignalIoService::Shared( setting_.signal_threads_ );
+    }
+    signal_ = std::make_shared<peerapi::Signal>( setting_.signal_uri_, io_service );
+    ApplySignalSetting();
   }
 
   //
@@ -80,6 +90,8 @@ void Peer::Open() {
     return;
   }
 
+  ApplyPeerSetting();
+
   //
   // Initialize peer connection
   //
@@ -101,6 +113,11 @@ void Peer::Open() {
 
 void Peer::Close( const string peer_id ) {
 
+  if ( control_.get() == nullptr ) {
+    LOG_F( WARNING ) << "Close a peer that is not opened";
+    return;
+  }
+
   if ( peer_id.empty() || peer_id == peer_id_ ) {
     control_->Close( CLOSE_NORMAL, FORCE_QUEUING_ON );
     signal_->SyncClose();
@@ -111,6 +128,21 @@ void Peer::Close( const string peer_id ) {
   LOG_F( INFO ) << "Done";
 }
 
+Peer::SignalStats Peer::GetSignalStats() {
+  SignalStats stats;
+
+  if ( signal_ == nullptr ) return stats;
+
+  Signal::ReconnectStats reconnect = signal_->reconnect_stats();
+  stats.attempts_ = reconnect.attempts;
+  stats.failures_ = reconnect.failures;
+  stats.disconnects_ = reconnect.disconnects;
+  stats.resumed_ = reconnect.resumed;
+  stats.throttled_ = reconnect.throttled;
+  stats.last_delay_ = reconnect.last_delay;
+  return stats;
+}
+
 void Peer::Connect( const string peer_id ) {
   control_->Connect( peer_id );
   LOG_F( INFO ) << "Done, peer is " << peer_id;
@@ -121,7 +153,8 @@ void Peer::Connect( const string peer_id ) {
 // Send message to destination peer session id
 //
 
-bool Peer::Send( const string& peer_id, const char* data, const size_t size, const bool wait ) {
+bool Peer::Send( const string& peer_id, const char* data, const size_t size, const bool wait,
+                 const SendPriority priority ) {
   if ( wait ) {
 
     //
@@ -132,19 +165,19 @@ bool Peer::Send( const string& peer_id, const char* data, const size_t size, con
     return control_->SyncSend( peer_id, data, size );
   }
   else {
-    control_->Send( peer_id, data, size );
-
     //
-    // Asyncronous send always returns true and
-    // trigger 'close' event with CloseCode if failed
+    // Asyncronous send returns false if the data is not buffered, when
+    // a send buffer or the send budget is full. Wait for 'writable' event
+    // then. It triggers 'close' event with CloseCode if failed later.
     //
 
-    return true;
+    return control_->Send( peer_id, data, size, priority );
   }
 }
 
-bool Peer::Send( const string& peer_id, const string& message, const bool wait  ) {
-  return Send( peer_id, message.c_str(), message.size(), wait );
+bool Peer::Send( const string& peer_id, const string& message, const bool wait,
+                 const SendPriority priority ) {
+  return Send( peer_id, message.c_str(), message.size(), wait, priority );
 }
 
 bool Peer::SetOptions( const string options ) {
@@ -161,6 +194,26 @@ std::string Peer::CreateRandomUuid() {
   return rtc::CreateRandomUuid();
 }
 
+std::vector<Peer::MemoryUsage> Peer::GetMemoryUsage() {
+  std::vector<MemoryUsage> usages;
+
+  if ( !MemoryAccounting::enabled() ) return usages;
+
+  for ( int i = 0; i < MEMORY_TAGS; i++ ) {
+    MemoryTag tag = static_cast<MemoryTag>( i );
+    MemoryCounter counter = MemoryAccounting::Get( tag );
+
+    MemoryUsage usage;
+    usage.subsystem_ = MemoryAccounting::name( tag );
+    usage.bytes_ = counter.bytes_;
+    usage.peak_bytes_ = counter.peak_bytes_;
+    usage.blocks_ = counter.blocks_;
+    usages.push_back( usage );
+  }
+
+  return usages;
+}
+
 //
 // Register Event handler
 //
@@ -295,6 +348,165 @@ void Peer::CallEventHandler( string msg_id, A&& ... args )
 }
 
 
+void Peer::ApplySignalSetting() {
+
+  if ( setting_.reconnect_attempts_ >= 0 ) {
+    signal_->set_reconnect_attempts( setting_.reconnect_attempts_ );
+  }
+
+  if ( setting_.reconnect_delay_ >= 0 ) {
+    signal_->set_reconnect_delay( setting_.reconnect_delay_ );
+  }
+
+  if ( setting_.reconnect_delay_max_ >= 0 ) {
+    signal_->set_reconnect_delay_max( setting_.reconnect_delay_max_ );
+  }
+
+  if ( setting_.reconnect_jitter_ == "none" ) {
+    signal_->set_reconnect_jitter( Signal::jitter_none );
+  }
+  else if ( setting_.reconnect_jitter_ == "equal" ) {
+    signal_->set_reconnect_jitter( Signal::jitter_equal );
+  }
+  else if ( setting_.reconnect_jitter_ == "full" ) {
+    signal_->set_reconnect_jitter( Signal::jitter_full );
+  }
+  else if ( setting_.reconnect_jitter_ == "decorrelated" ) {
+    signal_->set_reconnect_jitter( Signal::jitter_decorrelated );
+  }
+  else if ( !setting_.reconnect_jitter_.empty() ) {
+    LOG_F( WARNING ) << "Unknown reconnect_jitter: " << setting_.reconnect_jitter_;
+  }
+
+  signal_->set_binary_encoding( setting_.signal_binary_ );
+
+  if ( setting_.signal_connect_rate_ >= 0 ) {
+    Signal::SetConnectRate( setting_.signal_connect_rate_, setting_.signal_connect_burst_ );
+  }
+}
+
+void Peer::ApplyPeerSetting() {
+  PeerSetting setting = control_->peer_setting();
+
+  if ( setting_.ice_candidate_batch_ >= 0 ) {
+    setting.ice_candidate_batch_ms_ = setting_.ice_candidate_batch_;
+  }
+
+  setting.local_transport_ = setting_.local_transport_;
+
+  if ( setting_.peer_pool_ >= 0 ) {
+    setting.peer_pool_size_ = setting_.peer_pool_;
+  }
+
+  if ( setting_.ice_candidate_pool_ >= 0 ) {
+    setting.ice_candidate_pool_size_ = setting_.ice_candidate_pool_;
+  }
+
+  if ( setting_.offer_batch_ > 0 ) {
+    setting.offer_batch_size_ = setting_.offer_batch_;
+  }
+
+  if ( setting_.offer_concurrency_ >= 0 ) {
+    setting.offer_concurrency_ = setting_.offer_concurrency_;
+  }
+
+  if ( setting_.max_peers_ >= 0 ) {
+    setting.max_peers_ = setting_.max_peers_;
+  }
+
+  if ( setting_.max_handshakes_ >= 0 ) {
+    setting.max_handshakes_ = setting_.max_handshakes_;
+  }
+
+  if ( setting_.accept_rate_ >= 0 ) {
+    setting.accept_rate_ = setting_.accept_rate_;
+    setting.accept_burst_ = setting_.accept_burst_;
+  }
+
+  if ( setting_.sweep_interval_ >= 0 ) {
+    setting.sweep_interval_ms_ = setting_.sweep_interval_;
+  }
+
+  if ( setting_.idle_timeout_ >= 0 ) {
+    setting.idle_timeout_ms_ = setting_.idle_timeout_;
+  }
+
+  if ( setting_.handshake_timeout_ >= 0 ) {
+    setting.handshake_timeout_ms_ = setting_.handshake_timeout_;
+  }
+
+  if ( setting_.ice_failed_timeout_ >= 0 ) {
+    setting.ice_failed_timeout_ms_ = setting_.ice_failed_timeout_;
+  }
+
+  if ( setting_.ice_restart_grace_ >= 0 ) {
+    setting.ice_restart_grace_ms_ = setting_.ice_restart_grace_;
+  }
+
+  setting.send_scheduler_ = setting_.send_scheduler_;
+
+  if ( setting_.send_watermark_ >= 0 ) {
+    setting.send_watermark_ = static_cast<size_t>( setting_.send_watermark_ );
+  }
+
+  for ( size_t i = 0; i < setting_.send_weights_.size(); i++ ) {
+    setting.send_weights_[i] = setting_.send_weights_[i];
+  }
+
+  if ( setting_.max_peer_memory_ >= 0 ) {
+    setting.max_peer_memory_ = static_cast<size_t>( setting_.max_peer_memory_ );
+  }
+
+  if ( setting_.send_buffer_size_ >= 0 ) {
+    setting.send_buffer_size_ = static_cast<size_t>( setting_.send_buffer_size_ );
+  }
+
+  if ( setting_.send_buffer_budget_ >= 0 ) {
+    setting.send_buffer_budget_ = static_cast<long long>( setting_.send_buffer_budget_ );
+  }
+
+  setting.shared_certificate_ = setting_.dtls_shared_certificate_;
+  setting.certificate_.certificate_file_ = setting_.dtls_certificate_;
+  setting.certificate_.private_key_file_ = setting_.dtls_private_key_;
+
+  if ( setting_.dtls_certificate_rotation_ >= 0 ) {
+    setting.certificate_.rotation_ = setting_.dtls_certificate_rotation_;
+  }
+
+  if ( setting_.dtls_key_type_ == "ecdsa" ) {
+    setting.certificate_.key_type_ = rtc::KT_ECDSA;
+  }
+  else if ( setting_.dtls_key_type_ == "rsa" ) {
+    setting.certificate_.key_type_ = rtc::KT_RSA;
+  }
+  else if ( !setting_.dtls_key_type_.empty() ) {
+    LOG_F( WARNING ) << "Unknown dtls_key_type: " << setting_.dtls_key_type_;
+  }
+
+  if ( setting_.ice_servers_set_ ) {
+    setting.ice_servers_.clear();
+    for ( auto& server : setting_.ice_servers_ ) {
+      webrtc::PeerConnectionInterface::IceServer ice_server;
+      ice_server.urls = server.urls_;
+      ice_server.username = server.username_;
+      ice_server.password = server.password_;
+      setting.ice_servers_.push_back( ice_server );
+    }
+  }
+
+  if ( setting_.ice_mode_ == "local" ) {
+    setting.ice_mode_ = PeerSetting::ice_local;
+  }
+  else if ( setting_.ice_mode_ == "default" ) {
+    setting.ice_mode_ = PeerSetting::ice_default;
+  }
+  else if ( !setting_.ice_mode_.empty() ) {
+    LOG_F( WARNING ) << "Unknown ice_mode: " << setting_.ice_mode_;
+  }
+
+  control_->set_peer_setting( setting );
+}
+
 bool Peer::ParseOptions( const string& options ) {
   Json::Reader reader;
   Json::Value joptions;
@@ -318,6 +530,217 @@ bool Peer::ParseOptions( const string& options ) {
     setting_.signal_password_ = value;
   }
 
+  int number;
+
+  if ( rtc::GetIntFromJsonObject( joptions, "signal_threads", &number ) && number >= 0 ) {
+    setting_.signal_threads_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "reconnect_attempts", &number ) ) {
+    setting_.reconnect_attempts_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "reconnect_delay", &number ) ) {
+    setting_.reconnect_delay_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "reconnect_delay_max", &number ) ) {
+    setting_.reconnect_delay_max_ = number;
+  }
+
+  if ( rtc::GetStringFromJsonObject( joptions, "reconnect_jitter", &value ) ) {
+    setting_.reconnect_jitter_ = value;
+  }
+
+  bool flag;
+
+  if ( rtc::GetBoolFromJsonObject( joptions, "signal_binary", &flag ) ) {
+    setting_.signal_binary_ = flag;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "ice_candidate_batch", &number ) ) {
+    setting_.ice_candidate_batch_ = number;
+  }
+
+  if ( rtc::GetBoolFromJsonObject( joptions, "local_transport", &flag ) ) {
+    setting_.local_transport_ = flag;
+  }
+
+  if ( rtc::GetBoolFromJsonObject( joptions, "dtls_shared_certificate", &flag ) ) {
+    setting_.dtls_shared_certificate_ = flag;
+  }
+
+  if ( rtc::GetBoolFromJsonObject( joptions, "send_scheduler", &flag ) ) {
+    setting_.send_scheduler_ = flag;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "send_watermark", &number ) ) {
+    setting_.send_watermark_ = number;
+  }
+
+  //
+  // send_weights is [ high, normal, low ] of positive integers
+  //
+
+  Json::Value weights;
+
+  if ( rtc::GetValueFromJsonObject( joptions, "send_weights", &weights ) ) {
+    if ( !weights.isArray() || weights.size() != SendScheduler::kPriorities ) {
+      LOG_F( WARNING ) << "send_weights is not an array of three weights";
+      return false;
+    }
+
+    std::vector<int> values;
+    for ( Json::ArrayIndex i = 0; i < weights.size(); i++ ) {
+      if ( !weights[i].isInt() || weights[i].asInt() <= 0 ) {
+        LOG_F( WARNING ) << "send_weights has an invalid weight";
+        return false;
+      }
+      values.push_back( weights[i].asInt() );
+    }
+    setting_.send_weights_ = values;
+  }
+
+  if ( rtc::GetStringFromJsonObject( joptions, "dtls_key_type", &value ) ) {
+    setting_.dtls_key_type_ = value;
+  }
+
+  if ( rtc::GetStringFromJsonObject( joptions, "dtls_certificate", &value ) ) {
+    setting_.dtls_certificate_ = value;
+  }
+
+  if ( rtc::GetStringFromJsonObject( joptions, "dtls_private_key", &value ) ) {
+    setting_.dtls_private_key_ = value;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "dtls_certificate_rotation", &number ) ) {
+    setting_.dtls_certificate_rotation_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "max_peers", &number ) ) {
+    setting_.max_peers_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "max_handshakes", &number ) ) {
+    setting_.max_handshakes_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "sweep_interval", &number ) ) {
+    setting_.sweep_interval_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "idle_timeout", &number ) ) {
+    setting_.idle_timeout_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "handshake_timeout", &number ) ) {
+    setting_.handshake_timeout_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "ice_failed_timeout", &number ) ) {
+    setting_.ice_failed_timeout_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "ice_restart_grace", &number ) ) {
+    setting_.ice_restart_grace_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "offer_batch", &number ) ) {
+    setting_.offer_batch_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "offer_concurrency", &number ) ) {
+    setting_.offer_concurrency_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "peer_pool", &number ) ) {
+    setting_.peer_pool_ = number;
+  }
+
+  if ( rtc::GetIntFromJsonObject( joptions, "ice_candidate_pool", &number ) ) {
+    setting_.ice_candidate_pool_ = number;
+  }
+
+  if ( rtc::GetStringFromJsonObject( joptions, "ice_mode", &value ) ) {
+    setting_.ice_mode_ = value;
+  }
+
+  //
+  // ice_servers is an array of urls or objects of
+  // { "urls": url or array of urls, "username": ..., "credential": ... }
+  //
+
+  Json::Value servers;
+
+  if ( rtc::GetValueFromJsonObject( joptions, "ice_servers", &servers ) ) {
+    if ( !servers.isArray() ) {
+      LOG_F( WARNING ) << "ice_servers is not an array";
+      return false;
+    }
+
+    setting_.ice_servers_.clear();
+    setting_.ice_servers_set_ = true;
+
+    for ( Json::ArrayIndex i = 0; i < servers.size(); i++ ) {
+      const Json::Value& server = servers[i];
+      Setting::IceServer ice_server;
+      Json::Value urls;
+
+      if ( server.isString() ) {
+        ice_server.urls_.push_back( server.asString() );
+      }
+      else if ( rtc::GetValueFromJsonObject( server, "urls", &urls ) ) {
+        if ( urls.isString() ) {
+          ice_server.urls_.push_back( urls.asString() );
+        }
+        else if ( urls.isArray() ) {
+          for ( Json::ArrayIndex j = 0; j < urls.size(); j++ ) {
+            if ( urls[j].isString() ) ice_server.urls_.push_back( urls[j].asString() );
+          }
+        }
+        rtc::GetStringFromJsonObject( server, "username", &ice_server.username_ );
+        rtc::GetStringFromJsonObject( server, "credential", &ice_server.password_ );
+      }
+
+      if ( ice_server.urls_.empty() ) {
+        LOG_F( WARNING ) << "Invalid ice server: " << server.toStyledString();
+        continue;
+      }
+
+      setting_.ice_servers_.push_back( ice_server );
+    }
+  }
+
+  double real;
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "signal_connect_rate", &real ) ) {
+    setting_.signal_connect_rate_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "signal_connect_burst", &real ) ) {
+    setting_.signal_connect_burst_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "accept_rate", &real ) ) {
+    setting_.accept_rate_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "accept_burst", &real ) ) {
+    setting_.accept_burst_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "max_peer_memory", &real ) ) {
+    setting_.max_peer_memory_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "send_buffer_size", &real ) ) {
+    setting_.send_buffer_size_ = real;
+  }
+
+  if ( rtc::GetDoubleFromJsonObject( joptions, "send_buffer_budget", &real ) ) {
+    setting_.send_buffer_budget_ = real;
+  }
+
   return true;
 }
 
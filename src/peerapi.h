@@ -9,8 +9,10 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
 #include <functional>
+#include <cstdint>
 
 #include "common.h"
 #include "controlobserver.h"
@@ -36,6 +38,53 @@ public:
     string signal_uri_;
     string signal_id_;
     string signal_password_;
+    size_t signal_threads_ = 0;
+
+    // Negative values keep the defaults of Signal
+    int reconnect_attempts_ = -1;
+    int reconnect_delay_ = -1;
+    int reconnect_delay_max_ = -1;
+    string reconnect_jitter_;
+    double signal_connect_rate_ = -1;
+    double signal_connect_burst_ = 1;
+    bool signal_binary_ = true;
+    int ice_candidate_batch_ = -1;
+
+    struct IceServer {
+      std::vector<string> urls_;
+      string username_;
+      string password_;
+    };
+
+    // ice_servers_ replaces the default servers if ice_servers_set_ is true
+    std::vector<IceServer> ice_servers_;
+    bool ice_servers_set_ = false;
+    string ice_mode_;
+    bool local_transport_ = true;
+    int peer_pool_ = -1;
+    int ice_candidate_pool_ = -1;
+    int offer_batch_ = -1;
+    int offer_concurrency_ = -1;
+    int max_peers_ = -1;
+    int max_handshakes_ = -1;
+    double accept_rate_ = -1;
+    double accept_burst_ = 1;
+    int sweep_interval_ = -1;
+    int idle_timeout_ = -1;
+    int handshake_timeout_ = -1;
+    int ice_failed_timeout_ = -1;
+    double max_peer_memory_ = -1;
+    int ice_restart_grace_ = -1;
+    bool send_scheduler_ = false;
+    int send_watermark_ = -1;
+    std::vector<int> send_weights_;
+    double send_buffer_size_ = -1;
+    double send_buffer_budget_ = -1;
+    bool dtls_shared_certificate_ = true;
+    string dtls_key_type_;
+    string dtls_certificate_;
+    string dtls_private_key_;
+    int dtls_certificate_rotation_ = -1;
   };
 
   //
@@ -48,10 +97,24 @@ public:
   void Open();
   void Close( const string peer_id = "" );
   void Connect( const string peer_id );
-  bool Send( const string& peer_id, const char* data, const std::size_t size, const bool wait = SYNC_OFF );
-  bool Send( const string& peer_id, const string& data, const bool wait = SYNC_OFF );
+  bool Send( const string& peer_id, const char* data, const std::size_t size, const bool wait = SYNC_OFF,
+             const SendPriority priority = PRIORITY_NORMAL );
+  bool Send( const string& peer_id, const string& data, const bool wait = SYNC_OFF,
+             const SendPriority priority = PRIORITY_NORMAL );
   bool SetOptions( const string options );
 
+  struct SignalStats {
+    uint64_t attempts_ = 0;         // Connection attempts to signal server
+    uint64_t failures_ = 0;         // Failed connection attempts
+    uint64_t disconnects_ = 0;      // Abnormal disconnections
+    uint64_t resumed_ = 0;          // Sessions resumed after reconnection
+    uint64_t throttled_ = 0;        // Attempts delayed by signal_connect_rate
+    unsigned last_delay_ = 0;       // Last reconnect delay in milliseconds
+  };
+
+  // Reconnection statistics of the signal server connection
+  SignalStats GetSignalStats();
+
   Peer& On( string event_id, std::function<void( string )> );
   Peer& On( string event_id, std::function<void( string, string )> );
   Peer& On( string event_id, std::function<void( string, peerapi::CloseCode, string )> );
@@ -66,6 +129,16 @@ public:
 
   static std::string CreateRandomUuid();
 
+  struct MemoryUsage {
+    string subsystem_;
+    std::size_t bytes_ = 0;         // Allocated and not freed
+    std::size_t peak_bytes_ = 0;
+    std::size_t blocks_ = 0;        // Allocated and not freed
+  };
+
+  // Heap usage by subsystem. Empty unless built with PEERAPI_MEMORY_ACCOUNTING.
+  static std::vector<MemoryUsage> GetMemoryUsage();
+
 
 protected:
   // The base type that is stored in the collection.
@@ -102,6 +175,8 @@ protected:
   void OnWritable( const string peer_id );
 
   bool ParseOptions( const string& options );
+  void ApplySignalSetting();
+  void ApplyPeerSetting();
 
   bool close_once_;
   Setting setting_;
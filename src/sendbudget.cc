@@ -0,0 +1,107 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <algorithm>
+
+#include "sendbudget.h"
+
+namespace peerapi {
+
+std::mutex SendBudget::lock_;
+size_t SendBudget::budget_ = 0;
+size_t SendBudget::used_ = 0;
+int SendBudget::holders_ = 0;
+std::map<SendBudgetObserver*, size_t> SendBudget::waiting_;
+
+
+bool SendBudget::Set(size_t budget) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  if ( holders_ > 0 && budget != budget_ ) {
+    return false;
+  }
+
+  budget_ = budget;
+  holders_++;
+  NotifyLocked();
+  return true;
+}
+
+void SendBudget::Release() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if ( holders_ > 0 ) holders_--;
+}
+
+size_t SendBudget::budget() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return budget_;
+}
+
+size_t SendBudget::used() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return used_;
+}
+
+bool SendBudget::available(size_t size) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return FitsLocked(size);
+}
+
+bool SendBudget::Reserve(size_t size) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  if ( !FitsLocked(size) ) {
+    return false;
+  }
+
+  used_ += size;
+  return true;
+}
+
+void SendBudget::Adjust(long long delta) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  if ( delta >= 0 ) {
+    used_ += static_cast<size_t>(delta);
+    return;
+  }
+
+  used_ -= std::min(used_, static_cast<size_t>(-delta));
+  NotifyLocked();
+}
+
+void SendBudget::Wait(SendBudgetObserver* observer, size_t size) {
+  std::lock_guard<std::mutex> guard(lock_);
+  waiting_[observer] = size;
+  NotifyLocked();
+}
+
+void SendBudget::Unwait(SendBudgetObserver* observer) {
+  std::lock_guard<std::mutex> guard(lock_);
+  waiting_.erase(observer);
+}
+
+bool SendBudget::FitsLocked(size_t size) {
+  return budget_ == 0 || (size <= budget_ && used_ <= budget_ - size);
+}
+
+void SendBudget::NotifyLocked() {
+  if ( waiting_.empty() ) return;
+  if ( !FitsLocked(1) ) return;
+
+  for ( auto it = waiting_.begin(); it != waiting_.end(); ) {
+    if ( !FitsLocked(it->second) ) {
+      ++it;
+      continue;
+    }
+
+    SendBudgetObserver* observer = it->first;
+    it = waiting_.erase(it);
+    observer->OnSendBudgetAvailable();
+  }
+}
+
+} // namespace peerapi
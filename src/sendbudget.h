@@ -0,0 +1,77 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_SENDBUDGET_H__
+#define __PEERAPI_SENDBUDGET_H__
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace peerapi {
+
+//
+// class SendBudget
+//
+// A process-wide budget of data waiting to be sent, in send buffers of data
+// channels and send queues of all peers. A peer reserves bytes before
+// sending, and adjusts them to its buffered amount afterwards. Observers
+// failed to reserve are notified once when the bytes they need fit in the
+// budget, so a large message doesn't wake them up while only a few bytes
+// are free. A budget of 0 is unlimited. It is thread-safe.
+//
+// Peers in the process share one budget. A peer sets it and releases it
+// when closed, and a different budget is refused while it is held.
+//
+
+class SendBudgetObserver {
+public:
+  // Called with the lock of SendBudget held. Post to another thread
+  // rather than sending here.
+  virtual void OnSendBudgetAvailable() = 0;
+
+protected:
+  virtual ~SendBudgetObserver() {}
+};
+
+class SendBudget {
+public:
+  // Returns false if other peers hold a different budget
+  static bool Set(size_t budget);
+  static void Release();
+
+  static size_t budget();
+  static size_t used();
+
+  // There is room for |size| bytes
+  static bool available(size_t size = 1);
+
+  // Reserve |size| bytes. Returns false if it exceeds the budget.
+  static bool Reserve(size_t size);
+
+  // Change used bytes by |delta| without a limit, and notify waiting
+  // observers if below the budget.
+  static void Adjust(long long delta);
+
+  // Notify |observer| when there is room for |size| bytes. A size over the
+  // budget is never notified.
+  static void Wait(SendBudgetObserver* observer, size_t size = 1);
+  static void Unwait(SendBudgetObserver* observer);
+
+private:
+  static bool FitsLocked(size_t size);
+  static void NotifyLocked();
+
+  static std::mutex lock_;
+  static size_t budget_;
+  static size_t used_;
+  static int holders_;
+  static std::map<SendBudgetObserver*, size_t> waiting_;
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_SENDBUDGET_H__
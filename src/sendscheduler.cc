@@ -0,0 +1,120 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <algorithm>
+
+#include "sendscheduler.h"
+
+namespace peerapi {
+
+// Bytes a queue may send per round for each weight
+static const size_t kQuantum = 16 * 1024;
+
+SendScheduler::SendScheduler()
+    : messages_(0),
+      bytes_(0),
+      current_(0),
+      visited_(false) {
+  set_weights(16, 4, 1);
+}
+
+void SendScheduler::set_weights(int high, int normal, int low) {
+  queues_[PRIORITY_HIGH].weight_ = std::max(high, 1);
+  queues_[PRIORITY_NORMAL].weight_ = std::max(normal, 1);
+  queues_[PRIORITY_LOW].weight_ = std::max(low, 1);
+}
+
+static int IndexOf(SendPriority priority) {
+  return std::min(std::max(static_cast<int>(priority), 0),
+                  static_cast<int>(SendScheduler::kPriorities) - 1);
+}
+
+void SendScheduler::Push(SendPriority priority, const char* data, size_t size) {
+  queues_[IndexOf(priority)].messages_.emplace_back(data, size);
+  messages_++;
+  bytes_ += size;
+}
+
+bool SendScheduler::Pop(std::string* data, SendPriority* priority) {
+  if (messages_ == 0) return false;
+
+  //
+  // Deficit round robin. A queue earns a quantum of its weight on each
+  // visit and sends messages while the deficit covers them. A message
+  // larger than a quantum is sent after a few rounds.
+  //
+
+  for (;;) {
+    Queue& queue = queues_[current_];
+
+    if (queue.messages_.empty()) {
+      queue.deficit_ = 0;
+      Next();
+      continue;
+    }
+
+    if (!visited_) {
+      queue.deficit_ += kQuantum * queue.weight_;
+      visited_ = true;
+    }
+
+    std::string& front = queue.messages_.front();
+    if (front.size() > queue.deficit_) {
+      Next();
+      continue;
+    }
+
+    queue.deficit_ -= front.size();
+    bytes_ -= front.size();
+    messages_--;
+
+    data->swap(front);
+    queue.messages_.pop_front();
+    if (priority) *priority = static_cast<SendPriority>(current_);
+
+    if (queue.messages_.empty()) {
+      queue.deficit_ = 0;
+      Next();
+    }
+
+    return true;
+  }
+}
+
+void SendScheduler::Requeue(SendPriority priority, std::string* data) {
+  int index = IndexOf(priority);
+  Queue& queue = queues_[index];
+
+  // Return the deficit as well, so the queue doesn't lose its turn
+  queue.deficit_ += data->size();
+  bytes_ += data->size();
+  messages_++;
+
+  queue.messages_.emplace_front();
+  queue.messages_.front().swap(*data);
+
+  current_ = index;
+  visited_ = true;
+}
+
+void SendScheduler::Clear() {
+  for (auto& queue : queues_) {
+    queue.messages_.clear();
+    queue.deficit_ = 0;
+  }
+
+  messages_ = 0;
+  bytes_ = 0;
+  current_ = 0;
+  visited_ = false;
+}
+
+void SendScheduler::Next() {
+  current_ = (current_ + 1) % kPriorities;
+  visited_ = false;
+}
+
+} // namespace peerapi
@@ -0,0 +1,65 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_SENDSCHEDULER_H__
+#define __PEERAPI_SENDSCHEDULER_H__
+
+#include <deque>
+#include <string>
+
+#include "common.h"
+
+namespace peerapi {
+
+//
+// class SendScheduler
+//
+// Queues of messages waiting to be sent to a data channel, one per
+// SendPriority. Messages are popped by deficit round robin, so each
+// priority gets bandwidth in proportion to its weight and a bulk transfer
+// of low priority doesn't delay messages of high priority. Messages of the
+// same priority are in FIFO order. It is not thread-safe.
+//
+
+class SendScheduler {
+public:
+  enum { kPriorities = PRIORITY_LOW + 1 };
+
+  SendScheduler();
+
+  // Weights of PRIORITY_HIGH, PRIORITY_NORMAL and PRIORITY_LOW
+  void set_weights(int high, int normal, int low);
+
+  void Push(SendPriority priority, const char* data, size_t size);
+  bool Pop(std::string* data, SendPriority* priority = nullptr);
+
+  // Put a popped message back to the front of its queue, if it couldn't be
+  // sent. It is popped first again.
+  void Requeue(SendPriority priority, std::string* data);
+
+  bool empty() const { return messages_ == 0; }
+  size_t bytes() const { return bytes_; }
+  void Clear();
+
+private:
+  struct Queue {
+    std::deque<std::string> messages_;
+    size_t deficit_ = 0;
+    int weight_ = 1;
+  };
+
+  void Next();
+
+  Queue queues_[kPriorities];
+  size_t messages_;
+  size_t bytes_;
+  int current_;
+  bool visited_;      // Quantum has been added to the current queue
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_SENDSCHEDULER_H__
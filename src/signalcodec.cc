@@ -0,0 +1,366 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <cstring>
+
+#include "signalcodec.h"
+
+namespace peerapi {
+
+const char* SignalCodec::kName = "msgpack";
+
+namespace {
+
+//
+// Schema. Names are encoded as an index of the tables, so the tables are
+// append-only. Never reorder or remove an entry.
+//
+
+const char* const kFieldNames[] = {
+  "command", "channel", "data", "peer_id",
+  "sdp", "sdp_mid", "sdp_mline_index", "candidate",
+  "name", "result", "desc", "session_id",
+  "user_id", "user_password", "peers", "encoding",
+  "encodings", "candidates"
+};
+
+const char* const kCommandNames[] = {
+  "open", "createchannel", "joinchannel", "leavechannel",
+  "createoffer", "offersdp", "answersdp", "ice_candidate",
+  "peerclosed", "channelcreate", "channeljoin", "channelleave",
+  "ice_candidates"
+};
+
+const int kMaxDepth = 32;
+
+template<size_t N>
+int FindName(const char* const (&table)[N], const std::string& name) {
+  for (size_t i = 0; i < N; i++) {
+    if (name == table[i]) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+template<size_t N>
+const char* GetName(const char* const (&table)[N], uint64_t index) {
+  return index < N ? table[index] : nullptr;
+}
+
+//
+// Writer
+//
+
+void PutBig(std::string* out, uint64_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    out->push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+  }
+}
+
+void PutUInt(std::string* out, uint64_t value) {
+  if (value < 0x80) {
+    out->push_back(static_cast<char>(value));
+  }
+  else if (value <= 0xff) {
+    out->push_back('\xcc'); PutBig(out, value, 1);
+  }
+  else if (value <= 0xffff) {
+    out->push_back('\xcd'); PutBig(out, value, 2);
+  }
+  else if (value <= 0xffffffff) {
+    out->push_back('\xce'); PutBig(out, value, 4);
+  }
+  else {
+    out->push_back('\xcf'); PutBig(out, value, 8);
+  }
+}
+
+void PutInt(std::string* out, int64_t value) {
+  if (value >= 0) {
+    PutUInt(out, static_cast<uint64_t>(value));
+  }
+  else if (value >= -32) {
+    out->push_back(static_cast<char>(value));
+  }
+  else if (value >= INT8_MIN) {
+    out->push_back('\xd0'); PutBig(out, static_cast<uint64_t>(value), 1);
+  }
+  else if (value >= INT16_MIN) {
+    out->push_back('\xd1'); PutBig(out, static_cast<uint64_t>(value), 2);
+  }
+  else if (value >= INT32_MIN) {
+    out->push_back('\xd2'); PutBig(out, static_cast<uint64_t>(value), 4);
+  }
+  else {
+    out->push_back('\xd3'); PutBig(out, static_cast<uint64_t>(value), 8);
+  }
+}
+
+void PutString(std::string* out, const std::string& value) {
+  size_t size = value.size();
+  if (size < 32) {
+    out->push_back(static_cast<char>(0xa0 | size));
+  }
+  else if (size <= 0xff) {
+    out->push_back('\xd9'); PutBig(out, size, 1);
+  }
+  else if (size <= 0xffff) {
+    out->push_back('\xda'); PutBig(out, size, 2);
+  }
+  else {
+    out->push_back('\xdb'); PutBig(out, size, 4);
+  }
+  out->append(value);
+}
+
+void PutHeader(std::string* out, size_t size, char fix, char head16, char head32) {
+  if (size < 16) {
+    out->push_back(static_cast<char>(fix | size));
+  }
+  else if (size <= 0xffff) {
+    out->push_back(head16); PutBig(out, size, 2);
+  }
+  else {
+    out->push_back(head32); PutBig(out, size, 4);
+  }
+}
+
+void PutValue(std::string* out, const Json::Value& value, bool command) {
+  switch (value.type()) {
+  case Json::nullValue:
+    out->push_back('\xc0');
+    break;
+  case Json::booleanValue:
+    out->push_back(value.asBool() ? '\xc3' : '\xc2');
+    break;
+  case Json::intValue:
+    PutInt(out, value.asLargestInt());
+    break;
+  case Json::uintValue:
+    PutUInt(out, value.asLargestUInt());
+    break;
+  case Json::realValue: {
+    double real = value.asDouble();
+    uint64_t bits;
+    std::memcpy(&bits, &real, sizeof(bits));
+    out->push_back('\xcb');
+    PutBig(out, bits, 8);
+    break;
+  }
+  case Json::stringValue: {
+    int index = command ? FindName(kCommandNames, value.asString()) : -1;
+    if (index >= 0) {
+      PutUInt(out, index);
+    }
+    else {
+      PutString(out, value.asString());
+    }
+    break;
+  }
+  case Json::arrayValue:
+    PutHeader(out, value.size(), '\x90', '\xdc', '\xdd');
+    for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+      PutValue(out, value[i], false);
+    }
+    break;
+  case Json::objectValue: {
+    Json::Value::Members names = value.getMemberNames();
+    PutHeader(out, names.size(), '\x80', '\xde', '\xdf');
+    for (auto& name : names) {
+      int index = FindName(kFieldNames, name);
+      if (index >= 0) {
+        PutUInt(out, index);
+      }
+      else {
+        PutString(out, name);
+      }
+      PutValue(out, value[name], name == "command");
+    }
+    break;
+  }
+  }
+}
+
+//
+// Reader
+//
+
+class Reader {
+public:
+  Reader(const char* data, size_t size)
+      : data_(reinterpret_cast<const uint8_t*>(data)), size_(size), pos_(0) {}
+
+  bool Read(Json::Value* value, bool command, int depth);
+  bool done() const { return pos_ == size_; }
+
+private:
+  bool Big(int bytes, uint64_t* value);
+  bool String(size_t size, std::string* value);
+  bool Array(size_t size, Json::Value* value, int depth);
+  bool Map(size_t size, Json::Value* value, int depth);
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+bool Reader::Big(int bytes, uint64_t* value) {
+  if (size_ - pos_ < static_cast<size_t>(bytes)) return false;
+  *value = 0;
+  for (int i = 0; i < bytes; i++) {
+    *value = (*value << 8) | data_[pos_++];
+  }
+  return true;
+}
+
+bool Reader::String(size_t size, std::string* value) {
+  if (size_ - pos_ < size) return false;
+  value->assign(reinterpret_cast<const char*>(data_ + pos_), size);
+  pos_ += size;
+  return true;
+}
+
+bool Reader::Array(size_t size, Json::Value* value, int depth) {
+  *value = Json::Value(Json::arrayValue);
+  for (size_t i = 0; i < size; i++) {
+    Json::Value item;
+    if (!Read(&item, false, depth + 1)) return false;
+    value->append(item);
+  }
+  return true;
+}
+
+bool Reader::Map(size_t size, Json::Value* value, int depth) {
+  *value = Json::Value(Json::objectValue);
+  for (size_t i = 0; i < size; i++) {
+    Json::Value key;
+    if (!Read(&key, false, depth + 1)) return false;
+
+    std::string name;
+    if (key.isString()) {
+      name = key.asString();
+    }
+    else if (key.isUInt() || (key.isInt() && key.asInt() >= 0)) {
+      const char* field = GetName(kFieldNames, key.asLargestUInt());
+      if (field == nullptr) return false;
+      name = field;
+    }
+    else {
+      return false;
+    }
+
+    if (!Read(&(*value)[name], name == "command", depth + 1)) return false;
+  }
+  return true;
+}
+
+bool Reader::Read(Json::Value* value, bool command, int depth) {
+  if (depth > kMaxDepth || pos_ >= size_) return false;
+
+  uint8_t head = data_[pos_++];
+  uint64_t number;
+  std::string text;
+
+  // Unsigned integer. It is a name of command in 'command' field.
+  if (head < 0x80 || (head >= 0xcc && head <= 0xcf)) {
+    if (head < 0x80) {
+      number = head;
+    }
+    else if (!Big(1 << (head - 0xcc), &number)) {
+      return false;
+    }
+
+    if (command) {
+      const char* name = GetName(kCommandNames, number);
+      if (name == nullptr) return false;
+      *value = name;
+    }
+    else {
+      *value = Json::Value(static_cast<Json::LargestUInt>(number));
+    }
+    return true;
+  }
+
+  // Negative fixint
+  if (head >= 0xe0) {
+    *value = Json::Value(static_cast<Json::LargestInt>(static_cast<int8_t>(head)));
+    return true;
+  }
+
+  // Signed integer
+  if (head >= 0xd0 && head <= 0xd3) {
+    int bytes = 1 << (head - 0xd0);
+    if (!Big(bytes, &number)) return false;
+    int shift = 64 - bytes * 8;
+    int64_t signed_number = static_cast<int64_t>(number << shift) >> shift;
+    *value = Json::Value(static_cast<Json::LargestInt>(signed_number));
+    return true;
+  }
+
+  if ((head & 0xe0) == 0xa0) {
+    if (!String(head & 0x1f, &text)) return false;
+    *value = text;
+    return true;
+  }
+
+  if ((head & 0xf0) == 0x90) return Array(head & 0x0f, value, depth);
+  if ((head & 0xf0) == 0x80) return Map(head & 0x0f, value, depth);
+
+  switch (head) {
+  case 0xc0:
+    *value = Json::Value();
+    return true;
+  case 0xc2:
+    *value = false;
+    return true;
+  case 0xc3:
+    *value = true;
+    return true;
+  case 0xcb: {
+    double real;
+    if (!Big(8, &number)) return false;
+    std::memcpy(&real, &number, sizeof(real));
+    *value = real;
+    return true;
+  }
+  case 0xc4: case 0xd9:   // bin8, str8
+  case 0xc5: case 0xda:   // bin16, str16
+  case 0xc6: case 0xdb: { // bin32, str32
+    int bytes = (head >= 0xd9) ? 1 << (head - 0xd9) : 1 << (head - 0xc4);
+    if (!Big(bytes, &number) || !String(static_cast<size_t>(number), &text)) return false;
+    *value = text;
+    return true;
+  }
+  case 0xdc:
+  case 0xdd:
+    if (!Big(head == 0xdc ? 2 : 4, &number)) return false;
+    return Array(static_cast<size_t>(number), value, depth);
+  case 0xde:
+  case 0xdf:
+    if (!Big(head == 0xde ? 2 : 4, &number)) return false;
+    return Map(static_cast<size_t>(number), value, depth);
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+
+//
+// class SignalCodec
+//
+
+void SignalCodec::Encode(const Json::Value& message, std::string* out) {
+  out->clear();
+  PutValue(out, message, false);
+}
+
+bool SignalCodec::Decode(const char* data, const size_t size, Json::Value* message) {
+  Reader reader(data, size);
+  return reader.Read(message, false, 0) && reader.done();
+}
+
+} // namespace peerapi
@@ -0,0 +1,38 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_SIGNALCODEC_H__
+#define __PEERAPI_SIGNALCODEC_H__
+
+#include <string>
+
+#include "webrtc/base/json.h"
+
+namespace peerapi {
+
+//
+// class SignalCodec
+//
+// Compact binary encoding of signaling commands in MessagePack format.
+// Command names and well-known field names (open, createchannel, offersdp,
+// answersdp, ice_candidate and their fields) are encoded as small integers.
+// Unknown names are encoded as strings, so any JSON command is supported.
+//
+// The encoding is negotiated by 'open' command. A client sends "encodings"
+// and a server replies "encoding" if it supports one of them.
+//
+
+class SignalCodec {
+public:
+  static const char* kName;
+
+  static void Encode(const Json::Value& message, std::string* out);
+  static bool Decode(const char* data, const size_t size, Json::Value* message);
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_SIGNALCODEC_H__
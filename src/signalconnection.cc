@@ -11,25 +11,104 @@
 #include <map>
 #include <list>
 #include "signalconnection.h"
+#include "signalcodec.h"
 #include "logging.h"
+#include "memoryaccounting.h"
 
 namespace peerapi {
 
-Signal::Signal(const string url) :
+//
+// class SignalIoService
+//
+
+SignalIoService::SignalIoService(size_t threads)
+    : work_(new asio::io_service::work(io_service_)) {
+
+  if (threads == 0) threads = 1;
+
+  for (size_t i = 0; i < threads; i++) {
+    threads_.push_back(std::thread([this] () {
+      MemoryScope memory_scope(MEMORY_SIGNAL);
+      io_service_.run();
+    }));
+  }
+
+  LOG_F( INFO ) << "Done, threads is " << threads;
+}
+
+SignalIoService::~SignalIoService() {
+  work_.reset();
+  io_service_.stop();
+
+  for (auto& thread : threads_) {
+    if (thread.get_id() == std::this_thread::get_id()) {
+      // The last user released the pool inside of a handler
+      thread.detach();
+    }
+    else if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  LOG_F( INFO ) << "Done";
+}
+
+bool SignalIoService::running_in_this_thread() const {
+  for (auto& thread : threads_) {
+    if (thread.get_id() == std::this_thread::get_id()) return true;
+  }
+  return false;
+}
+
+std::shared_ptr<SignalIoService> SignalIoService::Shared(size_t threads) {
+  static std::mutex lock;
+  static std::weak_ptr<SignalIoService> shared;
+
+  std::lock_guard<std::mutex> guard(lock);
+  std::shared_ptr<SignalIoService> io_service = shared.lock();
+
+  if (io_service) {
+    if (io_service->threads() != threads) {
+      LOG_F( WARNING ) << "Shared io_service already runs " <<
+                          io_service->threads() << " threads";
+    }
+    return io_service;
+  }
+
+  io_service = std::make_shared<SignalIoService>(threads);
+  shared = io_service;
+  return io_service;
+}
+
+
+//
+// class Signal
+//
+
+Signal::Signal(const string url, std::shared_ptr<SignalIoService> io_service) :
+      io_service_(io_service),
+      client_(std::make_shared<client_type>()),
+      lifetime_(std::make_shared<Lifetime>()),
       con_state_(con_closed),
       network_thread_(),
       reconn_attempts_(3),
       reconn_made_(0),
       reconn_delay_(5000),
       reconn_delay_max_(25000),
+      reconn_last_delay_(0),
+      reconn_jitter_(jitter_full),
+      reconn_random_(std::random_device()()),
+      reconnecting_(false),
+      binary_enabled_(true),
+      binary_(false),
       url_(url) {
 
 #if _DEBUG || DEBUG
-  client_.clear_access_channels(websocketpp::log::alevel::all);
-  client_.set_access_channels(websocketpp::log::alevel::fail);
+  client_->clear_access_channels(websocketpp::log::alevel::all);
+  client_->set_access_channels(websocketpp::log::alevel::fail);
 #else
-  client_.clear_access_channels(websocketpp::log::elevel::all);
-  client_.clear_error_channels(websocketpp::log::alevel::all);
+  client_->clear_access_channels(websocketpp::log::elevel::all);
+  client_->clear_error_channels(websocketpp::log::alevel::all);
 #endif
 
   // Default settings
@@ -38,18 +117,29 @@ Signal::Signal(const string url) :
   }
 
   // Initialize ASIO
-  client_.init_asio();
+  if (io_service_) {
+    client_->init_asio(&io_service_->io_service());
+  }
+  else {
+    client_->init_asio();
+  }
+
+  strand_.reset(new asio::io_service::strand(client_->get_io_service()));
 
   // Bind the handlers we are using
   using websocketpp::lib::placeholders::_1;
   using websocketpp::lib::placeholders::_2;
   using websocketpp::lib::bind;
 
-  client_.set_open_handler(bind(&Signal::OnOpen, this, _1));
-  client_.set_close_handler(bind(&Signal::OnClose, this, _1));
-  client_.set_fail_handler(bind(&Signal::OnFail, this, _1));
-  client_.set_message_handler(bind(&Signal::OnMessage, this, _1, _2));
-  client_.set_tls_init_handler(bind(&Signal::OnTlsInit, this, _1));
+  client_->set_open_handler(Guard(bind(&Signal::OnOpen, this, _1)));
+  client_->set_close_handler(Guard(bind(&Signal::OnClose, this, _1)));
+  client_->set_fail_handler(Guard(bind(&Signal::OnFail, this, _1)));
+  client_->set_message_handler(Guard(bind(&Signal::OnMessage, this, _1, _2)));
+  client_->set_tls_init_handler(bind(&Signal::OnTlsInit, _1));
+
+  // Frame outgoing commands in their buffer and read incoming commands
+  // from the read buffer. OnMessage doesn't keep messages.
+  client_->set_zero_copy(true);
 
   LOG_F( INFO ) << "Done";
 }
@@ -70,15 +160,16 @@ void Signal::Open(const string& id, const string& password) {
 void Signal::Close() {
 
   if ( !opened() ) {
+    CancelReconnect();
     LOG_F( WARNING ) << "It is not opened";
     return;
   }
 
   con_state_ = con_closing;
-  client_.get_io_service().dispatch(websocketpp::lib::bind(&Signal::CloseInternal,
-                                    this,
-                                    websocketpp::close::status::normal,
-                                    "End by user"));
+  strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::CloseInternal,
+                                                 this,
+                                                 websocketpp::close::status::normal,
+                                                 "End by user")));
   LOG_F( INFO ) << "Done";
 }
 
@@ -86,17 +177,32 @@ void Signal::Close() {
 void Signal::SyncClose()
 {
   if ( !opened() ) {
+    CancelReconnect();
+    if (!io_service_ && network_thread_ && network_thread_->joinable()) {
+      network_thread_->join();
+      network_thread_.reset();
+    }
     LOG_F( WARNING ) << "It is not opened";
     return;
   }
 
   con_state_ = con_closing;
-  client_.get_io_service().dispatch(websocketpp::lib::bind(&Signal::CloseInternal,
-                                    this,
-                                    websocketpp::close::status::normal,
-                                    "End by user"));
+  strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::CloseInternal,
+                                                 this,
+                                                 websocketpp::close::status::normal,
+                                                 "End by user")));
 
-  if (network_thread_ && network_thread_->joinable() )
+  if (io_service_ && io_service_->running_in_this_thread())
+  {
+    // Waiting would block the thread that closes the connection
+    LOG_F( WARNING ) << "Called from the io_service, closing asynchronously";
+  }
+  else if (io_service_)
+  {
+    // Shared io_service never stops, so wait for the connection only
+    WaitClosed();
+  }
+  else if (network_thread_ && network_thread_->joinable() )
   {
     network_thread_->join();
     network_thread_.reset();
@@ -109,30 +215,36 @@ void Signal::SyncClose()
 void Signal::SendCommand(const string channel,
                          const string commandname,
                          const Json::Value& data) {
+  MemoryScope memory_scope(MEMORY_SIGNAL);
 
   if (commandname.empty()) {
     LOG_F(WARNING) << "SendCommand with empty commandname";
     return;
   }
 
-  if (!opened()) {
-    LOG_F(WARNING) << "Signal server is not opened";
-    return;
-  }
-
   Json::Value message;
-  Json::FastWriter writer;
   message["command"] = commandname;
   message["data"] = data;
   if (!channel.empty()) message["channel"] = channel;
 
+  if (QueueCommand(message)) {
+    LOG_F(INFO) << "Queued until reconnected, command is " << commandname;
+    return;
+  }
+
+  if (!opened()) {
+    LOG_F(WARNING) << "Signal server is not opened";
+    return;
+  }
+
   LOG_F( LS_VERBOSE ) << "message is " << message.toStyledString();
 
   try {
-    client_.send(con_hdl_, writer.write(message), websocketpp::frame::opcode::text);
-  }
-  catch (websocketpp::lib::error_code& ec) {
-    LOG_F(LERROR) << "SendCommand Error: " << ec;
+    websocketpp::lib::error_code ec;
+    SendMessage(message, ec);
+    if (ec) {
+      LOG_F(LERROR) << "SendCommand Error: " << ec.message();
+    }
   }
   catch (std::exception& e) {
     LOG_F(LERROR) << "SendCommand Error: " << e.what();
@@ -151,12 +263,6 @@ void Signal::SendGlobalCommand(const string commandname,
 
 void Signal::Connect()
 {
-  if (reconn_timer_)
-  {
-    reconn_timer_->cancel();
-    reconn_timer_.reset();
-  }
-
   if (network_thread_)
   {
     if (con_state_ == con_closing || con_state_ == con_closed)
@@ -173,19 +279,58 @@ void Signal::Connect()
       return;
     }
   }
+  else if (io_service_ && (con_state_ == con_opening || con_state_ == con_opened))
+  {
+    //no network thread in shared mode, so check the state only.
+    return;
+  }
 
   con_state_ = con_opening;
-  reconn_made_ = 0;
 
   this->ResetState();
-  client_.get_io_service().dispatch(websocketpp::lib::bind(&Signal::ConnectInternal, this));
-  network_thread_.reset(new websocketpp::lib::thread(websocketpp::lib::bind(&Signal::RunLoop, this)));
+  strand_->dispatch(Guard([this] () {
+    if (reconn_timer_)
+    {
+      reconn_timer_->cancel();
+      reconn_timer_.reset();
+    }
+    reconn_made_ = 0;
+    ConnectInternal();
+  }));
+
+  if (!io_service_) {
+    network_thread_.reset(new websocketpp::lib::thread(websocketpp::lib::bind(&Signal::RunLoop, client_)));
+  }
   LOG_F( INFO ) << "Done";
 }
 
 
 void Signal::Teardown()
 {
+  //
+  // Handlers bound to this instance must not run after it is destroyed.
+  // Stop reconnecting and close the connection in any state. The lock of
+  // lifetime_ keeps the handlers off the state meanwhile.
+  //
+
+  {
+    std::lock_guard<std::recursive_mutex> lock(lifetime_->lock);
+    if (!lifetime_->alive) return;
+    AbortInternal();
+  }
+
+  if ( io_service_ ) {
+    if ( io_service_->running_in_this_thread() ) {
+      // Waiting would block the thread that closes the connection
+      LOG_F( WARNING ) << "Called from the io_service, closing asynchronously";
+    }
+    else {
+      WaitClosed();
+    }
+  }
+
+  ReleaseHandlers();
+
   if ( network_thread_ && network_thread_->joinable() ) {
     network_thread_->detach();
     network_thread_.reset();
@@ -196,7 +341,7 @@ void Signal::Teardown()
 
 asio::io_service& Signal::GetIoService()
 {
-  return client_.get_io_service();
+  return client_->get_io_service();
 }
 
 
@@ -207,34 +352,246 @@ void Signal::SendOpenCommand() {
   data["user_id"] = user_id_;
   data["user_password"] = user_password_;
 
-  SendGlobalCommand("open", data);
+  // Resume previous session if reconnecting
+  if (!session_id_.empty()) {
+    data["session_id"] = session_id_;
+  }
+
+  // Negotiate binary encoding. 'open' command itself is always JSON.
+  binary_ = false;
+  if (binary_enabled_) {
+    data["encodings"].append(SignalCodec::kName);
+  }
+
+  Json::Value message;
+  message["command"] = "open";
+  message["data"] = data;
+
+  websocketpp::lib::error_code ec;
+  SendMessage(message, ec);
+  if (ec) {
+    LOG_F(LERROR) << "Send open command error: " << ec.message();
+  }
 }
 
 void Signal::OnCommandReceived(Json::Value& message) {
+  string command;
+  Json::Value data;
+
+  if (rtc::GetStringFromJsonObject(message, "command", &command) &&
+      rtc::GetValueFromJsonObject(message, "data", &data) &&
+      command == "open") {
+    OnOpenReceived(data);
+  }
+
   SignalOnCommandReceived_(message);
   return;
 }
 
-void Signal::RunLoop()
+void Signal::OnOpenReceived(const Json::Value& data) {
+  bool result;
+  string session_id;
+
+  if (!rtc::GetBoolFromJsonObject(data, "result", &result) || !result) {
+    return;
+  }
+
+  string encoding;
+  if (binary_enabled_ &&
+      rtc::GetStringFromJsonObject(data, "encoding", &encoding) &&
+      encoding == SignalCodec::kName) {
+    LOG_F(INFO) << "Binary encoding is " << encoding;
+    binary_ = true;
+  }
+
+  if (rtc::GetStringFromJsonObject(data, "session_id", &session_id)) {
+    if (session_id_ == session_id) {
+      std::lock_guard<std::mutex> lock(stats_lock_);
+      stats_.resumed++;
+      LOG_F(INFO) << "Session resumed, session_id is " << session_id;
+    }
+    session_id_ = session_id;
+  }
+
+  SendPendingCommands();
+}
+
+bool Signal::QueueCommand(const Json::Value& message) {
+  std::lock_guard<std::mutex> lock(pending_lock_);
+
+  if (!reconnecting_) {
+    return false;
+  }
+
+  if (pending_commands_.size() >= max_pending_commands_) {
+    LOG_F(WARNING) << "Pending command queue is full, drop the oldest one";
+    pending_commands_.pop_front();
+  }
+
+  pending_commands_.push_back(message);
+  return true;
+}
+
+void Signal::SendMessage(const Json::Value& message, websocketpp::lib::error_code& ec) {
+  websocketpp::connection_hdl con = connection();
+
+  if (binary_) {
+    string payload;
+    SignalCodec::Encode(message, &payload);
+    client_->send(con, payload, websocketpp::frame::opcode::binary, ec);
+  }
+  else {
+    Json::FastWriter writer;
+    client_->send(con, writer.write(message), websocketpp::frame::opcode::text, ec);
+  }
+}
+
+websocketpp::connection_hdl Signal::connection() {
+  std::lock_guard<std::mutex> lock(pending_lock_);
+  return con_hdl_;
+}
+
+void Signal::set_connection(websocketpp::connection_hdl con) {
+  std::lock_guard<std::mutex> lock(pending_lock_);
+  con_hdl_ = con;
+}
+
+void Signal::SendPendingCommands() {
+  std::deque<Json::Value> commands;
+
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    reconnecting_ = false;
+    commands.swap(pending_commands_);
+  }
+
+  if (commands.empty()) return;
+
+  LOG_F(INFO) << "Send " << commands.size() << " pending commands";
+
+  for (auto& message : commands) {
+    websocketpp::lib::error_code ec;
+    SendMessage(message, ec);
+    if (ec) {
+      LOG_F(LERROR) << "Send pending command error: " << ec.message();
+    }
+  }
+}
+
+void Signal::RunLoop(std::shared_ptr<client_type> client)
 {
-  client_.run();
-  client_.reset();
-  client_.get_alog().write(websocketpp::log::alevel::devel,
+  // The client is kept alive until the loop ends, even if the Signal was
+  // destroyed and the thread detached
+  MemoryScope memory_scope(MEMORY_SIGNAL);
+  client->run();
+  client->reset();
+  client->get_alog().write(websocketpp::log::alevel::devel,
                            "run loop end");
 }
 
 void Signal::ConnectInternal()
 {
+    unsigned wait = ConnectLimiter().Take();
+    if (wait > 0) {
+      {
+        std::lock_guard<std::mutex> lock(stats_lock_);
+        stats_.throttled++;
+      }
+
+      LOG_F(WARNING) << "Connection attempt is throttled for " << wait << "ms";
+      reconn_timer_.reset(new asio::steady_timer(client_->get_io_service()));
+      websocketpp::lib::asio::error_code ec;
+      reconn_timer_->expires_from_now(websocketpp::lib::asio::milliseconds(wait), ec);
+      reconn_timer_->async_wait(strand_->wrap(Guard(websocketpp::lib::bind(&Signal::TimeoutThrottle, this, websocketpp::lib::placeholders::_1))));
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(stats_lock_);
+      stats_.attempts++;
+    }
+
     websocketpp::lib::error_code ec;
-    client_type::connection_ptr con = client_.get_connection(url_, ec);
+    client_type::connection_ptr con = client_->get_connection(url_, ec);
     if (ec) {
-      client_.get_alog().write(websocketpp::log::alevel::app,
+      client_->get_alog().write(websocketpp::log::alevel::app,
                               "Get Connection Error: " + ec.message());
       return;
     }
 
-    client_.connect(con);
+    set_connection(con->get_handle());
+    client_->connect(con);
+    return;
+}
+
+void Signal::AbortInternal()
+{
+  // Called with the lock of lifetime_ held
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    reconnecting_ = false;
+    pending_commands_.clear();
+  }
+
+  reconn_made_ = reconn_attempts_;
+  if (reconn_timer_)
+  {
+    reconn_timer_->cancel();
+    reconn_timer_.reset();
+  }
+
+  websocketpp::lib::error_code ec;
+  client_type::connection_ptr con = client_->get_con_from_hdl(connection(), ec);
+  if (ec)
+  {
+    // No connection, or waiting to reconnect
+    SetClosed();
     return;
+  }
+
+  con_state_ = con_closing;
+
+  switch (con->get_state())
+  {
+  case websocketpp::session::state::connecting:
+    // Abort on the strand of the connection, as its handshake timeout does
+    con->get_strand()->post(websocketpp::lib::bind(
+        &client_type::connection_type::terminate, con,
+        websocketpp::error::make_error_code(websocketpp::error::operation_canceled)));
+    break;
+  case websocketpp::session::state::open:
+    con->close(websocketpp::close::status::normal, "End by user", ec);
+    break;
+  default:
+    // Closing already
+    break;
+  }
+}
+
+void Signal::WaitClosed()
+{
+  std::unique_lock<std::mutex> lock(closed_lock_);
+  if (!closed_cv_.wait_for(lock, std::chrono::seconds(10),
+                           [this] () { return con_state_ == con_closed; })) {
+    LOG_F( WARNING ) << "Timeout";
+  }
+}
+
+void Signal::ReleaseHandlers()
+{
+  std::lock_guard<std::recursive_mutex> lock(lifetime_->lock);
+  lifetime_->alive = false;
+
+  // Handlers of the client refer to lifetime_, which would keep the client
+  // alive by itself
+  client_->set_open_handler(nullptr);
+  client_->set_close_handler(nullptr);
+  client_->set_fail_handler(nullptr);
+  client_->set_message_handler(nullptr);
+
+  if (io_service_) {
+    lifetime_->client = client_;
+  }
 }
 
 
@@ -248,14 +605,15 @@ void Signal::CloseInternal(websocketpp::close::status::value const& code, string
     reconn_timer_->cancel();
     reconn_timer_.reset();
   }
-  if (con_hdl_.expired())
+  websocketpp::connection_hdl con = connection();
+  if (con.expired())
   {
     LOG_F(LERROR) << "Error: No active session";
   }
   else
   {
     websocketpp::lib::error_code ec;
-    client_.close(con_hdl_, code, desc, ec);
+    client_->close(con, code, desc, ec);
   }
 }
 
@@ -272,23 +630,132 @@ void Signal::TimeoutReconnect(websocketpp::lib::asio::error_code const& ec)
     reconn_made_++;
     this->ResetState();
     LOG_F(WARNING) << "Reconnecting..";
-    client_.get_io_service().dispatch(websocketpp::lib::bind(&Signal::ConnectInternal, this));
+    strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::ConnectInternal, this)));
+  }
+}
+
+bool Signal::ScheduleReconnect()
+{
+  if (reconn_made_ >= reconn_attempts_)
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    reconnecting_ = false;
+    pending_commands_.clear();
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    reconnecting_ = true;
+  }
+
+  LOG_F(WARNING) << "Reconnect for attempt:" << reconn_made_;
+  unsigned delay = this->NextDelay();
+  reconn_timer_.reset(new asio::steady_timer(client_->get_io_service()));
+  websocketpp::lib::asio::error_code ec;
+  reconn_timer_->expires_from_now(websocketpp::lib::asio::milliseconds(delay), ec);
+  reconn_timer_->async_wait(strand_->wrap(Guard(websocketpp::lib::bind(&Signal::TimeoutReconnect, this, websocketpp::lib::placeholders::_1))));
+  return true;
+}
+
+void Signal::CancelReconnect()
+{
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    if (!reconnecting_) return;
+    reconnecting_ = false;
+    pending_commands_.clear();
   }
+
+  strand_->dispatch(Guard([this] () {
+    if (reconn_timer_)
+    {
+      reconn_timer_->cancel();
+      reconn_timer_.reset();
+    }
+    reconn_made_ = reconn_attempts_;
+  }));
+
+  LOG_F( INFO ) << "Done";
 }
 
-unsigned Signal::NextDelay() const
+void Signal::TimeoutThrottle(websocketpp::lib::asio::error_code const& ec)
 {
-  //no jitter, fixed power root.
+  if (ec)
+  {
+    return;
+  }
+
+  if (con_state_ == con_opening)
+  {
+    ConnectInternal();
+  }
+}
+
+unsigned Signal::NextDelay()
+{
+  //fixed power root with jitter, to spread reconnections of many clients.
   unsigned reconn_made = std::min<unsigned>(reconn_made_, 32);//protect the pow result to be too big.
-  return static_cast<unsigned>(std::min<double>(reconn_delay_ * pow(1.5, reconn_made), reconn_delay_max_));
+  double delay = std::min<double>(reconn_delay_ * pow(1.5, reconn_made), reconn_delay_max_);
+
+  switch (reconn_jitter_)
+  {
+  case jitter_none:
+    break;
+  case jitter_equal:
+    delay = delay / 2 + std::uniform_real_distribution<double>(0, delay / 2)(reconn_random_);
+    break;
+  case jitter_full:
+    delay = std::uniform_real_distribution<double>(0, delay)(reconn_random_);
+    break;
+  case jitter_decorrelated:
+  {
+    double last = (reconn_made_ == 0 || reconn_last_delay_ < reconn_delay_) ? reconn_delay_ : reconn_last_delay_;
+    delay = std::uniform_real_distribution<double>(reconn_delay_, last * 3)(reconn_random_);
+    delay = std::min<double>(delay, reconn_delay_max_);
+    break;
+  }
+  }
+
+  reconn_last_delay_ = static_cast<unsigned>(delay);
+
+  {
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    stats_.last_delay = reconn_last_delay_;
+  }
+
+  return reconn_last_delay_;
+}
+
+Signal::ReconnectStats Signal::reconnect_stats()
+{
+  std::lock_guard<std::mutex> lock(stats_lock_);
+  return stats_;
+}
+
+void Signal::SetConnectRate(double rate, double burst)
+{
+  ConnectLimiter().Set(rate, burst);
+  LOG_F( INFO ) << "rate is " << rate << ", burst is " << burst;
+}
+
+TokenBucket& Signal::ConnectLimiter()
+{
+  static TokenBucket limiter;
+  return limiter;
 }
 
 
 void Signal::OnOpen(websocketpp::connection_hdl con)
+{
+  strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::OnOpenInternal, this, con)));
+}
+
+void Signal::OnOpenInternal(websocketpp::connection_hdl con)
 {
   LOG_F(WARNING) << "Connected.";
   con_state_ = con_opened;
-  con_hdl_ = con;
+  set_connection(con);
   reconn_made_ = 0;
 
   SendOpenCommand();
@@ -302,10 +769,9 @@ void Signal::OnClose(websocketpp::connection_hdl con)
   // This routine will not be called when attempt to connection failed.
   //
 
-  con_state_ = con_closed;
   websocketpp::lib::error_code ec;
   websocketpp::close::status::value code = websocketpp::close::status::normal;
-  client_type::connection_ptr conn_ptr = client_.get_con_from_hdl(con, ec);
+  client_type::connection_ptr conn_ptr = client_->get_con_from_hdl(con, ec);
   if (ec) {
     LOG_F(LERROR) << "get conn failed" << ec;
   }
@@ -313,7 +779,13 @@ void Signal::OnClose(websocketpp::connection_hdl con)
     code = conn_ptr->get_local_close_code();
   }
 
-  con_hdl_.reset();
+  strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::OnCloseInternal, this, code)));
+}
+
+void Signal::OnCloseInternal(websocketpp::close::status::value code)
+{
+  SetClosed();
+  set_connection(websocketpp::connection_hdl());
 
   if (code == websocketpp::close::status::normal)
   {
@@ -321,21 +793,21 @@ void Signal::OnClose(websocketpp::connection_hdl con)
   }
   else
   {
+    {
+      std::lock_guard<std::mutex> lock(stats_lock_);
+      stats_.disconnects++;
+    }
+
     //
-    // TODO: Implement seamless signal reconnection. Don't close existing ice connection.
-    //  Reconstruction of (creating and joining) channel has to be implemented.
+    // Seamless signal reconnection. Existing ice connections are kept and
+    // the session is resumed by 'open' command with previous session_id.
+    // Control re-creates the channel when the session is opened again.
     //
 
-    //if (reconn_made_<reconn_attempts_)
-    //{
-    //  LOG_F(LS_WARNING) << "Reconnect for attempt:" << reconn_made_;
-    //  unsigned delay = this->NextDelay();
-    //  reconn_timer_.reset(new websocketpp::lib::asio::steady_timer(client_.get_io_service()));
-    //  websocketpp::lib::asio::error_code ec;
-    //  reconn_timer_->expires_from_now(websocketpp::lib::asio::milliseconds(delay), ec);
-    //  reconn_timer_->async_wait(websocketpp::lib::bind(&Signal::TimeoutReconnect, this, websocketpp::lib::placeholders::_1));
-    //  return;
-    //}
+    if (ScheduleReconnect())
+    {
+      return;
+    }
 
     SignalOnClosed_(code);
   }
@@ -353,7 +825,7 @@ void Signal::OnFail(websocketpp::connection_hdl con)
 
   websocketpp::lib::error_code ec;
   websocketpp::close::status::value code = websocketpp::close::status::abnormal_close;
-  client_type::connection_ptr conn_ptr = client_.get_con_from_hdl(con, ec);
+  client_type::connection_ptr conn_ptr = client_->get_con_from_hdl(con, ec);
   if (ec) {
     LOG_F(LERROR) << "get conn failed" << ec;
   }
@@ -361,21 +833,23 @@ void Signal::OnFail(websocketpp::connection_hdl con)
     code = conn_ptr->get_local_close_code();
   }
 
-  con_hdl_.reset();
-  con_state_ = con_closed;
+  strand_->dispatch(Guard(websocketpp::lib::bind(&Signal::OnFailInternal, this, code)));
+}
+
+void Signal::OnFailInternal(websocketpp::close::status::value code)
+{
+  set_connection(websocketpp::connection_hdl());
+  SetClosed();
 
   LOG_F(LERROR) << "Connection failed.";
 
-  if (reconn_made_<reconn_attempts_)
   {
-    LOG_F(WARNING) << "Reconnect for attempt:" << reconn_made_;
-    unsigned delay = this->NextDelay();
-    reconn_timer_.reset(new asio::steady_timer(client_.get_io_service()));
-    websocketpp::lib::asio::error_code ec;
-    reconn_timer_->expires_from_now(websocketpp::lib::asio::milliseconds(delay), ec);
-    reconn_timer_->async_wait(websocketpp::lib::bind(&Signal::TimeoutReconnect, this, websocketpp::lib::placeholders::_1));
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    stats_.failures++;
   }
-  else {
+
+  if (!ScheduleReconnect())
+  {
     SignalOnClosed_(code);
   }
 }
@@ -383,22 +857,47 @@ void Signal::OnFail(websocketpp::connection_hdl con)
 
 void Signal::OnMessage(websocketpp::connection_hdl con, client_type::message_ptr msg)
 {
-  Json::Reader reader;
-  Json::Value jmessage;
-
-  if (!reader.parse(msg->get_payload(), jmessage)) {
-    LOG_F(WARNING) << "Received unknown message: " << msg->get_payload();
-    return;
+  // Decoded here while the payload is valid, and handled on strand_ with
+  // the session state
+  std::shared_ptr<Json::Value> message = std::make_shared<Json::Value>();
+  Json::Value& jmessage = *message;
+
+  // The payload may be a view of the read buffer, don't copy it
+  const char* data = msg->get_payload_data();
+  const size_t size = msg->get_payload_size();
+
+  if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+    if (!SignalCodec::Decode(data, size, &jmessage)) {
+      LOG_F(WARNING) << "Received unknown binary message, size is " << size;
+      return;
+    }
+  }
+  else {
+    Json::Reader reader;
+    if (!reader.parse(data, data + size, jmessage)) {
+      LOG_F(WARNING) << "Received unknown message: " << string(data, size);
+      return;
+    }
   }
 
   LOG_F( LS_VERBOSE ) << jmessage.toStyledString();
-  OnCommandReceived(jmessage);
+  strand_->dispatch(Guard([this, message] () { OnCommandReceived(*message); }));
 }
 
 
 void Signal::ResetState()
 {
-  client_.reset();
+  // A shared io_service is running by other connections
+  if (!io_service_) {
+    client_->reset();
+  }
+}
+
+void Signal::SetClosed()
+{
+  std::lock_guard<std::mutex> lock(closed_lock_);
+  con_state_ = con_closed;
+  closed_cv_.notify_all();
 }
 
 Signal::context_ptr Signal::OnTlsInit(websocketpp::connection_hdl conn)
@@ -34,6 +34,13 @@
 #define __PEERAPI_SIGNAL_H__
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 #if _DEBUG || DEBUG
 #include <websocketpp/config/debug_asio.hpp>
@@ -43,10 +50,13 @@
 
 #include "websocketpp/client.hpp"
 #include "websocketpp/common/thread.hpp"
+#include "websocketpp/message_buffer/pool.hpp"
 
 #include "webrtc/base/sigslot.h"
 #include "webrtc/base/json.h"
 
+#include "tokenbucket.h"
+
 
 namespace peerapi {
 
@@ -72,6 +82,34 @@ protected:
 };
 
 
+//
+// class SignalIoService
+//
+// An asio io_service driven by a pool of threads. Signal instances attached
+// to it share the pool instead of spawning a network thread each.
+//
+
+class SignalIoService {
+public:
+  explicit SignalIoService(size_t threads);
+  ~SignalIoService();
+
+  asio::io_service& io_service() { return io_service_; }
+  size_t threads() const { return threads_.size(); }
+
+  // True if called from one of the threads of the pool
+  bool running_in_this_thread() const;
+
+  // Process-wide pool, created on first use and released with the last user
+  static std::shared_ptr<SignalIoService> Shared(size_t threads);
+
+private:
+  asio::io_service io_service_;
+  std::unique_ptr<asio::io_service::work> work_;
+  std::vector<std::thread> threads_;
+};
+
+
 class Signal
   : public SignalInterface {
 public:
@@ -83,16 +121,54 @@ public:
     con_closed
   };
 
+  // Randomization of reconnect delay to avoid reconnecting in lockstep
+  enum reconn_jitter
+  {
+    jitter_none,          // base * 1.5^n
+    jitter_equal,         // half of the delay is random
+    jitter_full,          // random between 0 and the delay
+    jitter_decorrelated   // random between base and 3 times the last delay
+  };
+
+  struct ReconnectStats
+  {
+    uint64_t attempts = 0;      // Connection attempts to signal server
+    uint64_t failures = 0;      // Failed connection attempts
+    uint64_t disconnects = 0;   // Abnormal disconnections
+    uint64_t resumed = 0;       // Sessions resumed after reconnection
+    uint64_t throttled = 0;     // Attempts delayed by the connection rate limit
+    unsigned last_delay = 0;    // Last reconnect delay in milliseconds
+  };
+
   using string = std::string;
 
 #if _DEBUG || DEBUG
-  typedef websocketpp::config::debug_asio_tls client_config;
+  typedef websocketpp::config::debug_asio_tls base_client_config;
 #else
-  typedef websocketpp::config::asio_tls_client client_config;
+  typedef websocketpp::config::asio_tls_client base_client_config;
 #endif //DEBUG
+
+  // Messages are recycled by a per-connection pool instead of allocated
+  // for every frame. Commands sent within write_flush_delay ms of each other,
+  // such as trickled ICE candidates, are written in one TLS record.
+  struct client_config : public base_client_config {
+    typedef client_config type;
+    typedef websocketpp::message_buffer::message<
+        websocketpp::message_buffer::pool::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::pool::con_msg_manager<message_type>
+        con_msg_manager_type;
+    typedef websocketpp::message_buffer::pool::endpoint_msg_manager<
+        con_msg_manager_type> endpoint_msg_manager_type;
+
+    static const long write_flush_delay = 5;
+  };
+
   typedef websocketpp::client<client_config> client_type;
 
-  Signal(const string url);
+  // io_service: A shared io_service to attach to. If null, Signal runs
+  //             its own network thread.
+  Signal(const string url,
+         std::shared_ptr<SignalIoService> io_service = nullptr);
   ~Signal();
 
   void Open(const string& id, const string& password);
@@ -111,6 +187,15 @@ public:
   void set_reconnect_attempts(unsigned attempts) { reconn_attempts_ = attempts; }
   void set_reconnect_delay(unsigned millis) { reconn_delay_ = millis; if (reconn_delay_max_<millis) reconn_delay_max_ = millis; }
   void set_reconnect_delay_max(unsigned millis) { reconn_delay_max_ = millis; if (reconn_delay_>millis) reconn_delay_ = millis; }
+  void set_reconnect_jitter(reconn_jitter jitter) { reconn_jitter_ = jitter; }
+  void set_binary_encoding(bool enable) { binary_enabled_ = enable; }
+
+  ReconnectStats reconnect_stats();
+
+  // Limit connection attempts of all Signal instances in this process.
+  // rate: attempts per second (0 is unlimited), burst: bucket size
+  // Setting the same rate and burst again keeps the tokens of the bucket.
+  static void SetConnectRate(double rate, double burst);
 
 
 protected:
@@ -120,12 +205,24 @@ protected:
 private:
   void SendOpenCommand();
   void OnCommandReceived(Json::Value& message);
-
-  void RunLoop();
+  void OnOpenReceived(const Json::Value& data);
+  void SendPendingCommands();
+  void SendMessage(const Json::Value& message, websocketpp::lib::error_code& ec);
+  bool QueueCommand(const Json::Value& message);
+  websocketpp::connection_hdl connection();
+  void set_connection(websocketpp::connection_hdl con);
+
+  static void RunLoop(std::shared_ptr<client_type> client);
   void ConnectInternal();
+  void AbortInternal();
+  void WaitClosed();
+  void ReleaseHandlers();
   void CloseInternal(websocketpp::close::status::value const& code, string const& desc);
   void TimeoutReconnect(websocketpp::lib::asio::error_code const& ec);
-  unsigned NextDelay() const;
+  void TimeoutThrottle(websocketpp::lib::asio::error_code const& ec);
+  bool ScheduleReconnect();
+  void CancelReconnect();
+  unsigned NextDelay();
 
   //websocket callbacks
   void OnFail(websocketpp::connection_hdl con);
@@ -133,23 +230,92 @@ private:
   void OnClose(websocketpp::connection_hdl con);
   void OnMessage(websocketpp::connection_hdl con, client_type::message_ptr msg);
 
+  // websocket callbacks run on the strand of the connection. The state and
+  // the reconnect timer are handled on strand_ by these.
+  void OnFailInternal(websocketpp::close::status::value code);
+  void OnOpenInternal(websocketpp::connection_hdl con);
+  void OnCloseInternal(websocketpp::close::status::value code);
+
   void ResetState();
+  void SetClosed();
 
   typedef websocketpp::lib::shared_ptr<asio::ssl::context> context_ptr;
-  context_ptr OnTlsInit(websocketpp::connection_hdl con);
+  static context_ptr OnTlsInit(websocketpp::connection_hdl con);
 
-  // Connection pointer for client functions.
+  //
+  // Handlers bound to this instance run under the lock of lifetime_, and do
+  // nothing once Teardown cleared alive. A connection that is still closing
+  // after Teardown keeps the client alive through the handlers it holds.
+  //
+
+  struct Lifetime
+  {
+    std::recursive_mutex lock;
+    bool alive = true;
+    std::shared_ptr<client_type> client;
+  };
+
+  template <typename Handler>
+  struct Guarded
+  {
+    std::shared_ptr<Lifetime> lifetime;
+    Handler handler;
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+      std::lock_guard<std::recursive_mutex> lock(lifetime->lock);
+      if (lifetime->alive) handler(std::forward<Args>(args)...);
+    }
+  };
+
+  template <typename Handler>
+  Guarded<Handler> Guard(Handler handler) {
+    return Guarded<Handler>{ lifetime_, handler };
+  }
+
+  // Shared mode if io_service_ is not null. It is declared before client_
+  // so that it is destroyed after it. The resolver, connections and timers
+  // of client_ refer to the io_service until they are destroyed.
+  std::shared_ptr<SignalIoService> io_service_;
+
+  // Connection pointer for client functions. Written on strand_ and read by
+  // senders on any thread, so guarded by pending_lock_.
   websocketpp::connection_hdl con_hdl_;
-  client_type client_;
+  std::shared_ptr<client_type> client_;
+  std::shared_ptr<Lifetime> lifetime_;
+
+  std::unique_ptr<asio::io_service::strand> strand_;
+  std::condition_variable closed_cv_;
+  std::mutex closed_lock_;
 
   std::unique_ptr<std::thread> network_thread_;
   std::unique_ptr<websocketpp::lib::asio::steady_timer> reconn_timer_;
-  con_state con_state_;
+  std::atomic<con_state> con_state_;
 
   unsigned reconn_delay_;
   unsigned reconn_delay_max_;
   unsigned reconn_attempts_;
   unsigned reconn_made_;
+  unsigned reconn_last_delay_;
+  reconn_jitter reconn_jitter_;
+  std::mt19937 reconn_random_;
+
+  ReconnectStats stats_;
+  std::mutex stats_lock_;
+
+  static TokenBucket& ConnectLimiter();
+
+  // Commands sent while reconnecting are queued until the session is resumed.
+  // pending_lock_ guards con_hdl_ as well.
+  bool reconnecting_;
+  std::deque<Json::Value> pending_commands_;
+  std::mutex pending_lock_;
+  const size_t max_pending_commands_ = 1024;
+
+  // binary_enabled_: Negotiate binary encoding by 'open' command
+  // binary_: Commands are sent as binary frames
+  bool binary_enabled_;
+  std::atomic<bool> binary_;
 
   // Signal server
   string url_;
@@ -0,0 +1,649 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#if defined(WEBRTC_WIN)
+#pragma warning(disable:4503)
+#endif
+
+#include <map>
+#include <set>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+
+#include "websocketpp/config/asio.hpp"
+#include "websocketpp/server.hpp"
+
+#include "webrtc/base/json.h"
+#include "webrtc/base/sslidentity.h"
+
+#include "signalserver.h"
+#include "signalcodec.h"
+#include "logging.h"
+
+namespace peerapi {
+
+//
+// class SignalServer::Impl
+//
+
+class SignalServer::Impl {
+public:
+  using string = std::string;
+  typedef websocketpp::server<websocketpp::config::asio_tls> server_type;
+  typedef websocketpp::lib::shared_ptr<asio::ssl::context> context_ptr;
+
+  Impl();
+  ~Impl();
+
+  bool Start(const string& address, uint16_t port);
+  void Stop();
+
+  uint16_t port_;
+  string address_;
+  uint32_t resume_grace_ms_;
+
+private:
+  typedef std::shared_ptr<asio::steady_timer> timer_ptr;
+
+  struct Session {
+    string session_id;
+    string channel;         // A channel created by this session (peer name)
+    bool binary = false;    // Binary encoding has been negotiated
+    std::set<string> peers; // Peers this session has exchanged commands with
+  };
+
+  // A disconnected session, expired by the timer unless it is resumed
+  struct Resumable {
+    string channel;
+    std::set<string> peers;
+    timer_ptr timer;
+  };
+
+  using Sessions = std::map<websocketpp::connection_hdl, Session,
+                            std::owner_less<websocketpp::connection_hdl>>;
+
+  // websocket callbacks
+  void OnOpen(websocketpp::connection_hdl con);
+  void OnClose(websocketpp::connection_hdl con);
+  void OnMessage(websocketpp::connection_hdl con, server_type::message_ptr msg);
+  context_ptr OnTlsInit(websocketpp::connection_hdl con);
+
+  // Commands
+  void OnOpenCommand(websocketpp::connection_hdl con, Session& session, const Json::Value& data);
+  void OnCreateChannel(websocketpp::connection_hdl con, Session& session, const Json::Value& data);
+  void OnJoinChannel(websocketpp::connection_hdl con, Session& session, const Json::Value& data);
+  void OnLeaveChannel(Session& session, const Json::Value& data);
+  void Relay(Session& session, const string& channel, const string& command, const Json::Value& data);
+  void AddPeer(Session& session, websocketpp::connection_hdl owner, const string& channel);
+  void OnResumeExpired(const string& session_id, timer_ptr timer, const asio::error_code& ec);
+
+  void Send(websocketpp::connection_hdl con, const string& command,
+            const Json::Value& data, const string& peer_id = "");
+  string CreateSessionId();
+  string PeerId(const Session& session) const;
+
+  server_type server_;
+  std::unique_ptr<std::thread> network_thread_;
+  std::mt19937_64 random_;
+
+  string certificate_pem_;
+  string private_key_pem_;
+
+  Sessions sessions_;
+  std::map<string, websocketpp::connection_hdl> channels_;
+
+  // Disconnected sessions, restored if the session is resumed
+  std::map<string, Resumable> resumable_;
+  bool stopping_;
+};
+
+
+SignalServer::Impl::Impl()
+    : port_(0),
+      resume_grace_ms_(30 * 1000),
+      random_(std::random_device()()),
+      stopping_(false) {
+
+  server_.clear_access_channels(websocketpp::log::alevel::all);
+  server_.clear_error_channels(websocketpp::log::elevel::all);
+
+  server_.init_asio();
+  server_.set_reuse_addr(true);
+
+  using websocketpp::lib::placeholders::_1;
+  using websocketpp::lib::placeholders::_2;
+  using websocketpp::lib::bind;
+
+  server_.set_open_handler(bind(&Impl::OnOpen, this, _1));
+  server_.set_close_handler(bind(&Impl::OnClose, this, _1));
+  server_.set_message_handler(bind(&Impl::OnMessage, this, _1, _2));
+  server_.set_tls_init_handler(bind(&Impl::OnTlsInit, this, _1));
+}
+
+SignalServer::Impl::~Impl() {
+  Stop();
+}
+
+bool SignalServer::Impl::Start(const string& address, uint16_t port) {
+
+  if (network_thread_) {
+    LOG_F( WARNING ) << "Already started";
+    return false;
+  }
+
+  //
+  // Self-signed certificate. Signal client doesn't verify it.
+  //
+
+  std::unique_ptr<rtc::SSLIdentity> identity(
+      rtc::SSLIdentity::Generate("peerapi", rtc::KT_ECDSA));
+  if (!identity) {
+    LOG_F( LERROR ) << "Failed to generate certificate";
+    return false;
+  }
+
+  certificate_pem_ = identity->certificate().ToPEMString();
+  private_key_pem_ = identity->PrivateKeyToPEMString();
+
+  //
+  // Listen
+  //
+
+  websocketpp::lib::error_code ec;
+  asio::error_code aec;
+  asio::ip::tcp::endpoint endpoint(asio::ip::address::from_string(address, aec), port);
+  if (aec) {
+    LOG_F( LERROR ) << "Invalid address " << address << ", " << aec.message();
+    return false;
+  }
+
+  server_.listen(endpoint, ec);
+  if (ec) {
+    LOG_F( LERROR ) << "Listen failed, " << ec.message();
+    return false;
+  }
+
+  server_.start_accept(ec);
+  if (ec) {
+    LOG_F( LERROR ) << "Accept failed, " << ec.message();
+    server_.stop_listening(ec);
+    return false;
+  }
+
+  port_ = server_.get_local_endpoint(aec).port();
+  address_ = address;
+  stopping_ = false;
+
+  // The io_service has been stopped if the server is started again
+  server_.reset();
+
+  network_thread_.reset(new std::thread([this] () {
+    server_.run();
+  }));
+
+  LOG_F( INFO ) << "Done, listening " << address_ << ":" << port_;
+  return true;
+}
+
+void SignalServer::Impl::Stop() {
+
+  if (!network_thread_) return;
+
+  server_.get_io_service().post([this] () {
+    websocketpp::lib::error_code ec;
+    server_.stop_listening(ec);
+    stopping_ = true;
+
+    // Pending timers would keep the io_service running
+    for (auto& resumable : resumable_) {
+      asio::error_code aec;
+      resumable.second.timer->cancel(aec);
+    }
+
+    for (auto& session : sessions_) {
+      server_.close(session.first, websocketpp::close::status::going_away,
+                    "Server shutdown", ec);
+    }
+  });
+
+  if (network_thread_->joinable()) {
+    network_thread_->join();
+  }
+  network_thread_.reset();
+
+  sessions_.clear();
+  channels_.clear();
+  resumable_.clear();
+  LOG_F( INFO ) << "Done";
+}
+
+void SignalServer::Impl::OnOpen(websocketpp::connection_hdl con) {
+  sessions_[con] = Session();
+}
+
+void SignalServer::Impl::OnClose(websocketpp::connection_hdl con) {
+  auto found = sessions_.find(con);
+  if (found == sessions_.end()) return;
+
+  //
+  // Release the channel only. Peers of this session are not closed, so the
+  // session may be resumed by reconnection.
+  //
+
+  const Session& session = found->second;
+  auto owner = channels_.find(session.channel);
+  if (owner != channels_.end() && !owner->second.owner_before(con) &&
+      !con.owner_before(owner->second)) {
+    channels_.erase(owner);
+  }
+
+  if (!stopping_ && !session.session_id.empty() && !session.channel.empty()) {
+    Resumable& resumable = resumable_[session.session_id];
+    resumable.channel = session.channel;
+    resumable.peers = session.peers;
+    resumable.timer = std::make_shared<asio::steady_timer>(server_.get_io_service());
+    resumable.timer->expires_from_now(std::chrono::milliseconds(resume_grace_ms_));
+    resumable.timer->async_wait(std::bind(&Impl::OnResumeExpired, this, session.session_id,
+                                          resumable.timer, std::placeholders::_1));
+  }
+
+  sessions_.erase(found);
+}
+
+//
+// A disconnected session has not been resumed within the grace period.
+// Peers of the session are closed by 'peerclosed' command.
+//
+
+void SignalServer::Impl::OnResumeExpired(const string& session_id, timer_ptr timer,
+                                         const asio::error_code& ec) {
+  if (ec) return;
+
+  auto found = resumable_.find(session_id);
+  if (found == resumable_.end() || found->second.timer != timer) return;
+
+  Resumable resumable = found->second;
+  resumable_.erase(found);
+
+  for (auto& peer : resumable.peers) {
+    auto owner = channels_.find(peer);
+    if (owner == channels_.end()) continue;
+
+    auto owner_session = sessions_.find(owner->second);
+    if (owner_session != sessions_.end()) {
+      owner_session->second.peers.erase(resumable.channel);
+    }
+
+    Send(owner->second, "peerclosed", Json::Value(Json::objectValue), resumable.channel);
+  }
+
+  LOG_F( INFO ) << "Done, session is expired, " << resumable.channel;
+}
+
+void SignalServer::Impl::OnMessage(websocketpp::connection_hdl con,
+                                   server_type::message_ptr msg) {
+  auto found = sessions_.find(con);
+  if (found == sessions_.end()) return;
+
+  Session& session = found->second;
+  Json::Value message;
+  const string& payload = msg->get_payload();
+
+  if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+    if (!SignalCodec::Decode(payload.data(), payload.size(), &message)) {
+      LOG_F( WARNING ) << "Invalid binary message";
+      return;
+    }
+  }
+  else {
+    Json::Reader reader;
+    if (!reader.parse(payload, message)) {
+      LOG_F( WARNING ) << "Invalid message: " << payload;
+      return;
+    }
+  }
+
+  string command;
+  string channel;
+  Json::Value data;
+
+  if (!rtc::GetStringFromJsonObject(message, "command", &command)) {
+    LOG_F( WARNING ) << "No command";
+    return;
+  }
+
+  if (!rtc::GetValueFromJsonObject(message, "data", &data)) {
+    data = Json::Value(Json::objectValue);
+  }
+
+  if (!rtc::GetStringFromJsonObject(message, "channel", &channel)) {
+    channel.clear();
+  }
+
+  if (command == "open") {
+    OnOpenCommand(con, session, data);
+    return;
+  }
+
+  if (session.session_id.empty()) {
+    LOG_F( WARNING ) << "Session is not opened, command is " << command;
+    return;
+  }
+
+  if (command == "createchannel") {
+    OnCreateChannel(con, session, data);
+  }
+  else if (command == "joinchannel") {
+    OnJoinChannel(con, session, data);
+  }
+  else if (command == "leavechannel") {
+    OnLeaveChannel(session, data);
+  }
+  else if (!channel.empty()) {
+    // offersdp, answersdp, ice_candidate and others
+    Relay(session, channel, command, data);
+  }
+  else {
+    LOG_F( WARNING ) << "Unknown command " << command;
+  }
+}
+
+SignalServer::Impl::context_ptr SignalServer::Impl::OnTlsInit(websocketpp::connection_hdl con) {
+  context_ptr ctx = context_ptr(new asio::ssl::context(asio::ssl::context::sslv23));
+  asio::error_code ec;
+
+  ctx->set_options(asio::ssl::context::default_workarounds |
+                   asio::ssl::context::no_sslv2 |
+                   asio::ssl::context::no_sslv3 |
+                   asio::ssl::context::single_dh_use, ec);
+  ctx->use_certificate_chain(asio::buffer(certificate_pem_), ec);
+  ctx->use_private_key(asio::buffer(private_key_pem_), asio::ssl::context::pem, ec);
+
+  if (ec) {
+    LOG_F( LERROR ) << "Init tls failed, reason:" << ec.message();
+  }
+
+  return ctx;
+}
+
+
+//
+// 'open' command
+//
+
+void SignalServer::Impl::OnOpenCommand(websocketpp::connection_hdl con,
+                                       Session& session,
+                                       const Json::Value& data) {
+  string session_id;
+
+  // Resume a session if the client has reconnected
+  if (!rtc::GetStringFromJsonObject(data, "session_id", &session_id) ||
+      session_id.empty()) {
+    session_id = CreateSessionId();
+  }
+
+  session.session_id = session_id;
+
+  // Restore the channel, so commands from the resumed session are
+  // addressed by the same peer name before the channel is re-created.
+  auto resumed = resumable_.find(session_id);
+  if (resumed != resumable_.end()) {
+    const string& channel = resumed->second.channel;
+    if (channels_.find(channel) == channels_.end()) {
+      channels_[channel] = con;
+      session.channel = channel;
+      session.peers = resumed->second.peers;
+    }
+
+    asio::error_code ec;
+    resumed->second.timer->cancel(ec);
+    resumable_.erase(resumed);
+  }
+
+  Json::Value reply;
+  reply["result"] = true;
+  reply["session_id"] = session_id;
+
+  Json::Value encodings;
+  if (rtc::GetValueFromJsonObject(data, "encodings", &encodings) && encodings.isArray()) {
+    for (Json::ArrayIndex i = 0; i < encodings.size(); i++) {
+      if (encodings[i].isString() && encodings[i].asString() == SignalCodec::kName) {
+        reply["encoding"] = SignalCodec::kName;
+      }
+    }
+  }
+
+  // 'open' reply is always JSON, then binary is used if negotiated
+  Send(con, "open", reply);
+  session.binary = reply.isMember("encoding");
+}
+
+
+//
+// 'createchannel' command
+//
+
+void SignalServer::Impl::OnCreateChannel(websocketpp::connection_hdl con,
+                                         Session& session,
+                                         const Json::Value& data) {
+  string name;
+  Json::Value reply;
+
+  if (!rtc::GetStringFromJsonObject(data, "name", &name) || name.empty()) {
+    reply["result"] = false;
+    reply["desc"] = "No channel name";
+    Send(con, "channelcreate", reply);
+    return;
+  }
+
+  reply["name"] = name;
+
+  auto owner = channels_.find(name);
+  if (owner != channels_.end()) {
+    auto owner_session = sessions_.find(owner->second);
+
+    // A resumed session takes over its channel from the stale connection
+    if (owner_session != sessions_.end() &&
+        owner_session->second.session_id != session.session_id) {
+      reply["result"] = false;
+      reply["desc"] = "Channel already exists";
+      Send(con, "channelcreate", reply);
+      return;
+    }
+
+    if (owner_session != sessions_.end()) {
+      owner_session->second.channel.clear();
+    }
+  }
+
+  channels_[name] = con;
+  session.channel = name;
+
+  reply["result"] = true;
+  Send(con, "channelcreate", reply);
+}
+
+
+//
+// 'joinchannel' command
+//
+
+void SignalServer::Impl::OnJoinChannel(websocketpp::connection_hdl con,
+                                       Session& session,
+                                       const Json::Value& data) {
+  string name;
+  Json::Value reply;
+
+  if (!rtc::GetStringFromJsonObject(data, "name", &name) || name.empty()) {
+    reply["result"] = false;
+    reply["desc"] = "No channel name";
+    Send(con, "channeljoin", reply);
+    return;
+  }
+
+  reply["name"] = name;
+
+  auto owner = channels_.find(name);
+  if (owner == channels_.end()) {
+    reply["result"] = false;
+    reply["desc"] = "Channel not found";
+    Send(con, "channeljoin", reply);
+    return;
+  }
+
+  reply["result"] = true;
+  Send(con, "channeljoin", reply);
+  AddPeer(session, owner->second, name);
+
+  // Owner of the channel creates an offer to the joined peer
+  Json::Value offer;
+  offer["peers"].append(PeerId(session));
+  Send(owner->second, "createoffer", offer);
+}
+
+
+//
+// 'leavechannel' command
+//
+
+void SignalServer::Impl::OnLeaveChannel(Session& session, const Json::Value& data) {
+  string name;
+
+  if (!rtc::GetStringFromJsonObject(data, "name", &name)) {
+    LOG_F( WARNING ) << "No channel name";
+    return;
+  }
+
+  auto owner = channels_.find(name);
+  if (owner == channels_.end()) {
+    return;
+  }
+
+  session.peers.erase(name);
+
+  auto owner_session = sessions_.find(owner->second);
+  if (owner_session != sessions_.end()) {
+    owner_session->second.peers.erase(PeerId(session));
+  }
+
+  Send(owner->second, "peerclosed", data, PeerId(session));
+}
+
+
+//
+// Relay a command to an owner of channel
+//
+
+void SignalServer::Impl::Relay(Session& session, const string& channel,
+                               const string& command, const Json::Value& data) {
+  auto owner = channels_.find(channel);
+  if (owner == channels_.end()) {
+    LOG_F( WARNING ) << "Channel not found, " << channel << ", command is " << command;
+    return;
+  }
+
+  AddPeer(session, owner->second, channel);
+  Send(owner->second, command, data, PeerId(session));
+}
+
+//
+// Peers of a session are closed when the session expires
+//
+
+void SignalServer::Impl::AddPeer(Session& session, websocketpp::connection_hdl owner,
+                                 const string& channel) {
+  if (channel == session.channel) return;
+
+  session.peers.insert(channel);
+
+  auto owner_session = sessions_.find(owner);
+  if (owner_session != sessions_.end() && !session.channel.empty()) {
+    owner_session->second.peers.insert(session.channel);
+  }
+}
+
+void SignalServer::Impl::Send(websocketpp::connection_hdl con,
+                              const string& command,
+                              const Json::Value& data,
+                              const string& peer_id) {
+  auto found = sessions_.find(con);
+  if (found == sessions_.end()) return;
+
+  Json::Value message;
+  message["command"] = command;
+  message["data"] = data;
+  if (!peer_id.empty()) message["peer_id"] = peer_id;
+
+  websocketpp::lib::error_code ec;
+
+  if (found->second.binary) {
+    string payload;
+    SignalCodec::Encode(message, &payload);
+    server_.send(con, payload, websocketpp::frame::opcode::binary, ec);
+  }
+  else {
+    Json::FastWriter writer;
+    server_.send(con, writer.write(message), websocketpp::frame::opcode::text, ec);
+  }
+
+  if (ec) {
+    LOG_F( WARNING ) << "Send failed, " << ec.message();
+  }
+}
+
+std::string SignalServer::Impl::CreateSessionId() {
+  std::ostringstream id;
+  id << std::hex << std::setfill('0')
+     << std::setw(16) << random_() << std::setw(16) << random_();
+  return id.str();
+}
+
+std::string SignalServer::Impl::PeerId(const Session& session) const {
+  // A peer is identified by its channel (peer name) by other peers
+  return session.channel.empty() ? session.session_id : session.channel;
+}
+
+
+//
+// class SignalServer
+//
+
+SignalServer::SignalServer()
+    : impl_(new Impl()) {
+}
+
+SignalServer::~SignalServer() {
+  impl_.reset();
+  LOG_F( INFO ) << "Done";
+}
+
+bool SignalServer::Start(const std::string& address, uint16_t port) {
+  return impl_->Start(address, port);
+}
+
+void SignalServer::Stop() {
+  impl_->Stop();
+}
+
+void SignalServer::set_resume_grace(uint32_t millis) {
+  impl_->resume_grace_ms_ = millis;
+}
+
+uint16_t SignalServer::port() const {
+  return impl_->port_;
+}
+
+std::string SignalServer::url() const {
+  std::ostringstream url;
+  url << "wss://" << impl_->address_ << ":" << impl_->port_ << "/hello";
+  return url.str();
+}
+
+} // namespace peerapi
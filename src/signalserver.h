@@ -0,0 +1,55 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_SIGNALSERVER_H__
+#define __PEERAPI_SIGNALSERVER_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace peerapi {
+
+//
+// class SignalServer
+//
+// A local signal server for tests and benchmarks. It implements the
+// signaling commands of PeerApi (open, createchannel, joinchannel,
+// leavechannel, createoffer, offersdp, answersdp, ice_candidate and
+// peerclosed) on the websocketpp server role, so peers can connect to each
+// other without the public signal server.
+//
+// It listens on localhost with a self-signed certificate and runs on its
+// own network thread. Use url() as 'url' option of Peer.
+//
+// A disconnected session keeps its channel for the resume grace period, so
+// a reconnecting client resumes it without closing its peers.
+//
+
+class SignalServer {
+public:
+  SignalServer();
+  ~SignalServer();
+
+  // Start listening. A port 0 selects an ephemeral port.
+  bool Start(const std::string& address = "127.0.0.1", uint16_t port = 0);
+  void Stop();
+
+  // A disconnected session may be resumed within this time in milliseconds.
+  // Then peers of the session receive 'peerclosed'. Call before Start().
+  void set_resume_grace(uint32_t millis);
+
+  uint16_t port() const;
+  std::string url() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_SIGNALSERVER_H__
@@ -0,0 +1,174 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+#include <iostream>
+#include <string>
+
+#include "peerapi.h"
+#include "signalserver.h"
+
+using namespace std;
+
+
+// Not assert(), so the checks also run in release builds
+static int failures = 0;
+
+#define EXPECT(cond) \
+  do { \
+    if (!(cond)) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #cond << std::endl; \
+      failures++; \
+    } \
+  } while (0)
+
+// Two chunks fill the send buffer of the in-process transport
+const size_t kSendBufferSize = 1024;
+const size_t kChunkSize = 512;
+
+std::string signal_options;
+
+void test_local_transport();
+
+
+int main(int argc, char *argv[]) {
+  std::cout << "Start local transport test" << std::endl;
+
+  peerapi::SignalServer signal_server;
+  if (!signal_server.Start()) {
+    std::cerr << "Failed to start signal server" << std::endl;
+    return 1;
+  }
+  signal_options = "{\"url\": \"" + signal_server.url() + "\", \"ice_mode\": \"local\","
+                   " \"local_transport\": true,"
+                   " \"send_buffer_size\": " + std::to_string(kSendBufferSize) + "}";
+
+  test_local_transport();
+
+  signal_server.Stop();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Exit local transport test" << std::endl;
+  return 0;
+}
+
+//
+// peer2 sends "Ping" and peer1 answers "Pong". Then peer2 sends chunks until
+// the send buffer is full, and sends one more on "writable" before closing.
+//
+
+void test_local_transport() {
+
+  std::string server_id = Peer::CreateRandomUuid();
+  std::string client_id = Peer::CreateRandomUuid();
+
+  Peer peer1(server_id);
+  Peer peer2(client_id);
+
+  peer1.SetOptions(signal_options);
+  peer2.SetOptions(signal_options);
+
+  const std::string chunk(kChunkSize, 'x');
+  size_t sent = 0;
+  size_t received = 0;
+  bool overrun = false;
+  bool resumed = false;
+  bool pong = false;
+
+  peer1.On("open", function_peer( string peer_id ) {
+    EXPECT(peer_id == server_id);
+    std::cout << "peer1: open" << std::endl;
+    peer2.Open();
+  });
+
+  peer1.On("message", function_peer( string peer_id, char* data, size_t size ) {
+    EXPECT(peer_id == client_id);
+    if ( std::string(data, size) == "Ping" ) {
+      std::cout << "peer1: ping" << std::endl;
+      EXPECT(peer1.Send(client_id, "Pong"));
+      return;
+    }
+
+    EXPECT(size == kChunkSize);
+    received += size;
+  });
+
+  peer1.On("close", function_peer( string peer_id, CloseCode code, string desc ) {
+    EXPECT( peer_id == client_id || peer_id == server_id );
+    if ( peer_id == client_id ) {
+      std::cout << "peer1: peer2 disconnected" << std::endl;
+
+      // Every chunk sent before closing has been delivered
+      EXPECT(received == sent);
+    }
+    else if ( peer_id == server_id ) {
+      std::cout << "peer1: close" << std::endl;
+      peer2.Close();
+    }
+  });
+
+
+  peer2.On("open", function_peer( string peer_id ) {
+    EXPECT(peer_id == client_id);
+    std::cout << "peer2: open" << std::endl;
+    peer2.Connect(server_id);
+  });
+
+  peer2.On("connect", function_peer( string peer_id ) {
+    EXPECT(peer_id == server_id);
+    std::cout << "peer2: peer1 connected" << std::endl;
+    EXPECT(peer2.Send(server_id, "Ping"));
+  });
+
+  peer2.On("message", function_peer( string peer_id, char* data, size_t size ) {
+    EXPECT(peer_id == server_id);
+    EXPECT(std::string(data, size) == "Pong");
+    std::cout << "peer2: pong" << std::endl;
+    pong = true;
+
+    // Nothing is delivered until this callback returns
+    while ( peer2.Send(server_id, chunk) ) {
+      sent += chunk.size();
+      if ( sent > kSendBufferSize ) break;
+    }
+
+    EXPECT(sent == kSendBufferSize);
+    overrun = true;
+  });
+
+  peer2.On("writable", function_peer( string peer_id ) {
+    if ( !overrun || resumed ) return;
+
+    EXPECT(peer_id == server_id);
+    std::cout << "peer2: writable" << std::endl;
+    resumed = true;
+
+    EXPECT(peer2.Send(server_id, chunk));
+    sent += chunk.size();
+    peer2.Close(server_id);
+  });
+
+  peer2.On("close", function_peer( string peer_id, CloseCode code, string desc ) {
+    EXPECT( peer_id == server_id || peer_id == client_id );
+    if ( peer_id == server_id ) {
+      std::cout << "peer2: peer1 disconnected" << std::endl;
+      peer1.Close();
+    }
+    else if ( peer_id == client_id ) {
+      std::cout << "peer2: close" << std::endl;
+      Peer::Stop();
+    }
+  });
+
+  peer1.Open();
+  Peer::Run();
+
+  EXPECT(pong);
+  EXPECT(resumed);
+}
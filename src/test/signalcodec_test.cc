@@ -0,0 +1,271 @@
+/*
+*  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+*
+*  Ryan Lee
+*/
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "signalcodec.h"
+
+using namespace std;
+using peerapi::SignalCodec;
+
+
+// Not assert(), so the checks also run in release builds
+static int failures = 0;
+
+#define EXPECT(cond) \
+  do { \
+    if (!(cond)) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #cond << std::endl; \
+      failures++; \
+    } \
+  } while (0)
+
+void test_nested_object();
+void test_string_boundary();
+void test_binary_boundary();
+void test_integer();
+void test_truncated();
+void test_depth_limit();
+void test_index_out_of_table();
+
+
+int main(int argc, char *argv[]) {
+  std::cout << "Start signal codec test" << std::endl;
+
+  test_nested_object();
+  test_string_boundary();
+  test_binary_boundary();
+  test_integer();
+  test_truncated();
+  test_depth_limit();
+  test_index_out_of_table();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Exit signal codec test" << std::endl;
+  return 0;
+}
+
+//
+// Helpers
+//
+
+static std::string ToJson(const Json::Value& value) {
+  Json::FastWriter writer;
+  return writer.write(value);
+}
+
+static bool RoundTrip(const Json::Value& value, std::string* encoded = nullptr) {
+  std::string out;
+  Json::Value decoded;
+
+  SignalCodec::Encode(value, &out);
+  if (encoded) *encoded = out;
+  if (!SignalCodec::Decode(out.data(), out.size(), &decoded)) return false;
+  return ToJson(decoded) == ToJson(value);
+}
+
+static bool Decode(const std::string& data, Json::Value* value) {
+  return SignalCodec::Decode(data.data(), data.size(), value);
+}
+
+// Big-endian length of a str/bin header
+static std::string Length(uint64_t size, int bytes) {
+  std::string out;
+  for (int i = bytes - 1; i >= 0; i--) {
+    out.push_back(static_cast<char>((size >> (i * 8)) & 0xff));
+  }
+  return out;
+}
+
+//
+// Tests
+//
+
+void test_nested_object() {
+  Json::Reader reader;
+  Json::Value message;
+
+  EXPECT(reader.parse(
+    "{\"command\":\"ice_candidate\",\"channel\":\"abc\",\"peer_id\":\"peer1\","
+    " \"data\":{\"sdp_mid\":\"data\",\"sdp_mline_index\":0,"
+    "  \"candidate\":\"candidate:1 1 udp 2122260223 192.168.0.2 54321 typ host\","
+    "  \"candidates\":[{\"sdp_mid\":\"audio\",\"sdp_mline_index\":1},"
+    "                  {\"unknown_field\":[true,false,null,1.5,[\"open\"]]}],"
+    "  \"nested\":{\"a\":{\"b\":{\"c\":{}}},\"empty\":[]}}}",
+    message));
+
+  std::string encoded;
+  EXPECT(RoundTrip(message, &encoded));
+
+  // Well-known names are encoded as indexes, so it is smaller than JSON
+  EXPECT(encoded.size() < ToJson(message).size());
+
+  // Unknown command is encoded as a string
+  Json::Value unknown;
+  unknown["command"] = "no_such_command";
+  unknown["data"] = "open";
+  EXPECT(RoundTrip(unknown));
+
+  // Command names are only indexes in the 'command' field
+  Json::Value not_command;
+  not_command["name"] = "open";
+  EXPECT(RoundTrip(not_command, &encoded));
+  EXPECT(encoded.find("open") != std::string::npos);
+}
+
+void test_string_boundary() {
+  struct {
+    size_t size;
+    uint8_t head;
+  } cases[] = {
+    { 0, 0xa0 }, { 31, 0xbf },          // fixstr
+    { 32, 0xd9 }, { 0xff, 0xd9 },       // str8
+    { 0x100, 0xda }, { 0xffff, 0xda },  // str16
+    { 0x10000, 0xdb }                   // str32
+  };
+
+  for (auto& c : cases) {
+    Json::Value value(std::string(c.size, 'x'));
+    std::string encoded;
+    EXPECT(RoundTrip(value, &encoded));
+    EXPECT(!encoded.empty() && static_cast<uint8_t>(encoded[0]) == c.head);
+  }
+}
+
+void test_binary_boundary() {
+  // The encoder never writes bin, but other encoders may. It is read as a string.
+  struct {
+    uint8_t head;
+    int bytes;
+    size_t size;
+  } cases[] = {
+    { 0xc4, 1, 0 }, { 0xc4, 1, 0xff },
+    { 0xc5, 2, 0x100 }, { 0xc5, 2, 0xffff },
+    { 0xc6, 4, 0x10000 }
+  };
+
+  for (auto& c : cases) {
+    std::string data(1, static_cast<char>(c.head));
+    data += Length(c.size, c.bytes);
+    data += std::string(c.size, 'b');
+
+    Json::Value value;
+    EXPECT(Decode(data, &value));
+    EXPECT(value.isString() && value.asString().size() == c.size);
+
+    // One byte short of the length
+    Json::Value truncated;
+    data.pop_back();
+    EXPECT(!Decode(data, &truncated));
+  }
+}
+
+void test_integer() {
+  const int64_t signed_values[] = {
+    -1, -32, -33, INT8_MIN, INT8_MIN - 1, INT16_MIN, INT16_MIN - 1,
+    INT32_MIN, static_cast<int64_t>(INT32_MIN) - 1, INT64_MIN
+  };
+
+  for (auto value : signed_values) {
+    Json::Value decoded;
+    std::string encoded;
+    SignalCodec::Encode(Json::Value(static_cast<Json::LargestInt>(value)), &encoded);
+    EXPECT(Decode(encoded, &decoded));
+    EXPECT(decoded.isInt64() && decoded.asInt64() == value);
+  }
+
+  const uint64_t unsigned_values[] = {
+    0, 0x7f, 0x80, 0xff, 0x100, 0xffff, 0x10000,
+    0xffffffff, 0x100000000ULL, INT64_MAX, UINT64_MAX
+  };
+
+  for (auto value : unsigned_values) {
+    Json::Value decoded;
+    std::string encoded;
+    SignalCodec::Encode(Json::Value(static_cast<Json::LargestUInt>(value)), &encoded);
+    EXPECT(Decode(encoded, &decoded));
+    EXPECT(decoded.isUInt64() && decoded.asUInt64() == value);
+  }
+
+  // Integers in a nested object
+  Json::Value message;
+  message["data"]["small"] = -5;
+  message["data"]["large"] = static_cast<Json::LargestInt>(INT64_MIN);
+  message["data"]["huge"] = static_cast<Json::LargestUInt>(UINT64_MAX);
+  EXPECT(RoundTrip(message));
+}
+
+void test_truncated() {
+  Json::Value message;
+  message["command"] = "offersdp";
+  message["peer_id"] = "peer1";
+  message["data"]["sdp"] = std::string(300, 's');
+  message["data"]["list"].append(static_cast<Json::LargestInt>(INT64_MIN));
+  message["data"]["list"].append(1.5);
+
+  std::string encoded;
+  SignalCodec::Encode(message, &encoded);
+
+  // Every prefix is rejected, including those ending inside a header
+  for (size_t size = 0; size < encoded.size(); size++) {
+    Json::Value value;
+    EXPECT(!SignalCodec::Decode(encoded.data(), size, &value));
+  }
+
+  // Trailing bytes
+  Json::Value value;
+  EXPECT(!Decode(encoded + '\xc0', &value));
+
+  // A length larger than the message
+  EXPECT(!Decode(std::string("\xdb") + Length(0xffffffff, 4) + "abc", &value));
+  EXPECT(!Decode(std::string("\xdd") + Length(0xffffffff, 4), &value));
+  EXPECT(!Decode(std::string("\xdf") + Length(0xffffffff, 4), &value));
+
+  // Unused head
+  EXPECT(!Decode(std::string("\xc1"), &value));
+}
+
+void test_depth_limit() {
+  // A value in 32 nested arrays is in the limit, 33 is not
+  std::string data = std::string(32, '\x91') + '\x00';
+  Json::Value value;
+  EXPECT(Decode(data, &value));
+
+  data = std::string(33, '\x91') + '\x00';
+  EXPECT(!Decode(data, &value));
+
+  // Maps are counted in the same way
+  data.clear();
+  for (int i = 0; i < 33; i++) data += "\x81\xa1k";
+  data += '\x00';
+  EXPECT(!Decode(data, &value));
+}
+
+void test_index_out_of_table() {
+  Json::Value value;
+
+  // {0: 0} is {"command": "open"}
+  EXPECT(Decode(std::string("\x81\x00\x00", 3), &value));
+  EXPECT(value["command"].asString() == "open");
+
+  // Field index out of the table
+  EXPECT(!Decode(std::string("\x81\x7f\x00", 3), &value));
+  EXPECT(!Decode(std::string("\x81\xcd\xff\xff\x00", 5), &value));
+
+  // Command index out of the table
+  EXPECT(!Decode(std::string("\x81\x00\x7f", 3), &value));
+  EXPECT(!Decode(std::string("\x81\x00\xcc\xff", 4), &value));
+
+  // Negative and non-integer keys
+  EXPECT(!Decode(std::string("\x81\xff\x00", 3), &value));
+  EXPECT(!Decode(std::string("\x81\xc3\x00", 3), &value));
+}
@@ -10,10 +10,14 @@
 #include <cassert>
 
 #include "peerapi.h"
+#include "signalserver.h"
 
 using namespace std;
 
 
+// Options to use the local signal server and loopback network
+std::string signal_options;
+
 void test_normal();
 void test_writable();
 
@@ -21,9 +25,19 @@ void test_writable();
 int main(int argc, char *argv[]) {
   std::cout << "Start test" << std::endl;
 
+  peerapi::SignalServer signal_server;
+  if (!signal_server.Start()) {
+    std::cerr << "Failed to start signal server" << std::endl;
+    return 1;
+  }
+  // Data channels over loopback. The in-process transport is in localtransport_test
+  signal_options = "{\"url\": \"" + signal_server.url() + "\", \"ice_mode\": \"local\","
+                   " \"local_transport\": false}";
+
 //  test_normal();
   test_writable();
 
+  signal_server.Stop();
   std::cout << "Exit test" << std::endl;
   return 0;
 }
@@ -36,6 +50,9 @@ void test_normal() {
   Peer peer1(server_id);
   Peer peer2(client_id);
 
+  peer1.SetOptions(signal_options);
+  peer2.SetOptions(signal_options);
+
   peer1.On("open", function_peer( string peer_id ) {
     assert(peer_id == server_id);
     std::cout << "peer1: open" << std::endl;
@@ -110,6 +127,9 @@ void test_writable() {
   Peer peer1(server_id);
   Peer peer2(client_id);
 
+  peer1.SetOptions(signal_options);
+  peer2.SetOptions(signal_options);
+
   peer1.On("open", function_peer( string peer_id ) {
     assert(peer_id == server_id);
     std::cout << "peer1: open" << std::endl;
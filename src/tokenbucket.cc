@@ -0,0 +1,66 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "tokenbucket.h"
+
+namespace peerapi {
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate),
+      burst_(std::max<double>(burst, 1)),
+      tokens_(std::max<double>(burst, 1)),
+      last_(clock::now()) {
+}
+
+void TokenBucket::Set(double rate, double burst) {
+  std::lock_guard<std::mutex> guard(lock_);
+  rate = std::max<double>(rate, 0);
+  burst = std::max<double>(burst, 1);
+
+  // Keep the tokens of a bucket that is configured again with the same limit
+  if (rate == rate_ && burst == burst_) return;
+
+  // Tokens earned at the previous rate are kept
+  Refill(clock::now());
+  rate_ = rate;
+  burst_ = burst;
+  tokens_ = std::min<double>(tokens_, burst_);
+  last_ = clock::now();
+}
+
+bool TokenBucket::enabled() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return rate_ > 0;
+}
+
+unsigned TokenBucket::Take() {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  if (rate_ <= 0) return 0;
+
+  Refill(clock::now());
+
+  if (tokens_ >= 1) {
+    tokens_ -= 1;
+    return 0;
+  }
+
+  double wait = (1 - tokens_) / rate_ * 1000;
+  return std::max<unsigned>(static_cast<unsigned>(std::ceil(wait)), 1);
+}
+
+void TokenBucket::Refill(clock::time_point now) {
+  double elapsed = std::chrono::duration<double>(now - last_).count();
+  if (elapsed <= 0) return;
+
+  tokens_ = std::min<double>(tokens_ + elapsed * rate_, burst_);
+  last_ = now;
+}
+
+} // namespace peerapi
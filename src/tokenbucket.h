@@ -0,0 +1,49 @@
+/*
+ *  Copyright 2016 The PeerApi Project Authors. All rights reserved.
+ *
+ *  Ryan Lee
+ */
+
+#ifndef __PEERAPI_TOKENBUCKET_H__
+#define __PEERAPI_TOKENBUCKET_H__
+
+#include <chrono>
+#include <mutex>
+
+namespace peerapi {
+
+//
+// class TokenBucket
+//
+// A thread-safe token bucket rate limiter. A rate of 0 disables the limit.
+//
+
+class TokenBucket {
+public:
+  // rate: Tokens per second
+  // burst: Maximum number of tokens in the bucket
+  explicit TokenBucket(double rate = 0, double burst = 1);
+
+  // Changes the limit. The tokens are kept if rate and burst are the same.
+  void Set(double rate, double burst);
+  bool enabled();
+
+  // Take a token. Returns 0 if taken, otherwise milliseconds to wait
+  // until a token is available.
+  unsigned Take();
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  void Refill(clock::time_point now);
+
+  std::mutex lock_;
+  double rate_;
+  double burst_;
+  double tokens_;
+  clock::time_point last_;
+};
+
+} // namespace peerapi
+
+#endif // __PEERAPI_TOKENBUCKET_H__